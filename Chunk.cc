@@ -0,0 +1,621 @@
+#include "Chunk.h"
+#include "Nodes.h"
+#include "globals.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+// The nodes the parser makes, statements first. Their order is the file's, changing it changes the version
+enum Kind : uint32_t
+{
+	BLOCK, ASSIGNMENT, MULTIPLE_ASSIGNMENT, CALL_STATEMENT, PRINT, IF_STATEMENT, IF, ELSE, FOR, FOR_IN, WHILE, REPEAT, RETURN, BREAK, LAZY_BLOCK,
+	VARIABLE, INTEGER, FLOAT, STRING, BOOLEAN, NIL, TABLE_CONSTRUCTOR, INDEX, FUNCTION, CALL, BINARY_OPERATION, LOGICAL_OPERATION, UNARY_OPERATION, PARENTHESIS,
+	KIND_COUNT
+};
+
+static const char* const tags[KIND_COUNT] =
+{
+	"Block", "AssignmentNode", "MultipleAssignmentNode", "CallStatementNode", "PrintNode", "IfStatementNode", "IfNode", "ElseNode", "ForNode", "ForInNode", "WhileNode", "RepeatNode", "ReturnNode", "BreakNode", "LazyBlock",
+	"VariableNode", "IntegerNode", "FloatNode", "StringNode", "BooleanNode", "NilNode", "TableConstructorNode", "IndexNode", "FunctionNode", "CallNode", "BinaryOperationNode", "LogicalOperationNode", "UnaryOperationNode", "ParenthesisNode"
+};
+
+static const char magic[4] = { '\x1b', 'L', 'u', 'c' };
+
+// What the tree was parsed with, beside the source
+static uint32_t flags()
+{
+	return lazy_functions ? 1 : 0;
+}
+
+
+
+Chunk::Chunk()
+{
+	this->environment = nullptr;
+	this->source = nullptr;
+	this->data = nullptr;
+	this->entries = nullptr;
+	this->strings = 0;
+	this->position = nullptr;
+	this->end = nullptr;
+	this->isBroken = false;
+	this->mapped = nullptr;
+	this->size = 0;
+}
+
+// FNV-1a
+uint64_t Chunk::hash(const char* text, long unsigned int length)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (long unsigned int i = 0; i < length; i++)
+	{
+		hash ^= static_cast<unsigned char>(text[i]);
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+// Writes the tree to a file next to path and renames it over path, so a run reading path at
+// the same time finds the old file or the new one. False when the tree has a node the parser
+// does not make, or the file can not be written
+bool Chunk::save(const std::string& path, uint64_t hash, Statement* root)
+{
+	Chunk chunk;
+	chunk.write(root);
+	if (chunk.isBroken)
+		return false;
+
+	return chunk.saveFile(path, magic, version, hash);
+}
+
+// The tree saved in path, not optimized yet. Null when there is no such file, or it is from
+// another version, source or options, or it is cut short
+Statement* Chunk::load(const std::string& path, uint64_t hash, Environment* environment, std::string* source)
+{
+	Chunk chunk;
+	chunk.environment = environment;
+	chunk.source = source;
+
+	Statement* root = chunk.map(path, magic, version, hash) ? chunk.statement() : nullptr;
+	if (chunk.position != chunk.end)
+		chunk.isBroken = true;
+
+	chunk.unmap();
+	return chunk.isBroken ? nullptr : root;
+}
+
+// The words written, the strings interned and a header over them
+bool Chunk::saveFile(const std::string& path, const char* magic, uint32_t version, uint64_t hash)
+{
+	uint64_t tableSize = 2 * sizeof(uint32_t) * table.size();
+	uint64_t offset = sizeof(Header) + tableSize + sizeof(uint32_t) * words.size();
+	std::vector<uint32_t> entries;
+	for (auto& text : table)
+	{
+		entries.push_back(offset);
+		entries.push_back(text.size());
+		offset += text.size();
+	}
+
+	Header header;
+	memcpy(header.magic, magic, sizeof(header.magic));
+	header.version = version;
+	header.hash = hash;
+	header.flags = flags();
+	header.strings = table.size();
+	header.words = words.size();
+	header.size = offset;
+
+	std::string body(reinterpret_cast<const char*>(entries.data()), sizeof(uint32_t) * entries.size());
+	body.append(reinterpret_cast<const char*>(words.data()), sizeof(uint32_t) * words.size());
+	for (auto& text : table)
+		body += text;
+	header.check = Chunk::hash(body.data(), body.size());
+
+	std::string temporary = path + "." + std::to_string(getpid());
+	FILE* file = fopen(temporary.c_str(), "wb");
+	if (!file)
+		return false;
+
+	bool isWritten = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(body.data(), 1, body.size(), file) == body.size();
+	isWritten = fclose(file) == 0 && isWritten;
+
+	if (!isWritten || rename(temporary.c_str(), path.c_str()) != 0)
+	{
+		remove(temporary.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+// Maps the file and checks its header, the words are then read from position. False when
+// there is no such file, or its header does not match, or it is cut short
+bool Chunk::map(const std::string& path, const char* magic, uint32_t version, uint64_t hash)
+{
+	int file = open(path.c_str(), O_RDONLY);
+	if (file < 0)
+	{
+		isBroken = true;
+		return false;
+	}
+
+	struct stat status;
+	if (fstat(file, &status) != 0 || status.st_size < static_cast<off_t>(sizeof(Header)))
+	{
+		close(file);
+		isBroken = true;
+		return false;
+	}
+
+	size = status.st_size;
+	mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+	if (mapped == MAP_FAILED)
+	{
+		mapped = nullptr;
+		isBroken = true;
+		return false;
+	}
+
+	data = static_cast<const char*>(mapped);
+
+	const Header* header = static_cast<const Header*>(mapped);
+	uint64_t tableSize = 2 * sizeof(uint32_t) * static_cast<uint64_t>(header->strings);
+	isBroken = memcmp(header->magic, magic, sizeof(header->magic)) != 0 || header->version != version || header->hash != hash
+		|| header->flags != flags() || header->size != size || header->words > size / sizeof(uint32_t)
+		|| sizeof(Header) + tableSize + sizeof(uint32_t) * header->words > size
+		|| header->check != Chunk::hash(data + sizeof(Header), size - sizeof(Header));
+
+	if (!isBroken)
+	{
+		entries = reinterpret_cast<const uint32_t*>(data + sizeof(Header));
+		strings = header->strings;
+		position = entries + 2 * strings;
+		end = position + header->words;
+
+		for (uint32_t i = 0; i < strings; i++)
+			if (static_cast<uint64_t>(entries[2 * i]) + entries[2 * i + 1] > size)
+				isBroken = true;
+	}
+
+	return !isBroken;
+}
+
+// Once the nodes are built, they copy the strings they keep
+void Chunk::unmap()
+{
+	if (mapped)
+		munmap(mapped, size);
+
+	mapped = nullptr;
+	data = nullptr;
+	entries = nullptr;
+	position = nullptr;
+	end = nullptr;
+}
+
+// The node as words, see the class comment
+void Chunk::write(Node* node)
+{
+	uint32_t kind = 0;
+	while (kind < KIND_COUNT && node->tag != tags[kind])
+		kind++;
+
+	if (kind == KIND_COUNT && node->tag == "TemporaryNode") // Left by value numbering, the expression it holds the value of
+	{
+		write(node->children[0]);
+		return;
+	}
+
+	if (kind == KIND_COUNT) // Made by a pass
+	{
+		isBroken = true;
+		return;
+	}
+
+	words.push_back(kind);
+	words.push_back(kind < VARIABLE ? static_cast<Statement*>(node)->line : 0);
+
+	switch (kind)
+	{
+		case ASSIGNMENT:
+			words.push_back(node->value == "local");
+			break;
+		case MULTIPLE_ASSIGNMENT:
+			words.push_back(node->value == "local");
+			words.push_back(static_cast<MultipleAssignmentNode*>(node)->targetList().size());
+			break;
+		case FOR_IN:
+			words.push_back(static_cast<ForInNode*>(node)->nameList().size());
+			break;
+		case FOR:
+		case VARIABLE:
+		case STRING:
+		case CALL: // The method, empty for f(...)
+			words.push_back(intern(node->value));
+			break;
+		case LAZY_BLOCK:
+		{
+			LazyBlock* block = static_cast<LazyBlock*>(node);
+			words.push_back(intern(block->name));
+			words.push_back(intern(block->source));
+			words.push_back(block->column);
+			break;
+		}
+		case INTEGER:
+		{
+			int value = 0;
+			static_cast<Expression*>(node)->evaluate(value);
+			words.push_back(value);
+			break;
+		}
+		case FLOAT:
+		{
+			float value = 0.0;
+			static_cast<Expression*>(node)->evaluate(value);
+			uint32_t bits = 0;
+			memcpy(&bits, &value, sizeof(bits));
+			words.push_back(bits);
+			break;
+		}
+		case BOOLEAN:
+		{
+			bool value = false;
+			static_cast<Expression*>(node)->evaluate(value);
+			words.push_back(value);
+			break;
+		}
+		case TABLE_CONSTRUCTOR: // Which fields have a key
+		{
+			const std::vector<std::pair<Expression*, Expression*>>& fields = static_cast<TableConstructorNode*>(node)->fieldList();
+			words.push_back(fields.size());
+			for (auto& field : fields)
+				words.push_back(field.first != nullptr);
+			break;
+		}
+		case FUNCTION:
+		{
+			const std::vector<std::string>& parameters = static_cast<FunctionNode*>(node)->parameterList();
+			words.push_back(parameters.size());
+			for (auto& parameter : parameters)
+				words.push_back(intern(parameter));
+			break;
+		}
+		case BINARY_OPERATION:
+			words.push_back(static_cast<BinaryOperationNode*>(node)->operation);
+			break;
+		case LOGICAL_OPERATION:
+			words.push_back(static_cast<LogicalOperationNode*>(node)->operation);
+			break;
+		case UNARY_OPERATION:
+			words.push_back(static_cast<UnaryOperationNode*>(node)->operation);
+			break;
+		default:
+			break;
+	}
+
+	words.push_back(node->children.size());
+	for (auto child : node->children)
+		write(child);
+}
+
+uint32_t Chunk::intern(const std::string& text)
+{
+	auto found = interned.find(text);
+	if (found != interned.end())
+		return found->second;
+
+	table.push_back(text);
+	return interned[text] = table.size() - 1;
+}
+
+uint32_t Chunk::next()
+{
+	if (position == end)
+	{
+		isBroken = true;
+		return 0;
+	}
+
+	return *position++;
+}
+
+std::string Chunk::string()
+{
+	uint32_t index = next();
+	if (index >= strings)
+	{
+		isBroken = true;
+		return "";
+	}
+
+	return std::string(data + entries[2 * index], entries[2 * index + 1]);
+}
+
+// The node at position, null once the words do not make a tree the parser could have made
+Node* Chunk::read()
+{
+	uint32_t kind = next();
+	int line = next();
+	if (kind >= KIND_COUNT)
+		isBroken = true;
+	if (isBroken)
+		return nullptr;
+
+	Node* node = nullptr;
+	switch (kind)
+	{
+		case ASSIGNMENT:
+		case MULTIPLE_ASSIGNMENT:
+		{
+			bool isLocal = next() != 0;
+			uint32_t targets = kind == ASSIGNMENT ? 1 : next();
+			uint32_t count = next();
+			if (kind == ASSIGNMENT ? count != 2 : targets > count)
+				isBroken = true;
+
+			std::vector<Expression*> variables, expressions;
+			for (uint32_t i = 0; i < count && !isBroken; i++)
+				(i < targets ? variables : expressions).push_back(expression());
+			if (isBroken)
+				return nullptr;
+
+			if (kind == ASSIGNMENT)
+				node = new AssignmentNode(environment, variables[0], expressions[0], isLocal);
+			else
+				node = new MultipleAssignmentNode(environment, variables, expressions, isLocal);
+			break;
+		}
+		case FOR:
+		{
+			std::string name = string();
+			uint32_t count = next();
+			if (count != 3 && count != 4)
+				isBroken = true;
+
+			std::vector<Expression*> expressions;
+			for (uint32_t i = 0; i + 1 < count && !isBroken; i++)
+				expressions.push_back(expression());
+			Statement* block = isBroken ? nullptr : statement();
+			if (isBroken)
+				return nullptr;
+
+			node = new ForNode(environment, name, expressions[0], expressions[1], count == 4 ? expressions[2] : nullptr, block);
+			break;
+		}
+		case FOR_IN:
+		{
+			uint32_t names = next();
+			uint32_t count = next();
+			if (names == 0 || names + 2 > count || count > static_cast<uint32_t>(end - position))
+				isBroken = true;
+
+			std::vector<Expression*> variables, expressions;
+			for (uint32_t i = 0; i + 1 < count && !isBroken; i++)
+				(i < names ? variables : expressions).push_back(expression());
+			Statement* block = isBroken ? nullptr : statement();
+			for (auto variable : variables)
+				if (!isBroken && variable->tag != "VariableNode")
+					isBroken = true;
+			if (isBroken)
+				return nullptr;
+
+			node = new ForInNode(environment, variables, expressions, block);
+			break;
+		}
+		case LAZY_BLOCK:
+		{
+			std::string name = string();
+			std::string source = string();
+			int column = next();
+			if (next() != 0)
+				isBroken = true;
+			if (isBroken)
+				return nullptr;
+
+			node = new LazyBlock(environment, name, source, line, column);
+			break;
+		}
+		case VARIABLE:
+		case STRING:
+		{
+			std::string text = string();
+			if (next() != 0)
+				isBroken = true;
+			if (isBroken)
+				return nullptr;
+
+			if (kind == VARIABLE)
+				node = new VariableNode(environment, text);
+			else
+				node = new StringNode(text);
+			break;
+		}
+		case INTEGER:
+		case FLOAT:
+		case BOOLEAN:
+		{
+			uint32_t bits = next();
+			if (next() != 0)
+				isBroken = true;
+			if (isBroken)
+				return nullptr;
+
+			if (kind == INTEGER)
+				node = new IntegerNode(static_cast<int>(bits));
+			else if (kind == BOOLEAN)
+				node = new BooleanNode(bits != 0);
+			else
+			{
+				float value = 0.0;
+				memcpy(&value, &bits, sizeof(value));
+				node = new FloatNode(value);
+			}
+			break;
+		}
+		case TABLE_CONSTRUCTOR:
+		{
+			uint32_t count = next();
+			if (count > static_cast<uint32_t>(end - position))
+				isBroken = true;
+
+			std::vector<bool> isKeyed;
+			uint32_t children = 0;
+			for (uint32_t i = 0; i < count && !isBroken; i++)
+			{
+				isKeyed.push_back(next() != 0);
+				children += isKeyed.back() ? 2 : 1;
+			}
+			if (next() != children)
+				isBroken = true;
+
+			std::vector<std::pair<Expression*, Expression*>> fields;
+			for (uint32_t i = 0; i < count && !isBroken; i++)
+			{
+				Expression* key = isKeyed[i] ? expression() : nullptr;
+				Expression* value = isBroken ? nullptr : expression();
+				fields.push_back(std::make_pair(key, value));
+			}
+			if (isBroken)
+				return nullptr;
+
+			node = new TableConstructorNode(fields);
+			break;
+		}
+		case FUNCTION:
+		{
+			uint32_t count = next();
+			if (count > static_cast<uint32_t>(end - position))
+				isBroken = true;
+
+			std::vector<std::string> parameters;
+			for (uint32_t i = 0; i < count && !isBroken; i++)
+				parameters.push_back(string());
+			if (next() != 1)
+				isBroken = true;
+
+			Statement* block = isBroken ? nullptr : statement();
+			if (isBroken)
+				return nullptr;
+
+			node = new FunctionNode(environment, parameters, block, source);
+			break;
+		}
+		case BINARY_OPERATION:
+		case LOGICAL_OPERATION:
+		case UNARY_OPERATION:
+		{
+			uint32_t operation = next();
+			uint32_t count = next();
+			uint32_t operations = kind == BINARY_OPERATION ? BinaryOperationNode::Operation::MORE_OR_EQUAL + 1 : 2;
+			if (operation >= operations || count != (kind == UNARY_OPERATION ? 1u : 2u))
+				isBroken = true;
+
+			Expression* left = isBroken ? nullptr : expression();
+			Expression* right = isBroken || count == 1 ? nullptr : expression();
+			if (isBroken)
+				return nullptr;
+
+			if (kind == BINARY_OPERATION)
+				node = new BinaryOperationNode(left, right, static_cast<BinaryOperationNode::Operation>(operation));
+			else if (kind == LOGICAL_OPERATION)
+				node = new LogicalOperationNode(left, right, static_cast<LogicalOperationNode::Operation>(operation));
+			else
+				node = new UnaryOperationNode(left, static_cast<UnaryOperationNode::Operation>(operation));
+			break;
+		}
+		case CALL:
+		{
+			std::string method = string();
+			uint32_t count = next();
+			if (count == 0)
+				isBroken = true;
+
+			Expression* function = isBroken ? nullptr : expression();
+			std::vector<Expression*> arguments;
+			for (uint32_t i = 1; i < count && !isBroken; i++)
+				arguments.push_back(expression());
+			if (isBroken)
+				return nullptr;
+
+			if (method.empty())
+				node = new CallNode(function, arguments);
+			else
+				node = new CallNode(function, method, arguments);
+			break;
+		}
+		default: // Only children, statements for the first kinds and expressions after
+		{
+			uint32_t count = next();
+			uint32_t expected = count;
+			if (kind == IF || kind == WHILE || kind == REPEAT || kind == INDEX)
+				expected = 2;
+			else if (kind == CALL_STATEMENT || kind == ELSE || kind == PARENTHESIS)
+				expected = 1;
+			else if (kind == BREAK || kind == NIL)
+				expected = 0;
+			if (count != expected || count > static_cast<uint32_t>(end - position))
+				isBroken = true;
+
+			std::vector<Statement*> statements;
+			std::vector<Expression*> expressions;
+			for (uint32_t i = 0; i < count && !isBroken; i++)
+			{
+				bool isStatement = kind == BLOCK || kind == IF_STATEMENT || kind == ELSE || ((kind == IF || kind == WHILE) && i == 1) || (kind == REPEAT && i == 0);
+				if (isStatement)
+					statements.push_back(statement());
+				else
+					expressions.push_back(expression());
+			}
+			if (isBroken)
+				return nullptr;
+
+			switch (kind)
+			{
+				case BLOCK: node = new Block(environment, statements); break;
+				case CALL_STATEMENT: node = new CallStatementNode(expressions[0]); break;
+				case PRINT: node = new PrintNode(environment, expressions); break;
+				case IF_STATEMENT: node = new IfStatementNode(statements); break;
+				case IF: node = new IfNode(expressions[0], statements[0]); break;
+				case ELSE: node = new ElseNode(statements[0]); break;
+				case WHILE: node = new WhileNode(environment, expressions[0], statements[0]); break;
+				case REPEAT: node = new RepeatNode(environment, statements[0], expressions[0]); break;
+				case RETURN: node = new ReturnNode(environment, expressions); break;
+				case BREAK: node = new BreakNode(environment); break;
+				case NIL: node = NilNode::instance(); break;
+				case INDEX: node = new IndexNode(expressions[0], expressions[1]); break;
+				case PARENTHESIS: node = new ParenthesisNode(expressions[0]); break;
+				default: break;
+			}
+			break;
+		}
+	}
+
+	if (kind < VARIABLE)
+		static_cast<Statement*>(node)->line = line;
+
+	return node;
+}
+
+Expression* Chunk::expression()
+{
+	if (position != end && *position < VARIABLE)
+		isBroken = true;
+
+	return isBroken ? nullptr : static_cast<Expression*>(read());
+}
+
+Statement* Chunk::statement()
+{
+	if (position != end && *position >= VARIABLE)
+		isBroken = true;
+
+	return isBroken ? nullptr : static_cast<Statement*>(read());
+}
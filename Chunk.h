@@ -0,0 +1,77 @@
+#ifndef CHUNK_H
+#define CHUNK_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Environment;
+class Expression;
+class Node;
+class Statement;
+
+// A parsed program saved to a file, run again without lexing and parsing its source
+// (./parser cache=file).
+//
+// The file holds a header, the strings of the tree interned in a table, and the tree before
+// any pass ran, each node as 32-bit words: its kind, its line, what its constructor takes
+// besides children, then its children. A string is its index in the table. The header has a
+// version, bumped whenever the nodes or their words change, and a hash of the source, so a
+// file from another version or source is parsed again and overwritten, as is a damaged one. Loading maps the file
+// and builds the nodes straight from it, the passes then run as after parsing.
+class Chunk
+{
+protected:
+	struct Header
+	{
+		char magic[4];
+		uint32_t version;
+		uint64_t hash; // Of the source
+		uint32_t flags; // Options the tree depends on
+		uint32_t strings; // Entries in the table, each an offset and a length, after the header
+		uint64_t words; // Of the tree, after the table
+		uint64_t size; // Of the file, the text of the strings last
+		uint64_t check; // Hash of the file after the header, nodes the parser could not make may crash
+	};
+
+	// Saving
+	std::vector<uint32_t> words;
+	std::vector<std::string> table;
+	std::unordered_map<std::string, uint32_t> interned;
+
+	// Loading
+	Environment* environment;
+	std::string* source; // The name the functions loaded keep
+	const char* data;
+	const uint32_t* entries;
+	uint32_t strings;
+	const uint32_t* position;
+	const uint32_t* end;
+	bool isBroken;
+	void* mapped;
+	long unsigned int size;
+
+	Chunk();
+
+	void write(Node* node);
+	uint32_t intern(const std::string& text);
+	bool saveFile(const std::string& path, const char* magic, uint32_t version, uint64_t hash);
+
+	bool map(const std::string& path, const char* magic, uint32_t version, uint64_t hash);
+	void unmap();
+	uint32_t next();
+	std::string string();
+	Node* read();
+	Expression* expression();
+	Statement* statement();
+
+public:
+	static const uint32_t version = 2;
+
+	static uint64_t hash(const char* text, long unsigned int length);
+	static bool save(const std::string& path, uint64_t hash, Statement* root);
+	static Statement* load(const std::string& path, uint64_t hash, Environment* environment, std::string* source);
+};
+
+#endif
@@ -0,0 +1,574 @@
+#include "Compilation.h"
+#include "Chunk.h"
+#include "Optimizer.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+
+// Where every line starts, the first at 0
+static std::vector<long unsigned int> lineStarts(const char* text, long unsigned int length)
+{
+	std::vector<long unsigned int> starts = { 0 };
+	const char* newline = text;
+	while ((newline = static_cast<const char*>(memchr(newline, '\n', text + length - newline))))
+		starts.push_back(++newline - text);
+
+	return starts;
+}
+
+static long unsigned int lineOffset(const std::vector<long unsigned int>& starts, int line, long unsigned int length)
+{
+	return line >= 1 && line <= static_cast<int>(starts.size()) ? starts[line - 1] : length;
+}
+
+// Lines with the same text and newline, counted from 0
+static bool isSameLine(const char* text, long unsigned int length, const std::vector<long unsigned int>& starts, int line,
+	const char* otherText, long unsigned int otherLength, const std::vector<long unsigned int>& otherStarts, int otherLine)
+{
+	long unsigned int begin = starts[line], end = lineOffset(starts, line + 2, length);
+	long unsigned int otherBegin = otherStarts[otherLine], otherEnd = lineOffset(otherStarts, otherLine + 2, otherLength);
+
+	return end - begin == otherEnd - otherBegin && memcmp(text + begin, otherText + otherBegin, end - begin) == 0;
+}
+
+// The first character from i on that is not whitespace or in a comment, or end
+static long unsigned int skipBlank(const char* text, long unsigned int i, long unsigned int end)
+{
+	while (i < end)
+	{
+		if (text[i] == ' ' || text[i] == '\t' || text[i] == '\n' || text[i] == '\r')
+			i++;
+		else if (text[i] == '-' && i + 1 < end && text[i + 1] == '-')
+			while (i < end && text[i] != '\n')
+				i++;
+		else
+			break;
+	}
+
+	return i;
+}
+
+// False when a string starts in the text and does not end in it
+static bool isClosed(const char* text, long unsigned int length)
+{
+	for (long unsigned int i = 0; i < length; i++)
+	{
+		if (text[i] == '-' && i + 1 < length && text[i + 1] == '-')
+		{
+			while (i < length && text[i] != '\n')
+				i++;
+		}
+		else if (text[i] == '"')
+		{
+			const char* close = static_cast<const char*>(memchr(text + i + 1, '"', length - i - 1));
+			if (!close)
+				return false;
+			i = close - text;
+		}
+	}
+
+	return true;
+}
+
+// What a run statement may leave with the environment as it is, and everything under it: a
+// function can be called later, tables and lists of values are stored without copies
+static bool isHeld(Node* node)
+{
+	return node->tag == "FunctionNode" || node->tag == "BuiltinFunctionNode" || node->tag == "TableNode" || node->tag == "ValueListNode" || node->tag == "NilNode";
+}
+
+// Freed with their statement unless stored, see stored() in Nodes.cc
+static bool isLiteral(Node* node)
+{
+	return node->tag == "IntegerNode" || node->tag == "FloatNode" || node->tag == "StringNode" || node->tag == "BooleanNode";
+}
+
+// The nodes under node, each once as value numbering shares some. What is held stops the walk,
+// its root goes to roots
+static void collect(Node* node, std::unordered_set<Node*>& nodes, std::unordered_set<Node*>& roots)
+{
+	if (!node || !nodes.insert(node).second)
+		return;
+
+	if (isHeld(node))
+	{
+		roots.insert(node);
+		return;
+	}
+
+	for (auto child : node->children)
+		collect(child, nodes, roots);
+}
+
+static void collect(Node* node, std::unordered_set<Node*>& nodes)
+{
+	if (!node || !nodes.insert(node).second)
+		return;
+
+	for (auto child : node->children)
+		collect(child, nodes);
+}
+
+
+
+Compilation::Compilation(const std::string& name, long unsigned int jobs, Environment* environment)
+{
+	this->name = name;
+	this->jobs = jobs;
+	this->environment = environment;
+	this->sourceName = environment->sourceName(name);
+	this->root = nullptr;
+	this->length = 0;
+	this->complete = 0;
+	this->input = nullptr;
+	this->isReparsable = false;
+	this->isBody = false;
+	this->scanner = nullptr;
+	this->optimizer = nullptr;
+	this->isStopped = false;
+	this->isInteractive = false;
+	this->isInHeader = false;
+	this->isBodyNext = false;
+}
+
+Compilation::~Compilation()
+{
+	if (scanner)
+		closeScanner(*this);
+	delete optimizer;
+}
+
+void Compilation::load(FILE* file)
+{
+	char chunk[65536];
+	long unsigned int size = 0;
+	while ((size = fread(chunk, 1, sizeof(chunk), file)) > 0)
+		source.insert(source.end(), chunk, chunk + size);
+
+	length = source.size();
+	complete = length;
+	source.resize(length + padding, '\0');
+	starts.clear();
+}
+
+void Compilation::load(const char* text, long unsigned int length)
+{
+	source.assign(text, text + length);
+	this->length = length;
+	complete = length;
+	source.resize(length + padding, '\0');
+	starts.clear();
+}
+
+// Nothing is read yet, the scanner refills as it goes
+void Compilation::stream(FILE* file)
+{
+	input = file;
+	isInteractive = isatty(fileno(file));
+	source.assign(padding, '\0');
+	length = 0;
+	complete = 0;
+	optimizer = new Optimizer(environment, jobs);
+}
+
+bool Compilation::isStreaming()
+{
+	return optimizer != nullptr;
+}
+
+// True when the source parsed, root is then the optimized tree
+bool Compilation::parse()
+{
+	origin = location.begin;
+	isInHeader = false;
+	isBodyNext = false;
+
+	openScanner(*this);
+	yy::parser parser(*this);
+	bool isParsed = parser.parse() == 0;
+	closeScanner(*this);
+
+	return isParsed;
+}
+
+// True when path holds the tree of this source, saved by a run before (./parser cache=file).
+// root is then that tree optimized, as if it was parsed
+bool Compilation::loadChunk(const std::string& path)
+{
+	Statement* tree = Chunk::load(path, Chunk::hash(source.data(), length), environment, sourceName);
+	if (!tree)
+		return false;
+
+	Optimizer optimizer(environment, jobs);
+	root = optimizer.run(tree);
+	return true;
+}
+
+// Parses the file's source in place of the one parsed, keeping the statements an edit did not
+// touch when reparsable. Falls back to parsing all of it when the source did not parse before,
+// or the reparsed lines may parse otherwise within the rest
+bool Compilation::reparse(FILE* file)
+{
+	std::vector<char> parsed;
+	parsed.swap(source);
+	long unsigned int parsedLength = length;
+
+	load(file);
+	errors.clear();
+
+	if (!isReparsable || !root)
+		return parseAll();
+
+	std::vector<long unsigned int> before = lineStarts(parsed.data(), parsedLength);
+	std::vector<long unsigned int> after = lineStarts(source.data(), length);
+	int beforeLines = before.size(), afterLines = after.size();
+
+	// The lines edited, in the parsed source, none when last is before first
+	int same = 0, sameEnd = 0, fewer = std::min(beforeLines, afterLines);
+	while (same < fewer && isSameLine(parsed.data(), parsedLength, before, same, source.data(), length, after, same))
+		same++;
+	while (sameEnd < fewer - same && isSameLine(parsed.data(), parsedLength, before, beforeLines - 1 - sameEnd, source.data(), length, after, afterLines - 1 - sameEnd))
+		sameEnd++;
+	int first = same + 1, last = beforeLines - sameEnd;
+
+	// Widened to whole statements, a line may hold the end of one and the start of the next
+	bool isWidened = true;
+	while (isWidened)
+	{
+		isWidened = false;
+		for (auto& part : parts)
+		{
+			if (part.first <= last && part.last >= first && (part.first < first || part.last > last))
+			{
+				first = std::min(first, part.first);
+				last = std::max(last, part.last);
+				isWidened = true;
+			}
+		}
+	}
+
+	int delta = afterLines - beforeLines;
+	long unsigned int begin = lineOffset(after, first, length), end = lineOffset(after, last + delta + 1, length);
+
+	// A parenthesis may continue the expression before it, and a string open at the end would go on below
+	if (source[skipBlank(source.data(), begin, end)] == '(' || source[skipBlank(source.data(), end, length)] == '(' || !isClosed(source.data() + begin, end - begin))
+		return parseAll();
+
+	Compilation edited(name, jobs, environment);
+	edited.isReparsable = true;
+	edited.load(source.data() + begin, end - begin);
+	edited.location.initialize(nullptr, first);
+	if (!edited.parse())
+		return parseAll();
+
+	std::vector<Part> reparsed, below;
+	for (auto& part : parts)
+	{
+		if (part.last < first)
+			reparsed.push_back(part);
+		else if (part.first > last)
+			below.push_back(part);
+	}
+	long unsigned int above = reparsed.size();
+	reparsed.insert(reparsed.end(), edited.parts.begin(), edited.parts.end());
+	reparsed.insert(reparsed.end(), below.begin(), below.end());
+
+	// Only the last statement may be a return or break
+	for (long unsigned int i = 0; i + 1 < reparsed.size(); i++)
+		if (!reparsed[i].block->children.empty() && (reparsed[i].block->children[0]->tag == "ReturnNode" || reparsed[i].block->children[0]->tag == "BreakNode"))
+			return parseAll();
+
+	// The statements below the edit move, and so do bodies inlined from them above it
+	if (delta != 0)
+	{
+		long unsigned int moved = above + edited.parts.size();
+		for (long unsigned int i = 0; i < reparsed.size(); i++)
+		{
+			if (i >= above && i < moved) // Parsed at the lines they are on now
+				continue;
+
+			Part& part = reparsed[i];
+			shiftLines(part.block, last, delta);
+			if (i >= moved)
+			{
+				part.first += delta;
+				part.last += delta;
+				part.block->line += delta;
+			}
+		}
+	}
+
+	std::vector<Statement*> blocks;
+	for (auto& part : reparsed)
+		blocks.push_back(part.block);
+
+	parts = std::move(reparsed);
+	root = new Block(environment, std::move(blocks));
+
+	return true;
+}
+
+bool Compilation::parseAll()
+{
+	parts.clear();
+	root = nullptr;
+	location.initialize();
+
+	return parse();
+}
+
+// The scanner's next token. With lazy functions, the tokens of a function body are skipped
+// and make one BODY token, except when streamed, as the text of a body may be dropped by then
+yy::parser::symbol_type Compilation::next()
+{
+	if (isBodyNext)
+	{
+		isBodyNext = false;
+		return skipBody();
+	}
+
+	yy::parser::symbol_type token = nextToken(*this);
+	if (lazy_functions && !isStreaming())
+	{
+		if (token.kind() == yy::parser::symbol_kind::S_FUNCTION)
+			isInHeader = true;
+		else if (token.kind() == yy::parser::symbol_kind::S_RROUND && isInHeader)
+		{
+			isInHeader = false;
+			isBodyNext = true;
+		}
+	}
+
+	return token;
+}
+
+// The body after the function header just scanned. Blocks open with function, do, if and
+// repeat and close with end and until, so the end closing the body is found from the tokens
+// alone. At the end of the source the parser gets that instead, and reports it
+yy::parser::symbol_type Compilation::skipBody()
+{
+	yy::position begin = location.end;
+	int depth = 1;
+	while (true)
+	{
+		yy::parser::symbol_type token = nextToken(*this);
+		switch (token.kind())
+		{
+			case yy::parser::symbol_kind::S_FUNCTION:
+			case yy::parser::symbol_kind::S_DO:
+			case yy::parser::symbol_kind::S_IF:
+			case yy::parser::symbol_kind::S_REPEAT:
+				depth++;
+				break;
+			case yy::parser::symbol_kind::S_END:
+			case yy::parser::symbol_kind::S_UNTIL:
+				depth--;
+				break;
+			case yy::parser::symbol_kind::S_YYEOF:
+				return token;
+			default:
+				break;
+		}
+
+		if (depth == 0)
+		{
+			long unsigned int first = offset(begin), last = offset(location.begin);
+			return yy::parser::make_BODY(Lexeme{ source.data() + first, last - first }, yy::location(begin, location.end));
+		}
+	}
+}
+
+// Where a position of the scanner is in the source
+long unsigned int Compilation::offset(const yy::position& position)
+{
+	if (position.line == origin.line)
+		return position.column - origin.column;
+
+	if (starts.empty())
+		starts = lineStarts(source.data(), length);
+	return lineOffset(starts, position.line - origin.line + 1, length) + position.column - 1;
+}
+
+// Drops the source before consumed and reads a line, for the hand-written scanner. Reading no
+// more than a line keeps a pipe from waiting for input the statements so far do not need.
+// False once the input is all read, complete is then the end
+bool Compilation::refill(long unsigned int consumed)
+{
+	if (!input)
+		return false;
+
+	source.erase(source.begin(), source.begin() + consumed);
+	length -= consumed;
+	source.resize(length);
+
+	if (isInteractive)
+		environment->output.flush();
+
+	char* line = nullptr;
+	size_t capacity = 0;
+	ssize_t size = getline(&line, &capacity, input);
+	if (size > 0)
+		source.insert(source.end(), line, line + size);
+	if (size <= 0 || line[size - 1] != '\n') // Only the last line has no newline
+		input = nullptr;
+	free(line);
+
+	length = source.size();
+	complete = length;
+
+	source.resize(length + padding, '\0');
+	return size > 0;
+}
+
+// Reads a line into buffer for flex, which reads a streamed source itself. Its own reading waits
+// for a whole buffer. 0 once the input is all read
+int Compilation::readLine(char* buffer, int size)
+{
+	if (isInteractive)
+		environment->output.flush();
+
+	if (!fgets(buffer, size, input))
+		return 0;
+	return strlen(buffer);
+}
+
+// The token text as it can be kept: a view into the source, or a copy once the source may be dropped
+Lexeme Compilation::lexeme(const char* text, long unsigned int length)
+{
+	if (!isStreaming())
+		return Lexeme{ text, length };
+
+	copies.emplace_back(text, length);
+	return Lexeme{ copies.back().data(), length };
+}
+
+// A statement of the main chunk, run at once when streaming and else kept for the whole tree
+void Compilation::statement(std::vector<Statement*>& statements, Statement* statement, const yy::location& location)
+{
+	if (isReparsable)
+	{
+		Block* block = new Block(environment, { statement });
+		block->line = statement->line;
+		parts.push_back({ location.begin.line, location.end.line, block });
+		statement = block;
+	}
+
+	if (!isStreaming())
+	{
+		statements.push_back(statement);
+		return;
+	}
+
+	// The parser may have read the token after the statement, the newest copy is kept for it
+	while (copies.size() > 1)
+		copies.pop_front();
+
+	// Walked before and after optimizing, what folding drops and numbering adds is freed too
+	std::unordered_set<Node*> nodes, optimized, roots;
+	collect(statement, nodes, roots);
+
+	if (isStopped)
+	{
+		release(nodes, roots, nullptr);
+		return;
+	}
+
+	Statement* block = optimizer->runPart(new Block(environment, { statement }));
+	collect(block, optimized, roots);
+	for (auto temporary : optimizer->temporaries) // Not among the children of what they replaced
+		collect(temporary, optimized, roots);
+	nodes.insert(optimized.begin(), optimized.end());
+
+	release(nodes, roots, block);
+	isStopped = environment->controlFlow != Environment::ControlFlow::NORMAL;
+}
+
+// Runs the optimized statement of the streamed main chunk, unless it is null, then frees the
+// nodes of the statement. What the environment may hold of them moves to kept: the functions,
+// tables and value lists with everything under them, and the literals stored while it ran, which
+// are transient until then. An error leaves the statement as it is
+void Compilation::release(std::unordered_set<Node*>& nodes, const std::unordered_set<Node*>& roots, Statement* block)
+{
+	std::unordered_set<Node*> held;
+	for (auto root : roots)
+		collect(root, held);
+	for (auto node : held)
+		nodes.erase(node);
+
+	for (auto node : nodes)
+	{
+		if (isLiteral(node))
+			static_cast<Expression*>(node)->isTransient = true;
+	}
+
+	if (block)
+	{
+		environment->source = sourceName;
+		block->execute();
+	}
+
+	for (auto root : roots)
+	{
+		if (root->tag != "NilNode") // The one nil, never freed
+			kept.push_back(root);
+	}
+
+	for (auto node : nodes)
+	{
+		if (isLiteral(node) && !static_cast<Expression*>(node)->isTransient)
+			kept.push_back(node);
+		else
+			delete node;
+	}
+}
+
+// The main chunk, saved when asked to and optimized as a whole. Every part of a reparsable one
+// is optimized alone, and a function body by its function
+void Compilation::finish(std::vector<Statement*> statements)
+{
+	if (isStreaming())
+		return;
+
+	Block* block = new Block(environment, std::move(statements));
+	if (isBody)
+	{
+		root = block;
+		return;
+	}
+
+	if (!chunk.empty() && !isReparsable)
+		Chunk::save(chunk, Chunk::hash(source.data(), length), block);
+
+	Optimizer optimizer(environment, jobs);
+	root = isReparsable ? optimizer.runPart(block) : optimizer.run(block);
+}
+
+// Moves the lines below after by delta, of the statements in blocks, of the bodies left as
+// source and of the bodies inlined in calls
+void Compilation::shiftLines(Node* node, int after, int delta)
+{
+	if (node->tag == "Block")
+	{
+		for (auto child : node->children)
+		{
+			Statement* statement = static_cast<Statement*>(child);
+			if (statement->line > after)
+				statement->line += delta;
+		}
+	}
+	else if (node->tag == "CallNode")
+		static_cast<CallNode*>(node)->shiftLines(after, delta);
+	else if (node->tag == "LazyBlock" && static_cast<Statement*>(node)->line > after)
+		static_cast<Statement*>(node)->line += delta;
+
+	for (auto child : node->children)
+		shiftLines(child, after, delta);
+}
+
+yy::parser::symbol_type yylex(Compilation& compilation)
+{
+	return compilation.next();
+}
@@ -0,0 +1,108 @@
+#ifndef COMPILATION_H
+#define COMPILATION_H
+
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "grammar.tab.hh"
+
+class Block;
+class Environment;
+class Node;
+class Optimizer;
+class Statement;
+
+// One script being compiled: its source, the scanner over it, the tree parsed from it and the
+// environment it runs in. Nothing in it is shared, so scripts can be compiled on separate
+// threads at once. The debug and dump flags in globals.h are set before any compilation and
+// only read after, so they stay global.
+//
+// A streamed compilation (./parser stream) runs every statement of the main chunk as soon as
+// it is parsed and then frees it, keeping only what the environment may hold of it. It reads its
+// source as the scanner gets to it, and drops what the scanner is done with, so the text of name
+// and string tokens is copied out. Memory stays flat however long the input runs.
+//
+// A reparsable compilation (./parser reload) keeps every statement of the main chunk in a
+// Block of its own with the lines it spans. Reparsing an edited source lexes and parses only
+// the lines of the statements an edit touches, and keeps the optimized Blocks of the others,
+// moving their lines by as many as the edit added.
+//
+// With lazy functions (./parser lazy), a function body is scanned only for where it ends and
+// parsed on the first call, see LazyBlock. The scanner's tokens go through next(), which
+// turns the tokens of a body into one BODY token over its text.
+class Compilation
+{
+public:
+	static const long unsigned int padding = 32; // Zeros after the source, for the scanners
+
+	std::string name; // Of the source, in syntax errors
+	std::string* sourceName; // Of the source, kept by the environment for runtime errors in its functions
+	long unsigned int jobs; // Threads optimizing its function bodies
+	Environment* environment;
+	Statement* root; // Once parsed and optimized, null when streamed
+	std::vector<std::string> errors; // Syntax errors, printed by whoever parses
+	std::vector<char> source; // Padded; tokens view their text in it
+	long unsigned int length; // Of the source without padding
+	long unsigned int complete; // The source before it is whole lines, or all of it once read
+	FILE* input; // Still being read when streamed, else null
+	bool isReparsable;
+	bool isBody; // A function body parsed on the first call, left for the function to optimize
+	std::string chunk; // Where the tree parsed is saved before it is optimized, when set, see Chunk
+	yy::location location; // Of the current token
+	void* scanner; // The state of the scanner linked in
+
+	Compilation(const std::string& name, long unsigned int jobs, Environment* environment);
+	~Compilation();
+
+	void load(FILE* file);
+	void load(const char* text, long unsigned int length);
+	void stream(FILE* file);
+	bool isStreaming();
+	bool parse();
+	bool loadChunk(const std::string& path);
+	bool reparse(FILE* file);
+
+	yy::parser::symbol_type next();
+	bool refill(long unsigned int consumed);
+	int readLine(char* buffer, int size);
+	Lexeme lexeme(const char* text, long unsigned int length);
+	void statement(std::vector<Statement*>& statements, Statement* statement, const yy::location& location);
+	void finish(std::vector<Statement*> statements);
+
+private:
+	struct Part
+	{
+		int first, last; // Lines
+		Block* block;
+	};
+
+	std::vector<Part> parts; // Of the main chunk in order, when reparsable
+	Optimizer* optimizer; // Kept between the statements of a streamed main chunk
+	std::deque<std::string> copies; // Of token text when streamed, dropped as statements run
+	std::vector<Node*> kept; // Of the streamed statements freed, what the environment may hold: functions, literals stored
+	bool isStopped; // A statement of the streamed main chunk returned or broke
+	bool isInteractive; // Streamed from a terminal, what was printed is flushed before reading on
+	yy::position origin; // Of the source, where parsing started
+	std::vector<long unsigned int> starts; // Of the lines in the source, once a body is skipped
+	bool isInHeader; // Between function and the parenthesis closing its parameters
+	bool isBodyNext;
+
+	bool parseAll();
+	void release(std::unordered_set<Node*>& nodes, const std::unordered_set<Node*>& roots, Statement* block);
+	yy::parser::symbol_type skipBody();
+	long unsigned int offset(const yy::position& position);
+	static void shiftLines(Node* node, int after, int delta);
+};
+
+// Implemented by the scanner linked in, flex's (lexer.ll) or the hand-written one (Scanner.cc)
+void openScanner(Compilation& compilation);
+void closeScanner(Compilation& compilation);
+yy::parser::symbol_type nextToken(Compilation& compilation);
+
+// The parser's, the scanner's through next()
+yy::parser::symbol_type yylex(Compilation& compilation);
+
+#endif
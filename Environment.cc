@@ -1,21 +1,49 @@
 #include "Environment.h"
 #include "Nodes.h"
+#include "Library.h"
 
 
-Environment::Environment() {}
+Environment::Environment()
+{
+	this->controlFlow = Environment::ControlFlow::NORMAL;
+	this->line = 0;
+	this->source = sourceName("stdin");
+	this->epoch = 0;
+
+	openBaseLibrary(this);
+}
 
 Environment::~Environment() {}
 
+// A name the functions of a source keep for their runtime errors. A reloaded script renames
+// its own as it goes, see Compilation
+std::string* Environment::sourceName(const std::string& name)
+{
+	sources.push_back(name);
+	return &sources.back();
+}
+
 Expression* Environment::read(Expression* variable)
 {
-	if (exists(variable))
-	{
-		std::string name = "";
-		variable->evaluate(name);
+	std::string name = "";
+	variable->evaluate(name);
+
+	return read(name);
+}
 
-		return variables[name];
+Expression* Environment::read(const std::string& name)
+{
+	if (!frames.empty())
+	{
+		auto local = frames.back().find(name);
+		if (local != frames.back().end())
+			return local->second;
 	}
 
+	auto global = variables.find(name);
+	if (global != variables.end())
+		return global->second;
+
 	return nullptr;
 }
 
@@ -33,9 +61,33 @@ void Environment::write(Expression* variable, Expression* expression)
 		}
 	}*/
 
+	write(name, expression);
+}
+
+void Environment::write(const std::string& name, Expression* expression)
+{
+	if (!frames.empty())
+	{
+		auto local = frames.back().find(name);
+		if (local != frames.back().end())
+		{
+			local->second = expression;
+			return;
+		}
+	}
+
 	variables[name] = expression;
 }
 
+// The returned slot stays valid until its frame is popped
+Expression*& Environment::declare(const std::string& name, Expression* expression)
+{
+	if (frames.empty()) // Locals of the main chunk live with the globals
+		return variables[name] = expression;
+
+	return frames.back()[name] = expression;
+}
+
 bool Environment::exists(Expression* variable)
 {
 	//std::cout << "bool Environment::exists(Expression* variable)\n";
@@ -43,7 +95,7 @@ bool Environment::exists(Expression* variable)
 	std::string name = "";
 	variable->evaluate(name);
 
-	bool doesExist = variables.count(name) != 0;
+	bool doesExist = exists(name);
 
 	/*if (doesExist)
 		std::cout << "-Variable does exist\n";
@@ -52,3 +104,66 @@ bool Environment::exists(Expression* variable)
 
 	return doesExist;
 }
+
+bool Environment::exists(const std::string& name)
+{
+	if (!frames.empty() && frames.back().count(name) != 0)
+		return true;
+
+	return variables.count(name) != 0;
+}
+
+const std::map<std::string, Expression*>& Environment::globals()
+{
+	return variables;
+}
+
+void Environment::pushFrame()
+{
+	frames.emplace_back();
+}
+
+void Environment::popFrame()
+{
+	frames.pop_back();
+}
+
+long unsigned int Environment::depth()
+{
+	return frames.size();
+}
+
+// Drops the frames of the calls an error unwound through
+void Environment::unwind(long unsigned int depth)
+{
+	frames.resize(depth);
+	controlFlow = Environment::ControlFlow::NORMAL;
+}
+
+
+
+LoopVariable::LoopVariable(Environment* environment, const std::string& name, Expression* value)
+{
+	this->environment = environment;
+	this->name = name;
+	this->depth = environment->frames.size();
+
+	std::map<std::string, Expression*>& scope = depth ? environment->frames.back() : environment->variables;
+	auto bound = scope.find(name);
+	this->isShadowing = bound != scope.end();
+	this->shadowed = isShadowing ? bound->second : nullptr;
+
+	this->slot = &environment->declare(name, value);
+}
+
+LoopVariable::~LoopVariable()
+{
+	if (depth > environment->frames.size()) // The frame is gone, and the binding with it
+		return;
+
+	std::map<std::string, Expression*>& scope = depth ? environment->frames[depth - 1] : environment->variables;
+	if (isShadowing)
+		scope[name] = shadowed;
+	else
+		scope.erase(name);
+}
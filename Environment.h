@@ -2,22 +2,70 @@
 #define ENVIRONMENT_H
 
 
+#include <deque>
 #include <map>
+#include <string>
+#include <vector>
+
+#include "Input.h"
+#include "Output.h"
 
 class Expression;
 
 class Environment
 {
+	friend class LoopVariable;
+
 private:
 	std::map<std::string, Expression*> variables;
+	std::vector<std::map<std::string, Expression*>> frames; // Locals of the active function calls
+	std::deque<std::string> sources; // Names of the sources compiled here, as long as their functions
 
 public:
+	enum ControlFlow { NORMAL, BREAK, RETURN } controlFlow;
+	int line; // Line of the statement being executed, where runtime errors are reported
+	const std::string* source; // Name of the source that line is in
+	unsigned long long epoch; // Counts calls and returns, a call may write variables behind the caller's back
+	Output output; // Of print
+	Input input; // Of io
+
 	Environment();
 	~Environment();
 
 	Expression* read(Expression* variable);
+	Expression* read(const std::string& name);
 	void write(Expression* variable, Expression* expression);
+	void write(const std::string& name, Expression* expression);
+	Expression*& declare(const std::string& name, Expression* expression);
 	bool exists(Expression* variable);
+	bool exists(const std::string& name);
+	const std::map<std::string, Expression*>& globals();
+	std::string* sourceName(const std::string& name);
+
+	void pushFrame();
+	void popFrame();
+	long unsigned int depth();
+	void unwind(long unsigned int depth);
+};
+
+
+// The control variable of a for loop, declared in the scope the loop runs in while the loop
+// runs. What the name was bound to in that scope before, or that it was unbound, is put back
+// when the loop ends, be it at its limit, by break or return, or by an error passing through
+class LoopVariable
+{
+private:
+	Environment* environment;
+	std::string name;
+	long unsigned int depth; // Of the frame declared in, 0 for the main chunk
+	bool isShadowing;
+	Expression* shadowed;
+
+public:
+	Expression** slot; // Valid while the loop runs
+
+	LoopVariable(Environment* environment, const std::string& name, Expression* value);
+	~LoopVariable();
 };
 
 
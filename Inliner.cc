@@ -0,0 +1,165 @@
+#include "Inliner.h"
+#include "Nodes.h"
+
+#include <algorithm>
+
+
+static const int maxSize = 16; // Nodes in the returned expression
+
+
+
+Inliner::Inliner(Environment* environment)
+{
+	this->environment = environment;
+}
+
+void Inliner::run(Statement* root)
+{
+	collect(root);
+
+	for (auto& definition : definitions)
+	{
+		FunctionNode* function = definition.second;
+		Statement* block = function->body();
+
+		if (redefined.count(definition.first) != 0 || block->children.size() != 1)
+			continue;
+		if (function->parameterList().size() > CallNode::maxInlinedParameters)
+			continue;
+
+		Node* statement = block->children[0];
+		if (statement->tag != "ReturnNode" || statement->children.size() != 1)
+			continue;
+
+		Candidate candidate = { function, static_cast<Expression*>(statement->children[0]), static_cast<Statement*>(statement)->line, {} };
+		int size = 0;
+		if (isSmall(candidate.returned, function->parameterList(), candidate.globals, size))
+			candidates[definition.first] = candidate;
+	}
+
+	if (!candidates.empty())
+		visit(root);
+}
+
+// Finds the names assigned a function. One assigned two can not have either inlined
+void Inliner::collect(Node* node)
+{
+	if (node->tag == "AssignmentNode" && node->children[0]->tag == "VariableNode" && node->children[1]->tag == "FunctionNode")
+	{
+		const std::string& name = node->children[0]->value;
+		if (definitions.count(name) != 0)
+			redefined.insert(name);
+		definitions[name] = static_cast<FunctionNode*>(node->children[1]);
+	}
+
+	for (auto child : node->children)
+		collect(child);
+}
+
+bool Inliner::isSmall(Node* node, const std::vector<std::string>& parameters, std::set<std::string>& globals, int& size)
+{
+	if (++size > maxSize)
+		return false;
+
+	if (node->tag == "VariableNode")
+	{
+		if (std::find(parameters.begin(), parameters.end(), node->value) == parameters.end())
+			globals.insert(node->value);
+		return true;
+	}
+
+	if (node->tag == "IntegerNode" || node->tag == "FloatNode" || node->tag == "StringNode" || node->tag == "BooleanNode" || node->tag == "NilNode")
+		return true;
+
+	if (node->tag != "IndexNode" && node->tag != "BinaryOperationNode" && node->tag != "LogicalOperationNode" && node->tag != "UnaryOperationNode")
+		return false;
+
+	for (auto child : node->children)
+		if (!isSmall(child, parameters, globals, size))
+			return false;
+
+	return true;
+}
+
+void Inliner::visit(Node* node)
+{
+	if (node->tag == "FunctionNode")
+	{
+		FunctionNode* function = static_cast<FunctionNode*>(node);
+
+		locals.emplace_back();
+		function->frameNames(locals.back());
+		visit(function->body());
+		locals.pop_back();
+		return;
+	}
+
+	for (auto child : node->children)
+		visit(child);
+
+	if (node->tag != "CallNode" || !node->value.empty() || node->children[0]->tag != "VariableNode")
+		return;
+
+	auto found = candidates.find(node->children[0]->value);
+	if (found == candidates.end())
+		return;
+
+	Candidate& candidate = found->second;
+
+	// In the main chunk every name is a global, inside a function its own locals come first
+	if (!locals.empty())
+	{
+		for (auto& name : candidate.globals)
+			if (locals.back().count(name) != 0)
+				return;
+	}
+
+	std::map<std::string, ArgumentNode*> arguments;
+	std::vector<ArgumentNode*> parameters;
+	for (auto& parameter : candidate.function->parameterList())
+	{
+		if (arguments.count(parameter) == 0) // A repeated name is bound twice, the last argument stays
+			arguments[parameter] = new ArgumentNode(parameter);
+		parameters.push_back(arguments[parameter]);
+	}
+
+	static_cast<CallNode*>(node)->inlineBody(environment, candidate.function, copy(candidate.returned, arguments)->fold(), parameters, candidate.line);
+}
+
+// The expression, with its parameters read from the arguments of the call it is inlined in
+Expression* Inliner::copy(Node* node, const std::map<std::string, ArgumentNode*>& arguments)
+{
+	Expression* expression = static_cast<Expression*>(node);
+
+	if (node->tag == "VariableNode")
+	{
+		auto argument = arguments.find(node->value);
+		if (argument != arguments.end())
+			return argument->second;
+
+		return new VariableNode(environment, node->value);
+	}
+
+	if (node->tag == "IndexNode")
+		return new IndexNode(copy(node->children[0], arguments), copy(node->children[1], arguments));
+
+	if (node->tag == "BinaryOperationNode")
+	{
+		BinaryOperationNode* operation = static_cast<BinaryOperationNode*>(node);
+		return new BinaryOperationNode(copy(node->children[0], arguments), copy(node->children[1], arguments), operation->operation);
+	}
+
+	if (node->tag == "LogicalOperationNode")
+	{
+		LogicalOperationNode* operation = static_cast<LogicalOperationNode*>(node);
+		return new LogicalOperationNode(copy(node->children[0], arguments), copy(node->children[1], arguments), operation->operation);
+	}
+
+	if (node->tag == "UnaryOperationNode")
+	{
+		UnaryOperationNode* operation = static_cast<UnaryOperationNode*>(node);
+		return new UnaryOperationNode(copy(node->children[0], arguments), operation->operation);
+	}
+
+	return expression; // A literal, never changed
+}
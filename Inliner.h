@@ -0,0 +1,52 @@
+#ifndef INLINER_H
+#define INLINER_H
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+class ArgumentNode;
+class Environment;
+class Expression;
+class FunctionNode;
+class Node;
+class Statement;
+
+// Inlining of small functions at their call sites, run once after folding.
+//
+// A function is small when its body returns one expression over its parameters, globals,
+// literals, indexing and operators. Without calls in it, it can not recurse. A call f(...)
+// where f, a global or a local, is assigned no other function definition gets a copy of the
+// expression with the parameters bound to the arguments. The call still evaluates f, and
+// only runs the copy while f is that function, so reassigning f, or a parameter or local
+// named f, calls whatever f is then.
+class Inliner
+{
+private:
+	struct Candidate
+	{
+		FunctionNode* function;
+		Expression* returned;
+		int line;
+		std::set<std::string> globals; // Read by the body, a local of the caller would shadow them
+	};
+
+	Environment* environment;
+	std::map<std::string, FunctionNode*> definitions;
+	std::set<std::string> redefined;
+	std::map<std::string, Candidate> candidates;
+	std::vector<std::set<std::string>> locals; // Of the functions around the node visited, innermost last
+
+	void collect(Node* node);
+	bool isSmall(Node* node, const std::vector<std::string>& parameters, std::set<std::string>& globals, int& size);
+	void visit(Node* node);
+	Expression* copy(Node* node, const std::map<std::string, ArgumentNode*>& arguments);
+
+public:
+	Inliner(Environment* environment);
+
+	void run(Statement* root);
+};
+
+#endif
@@ -0,0 +1,243 @@
+#include "Input.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+static bool isSpace(char character)
+{
+	return character == ' ' || character == '\t' || character == '\n' || character == '\r' || character == '\v' || character == '\f';
+}
+
+static bool isDigit(char character)
+{
+	return character >= '0' && character <= '9';
+}
+
+
+
+Input::Input()
+{
+	this->descriptor = 0;
+	this->mapped = nullptr;
+	this->size = 0;
+	this->position = nullptr;
+	this->end = nullptr;
+	this->isFinished = false;
+}
+
+Input::~Input()
+{
+	close();
+}
+
+// Reads the file from now on instead of stdin, false when it can not be opened
+bool Input::open(const std::string& path)
+{
+	int file = ::open(path.c_str(), O_RDONLY);
+	if (file < 0)
+		return false;
+
+	close();
+	descriptor = file;
+	isFinished = false;
+	return true;
+}
+
+void Input::close()
+{
+	if (mapped)
+		munmap(mapped, size);
+	if (descriptor != 0)
+		::close(descriptor);
+
+	descriptor = 0;
+	mapped = nullptr;
+	size = 0;
+	buffer.clear();
+	position = nullptr;
+	end = nullptr;
+	isFinished = true;
+}
+
+// Makes more text follow what is left of the last, false when there is none. The first fill maps
+// a regular file, from where its offset is, and reads the rest up front. Otherwise what is left
+// moves to the front of the buffer, which doubles when a line fills it, and a read follows it
+bool Input::fill()
+{
+	if (isFinished)
+		return false;
+
+	if (buffer.empty())
+	{
+		struct stat status;
+		if (fstat(descriptor, &status) == 0 && S_ISREG(status.st_mode) && status.st_size > 0)
+		{
+			off_t offset = lseek(descriptor, 0, SEEK_CUR);
+			void* data = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+			if (data != MAP_FAILED)
+			{
+				madvise(data, status.st_size, MADV_SEQUENTIAL);
+				mapped = data;
+				size = status.st_size;
+				const char* start = static_cast<const char*>(data);
+				end = start + size;
+				position = offset > 0 ? std::min(start + offset, end) : start;
+				isFinished = true;
+				return position != end;
+			}
+		}
+
+		buffer.resize(capacity);
+		position = buffer.data();
+		end = buffer.data();
+	}
+
+	long unsigned int left = end - position;
+	if (position != buffer.data())
+		memmove(buffer.data(), position, left);
+	if (left == buffer.size())
+		buffer.resize(buffer.size() * 2);
+
+	ssize_t count = 0;
+	do
+		count = ::read(descriptor, buffer.data() + left, buffer.size() - left);
+	while (count < 0 && errno == EINTR);
+
+	position = buffer.data();
+	end = buffer.data() + left + (count > 0 ? count : 0);
+	if (count <= 0)
+		isFinished = true;
+
+	return count > 0;
+}
+
+// The next line without its newline. The last one may lack it
+bool Input::line(const char*& text, long unsigned int& length)
+{
+	long unsigned int searched = 0; // Of what is left, known to hold no newline
+	while (true)
+	{
+		const char* newline = position == end ? nullptr : static_cast<const char*>(memchr(position + searched, '\n', end - position - searched));
+		if (newline)
+		{
+			text = position;
+			length = newline - position;
+			position = newline + 1;
+			return true;
+		}
+
+		searched = end - position;
+		if (!fill())
+			break;
+	}
+
+	if (position == end)
+		return false;
+
+	text = position;
+	length = end - position;
+	position = end;
+	return true;
+}
+
+// Up to count characters, fewer at the end of the input
+bool Input::characters(long unsigned int count, const char*& text, long unsigned int& length)
+{
+	while (static_cast<long unsigned int>(end - position) < count && fill())
+		;
+
+	if (position == end && count > 0)
+		return false;
+
+	text = position;
+	length = std::min(count, static_cast<long unsigned int>(end - position));
+	position += length;
+	return true;
+}
+
+// The rest of the input, empty at its end
+bool Input::all(const char*& text, long unsigned int& length)
+{
+	while (fill())
+		;
+
+	text = position;
+	length = end - position;
+	position = end;
+	return true;
+}
+
+// As many whole lines as fit in size bytes, or the first one when it is longer, and a last
+// line lacking its newline at the end of the input
+bool Input::lines(long unsigned int size, const char*& text, long unsigned int& length)
+{
+	while (static_cast<long unsigned int>(end - position) < size && fill())
+		;
+
+	if (static_cast<long unsigned int>(end - position) >= size)
+	{
+		const char* newline = static_cast<const char*>(memrchr(position, '\n', size));
+		if (newline)
+		{
+			text = position;
+			length = newline + 1 - position;
+			position = newline + 1;
+			return true;
+		}
+
+		return line(text, length);
+	}
+
+	return all(text, length) && length > 0;
+}
+
+// [+-]digits[.digits], as parseInteger and parseFloat read them. A '+' is left out of the view.
+// False, having read what did not make a numeral, when there is none
+bool Input::numeral(const char*& text, long unsigned int& length, bool& isFloat)
+{
+	while (true)
+	{
+		while (position != end && isSpace(*position))
+			position++;
+		if (position != end || !fill())
+			break;
+	}
+
+	if (position != end && *position == '+')
+		position++;
+
+	while (true)
+	{
+		long unsigned int available = end - position;
+		long unsigned int i = available > 0 && *position == '-' ? 1 : 0;
+		bool isFraction = false;
+		for (; i < available; i++)
+		{
+			if (position[i] == '.' && !isFraction)
+				isFraction = true;
+			else if (!isDigit(position[i]))
+				break;
+		}
+
+		if (i == available && fill()) // May go on in what is read next
+			continue;
+
+		text = position;
+		length = i;
+		isFloat = isFraction;
+		position += i;
+		break;
+	}
+
+	long unsigned int digits = 0;
+	for (long unsigned int i = 0; i < length; i++)
+		digits += isDigit(text[i]);
+
+	return digits > 0;
+}
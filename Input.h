@@ -0,0 +1,40 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <string>
+#include <vector>
+
+// What io reads, stdin or the file given (./parser input=file). A regular file is mapped whole,
+// anything else is read into a buffer of at least capacity bytes. Reads hand out views of the
+// text where it lies, valid until the next read, and numbers are parsed from there
+class Input
+{
+private:
+	static const long unsigned int capacity = 1 << 20;
+
+	int descriptor;
+	std::vector<char> buffer;
+	void* mapped;
+	long unsigned int size;
+	const char* position;
+	const char* end;
+	bool isFinished; // Nothing more to read past end
+
+	bool fill();
+
+public:
+	Input();
+	~Input();
+
+	bool open(const std::string& path);
+	void close();
+
+	// False at the end of the input, else the view is set
+	bool line(const char*& text, long unsigned int& length);
+	bool characters(long unsigned int count, const char*& text, long unsigned int& length);
+	bool all(const char*& text, long unsigned int& length);
+	bool lines(long unsigned int size, const char*& text, long unsigned int& length); // Whole ones, about size bytes
+	bool numeral(const char*& text, long unsigned int& length, bool& isFloat); // Skips the white space before it
+};
+
+#endif
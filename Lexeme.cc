@@ -0,0 +1,78 @@
+#include "Lexeme.h"
+
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+
+std::string Lexeme::string() const
+{
+	return std::string(text, length);
+}
+
+// [-]digits
+bool parseInteger(const char* text, long unsigned int length, int& value)
+{
+	long unsigned int i = 0;
+	bool isNegative = length > 0 && text[0] == '-';
+	if (isNegative)
+		i++;
+
+	long long magnitude = 0;
+	long long limit = isNegative ? -static_cast<long long>(INT_MIN) : INT_MAX;
+	for (; i < length; i++)
+	{
+		magnitude = magnitude * 10 + (text[i] - '0');
+		if (magnitude > limit)
+			return false;
+	}
+
+	value = static_cast<int>(isNegative ? -magnitude : magnitude);
+	return true;
+}
+
+// [-]digits[.digits]. Up to 15 significant digits the value is exact in a double, and so is
+// dividing by a power of ten up to 1e22; longer literals go through strtof
+float parseFloat(const char* text, long unsigned int length)
+{
+	static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+	long unsigned int i = 0;
+	bool isNegative = length > 0 && text[0] == '-';
+	if (isNegative)
+		i++;
+
+	unsigned long long mantissa = 0;
+	int digits = 0;
+	int decimals = 0;
+	bool isFraction = false;
+	for (; i < length; i++)
+	{
+		if (text[i] == '.')
+		{
+			isFraction = true;
+			continue;
+		}
+
+		if (mantissa != 0 || text[i] != '0')
+			digits++;
+		mantissa = mantissa * 10 + (text[i] - '0');
+		if (isFraction)
+			decimals++;
+
+		if (digits > 15 || decimals > 22)
+		{
+			char copy[64];
+			if (length >= sizeof(copy))
+				return std::strtof(std::string(text, length).c_str(), nullptr);
+
+			std::memcpy(copy, text, length);
+			copy[length] = '\0';
+			return std::strtof(copy, nullptr);
+		}
+	}
+
+	double value = static_cast<double>(mantissa) / powers[decimals];
+	return static_cast<float>(isNegative ? -value : value);
+}
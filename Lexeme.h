@@ -0,0 +1,21 @@
+#ifndef LEXEME_H
+#define LEXEME_H
+
+#include <string>
+
+// The text of a name or string token, viewed where it is in the source buffer. Only these
+// tokens carry their text; keywords and punctuation are told apart by their kind alone
+struct Lexeme
+{
+	const char* text;
+	long unsigned int length;
+
+	std::string string() const;
+};
+
+// Number literals, read straight from the buffer without allocating or throwing.
+// parseInteger is false when the value does not fit an int
+bool parseInteger(const char* text, long unsigned int length, int& value);
+float parseFloat(const char* text, long unsigned int length);
+
+#endif
@@ -0,0 +1,247 @@
+#include "Library.h"
+#include "Environment.h"
+#include "Nodes.h"
+#include "Memoizer.h"
+#include "Lexeme.h"
+
+
+static Expression* setmetatable(Environment* environment, std::vector<Expression*>& arguments)
+{
+	if (arguments.size() < 2 || arguments[0]->type != Expression::Type::TABLE
+		|| (arguments[1]->type != Expression::Type::TABLE && arguments[1]->type != Expression::Type::NIL))
+		throw RuntimeError("bad arguments to 'setmetatable' (table and table or nil expected)");
+
+	TableNode* table = static_cast<TableNode*>(arguments[0]);
+
+	if (arguments[1]->type == Expression::Type::TABLE)
+		table->metatable = static_cast<TableNode*>(arguments[1]);
+	else
+		table->metatable = nullptr;
+
+	return table;
+}
+
+static Expression* getmetatable(Environment* environment, std::vector<Expression*>& arguments)
+{
+	if (arguments.empty() || arguments[0]->type != Expression::Type::TABLE)
+		return NilNode::instance();
+
+	TableNode* metatable = static_cast<TableNode*>(arguments[0])->metatable;
+	if (!metatable)
+		return NilNode::instance();
+
+	return metatable;
+}
+
+// error(message [, level]). A string message gets the position of the call unless level is 0
+static Expression* error(Environment* environment, std::vector<Expression*>& arguments)
+{
+	Expression* value = arguments.empty() ? NilNode::instance() : arguments[0];
+
+	int level = 1;
+	if (arguments.size() > 1 && arguments[1]->type == Expression::Type::INTEGER)
+		arguments[1]->evaluate(level);
+
+	if (value->type == Expression::Type::STRING && level > 0)
+	{
+		std::string message = "";
+		value->evaluate(message);
+		throw RuntimeError(message);
+	}
+
+	throw RuntimeError(value);
+}
+
+// pcall(f, ...) returns true and f's results, or false and the error object. Entering it only
+// records the call depth, the try block costs nothing unless an error is thrown
+static Expression* pcall(Environment* environment, std::vector<Expression*>& arguments)
+{
+	if (arguments.empty())
+		throw RuntimeError("bad argument #1 to 'pcall' (value expected)");
+
+	Expression* function = arguments[0];
+	arguments.erase(arguments.begin());
+
+	long unsigned int depth = environment->depth();
+	int line = environment->line;
+	const std::string* source = environment->source;
+
+	try
+	{
+		Expression* result = CallNode::call(function, arguments);
+
+		std::vector<Expression*> values = { new BooleanNode(true) };
+		if (result->type == Expression::Type::VALUELIST)
+		{
+			std::vector<Expression*>& results = static_cast<ValueListNode*>(result)->values;
+			values.insert(values.end(), results.begin(), results.end());
+		}
+		else
+			values.push_back(result);
+
+		return new ValueListNode(values);
+	}
+	catch (RuntimeError& error)
+	{
+		Expression* value = error.errorObject(*environment->source, environment->line);
+
+		environment->unwind(depth);
+		environment->line = line;
+		environment->source = source;
+		environment->epoch++; // As a return would, the calls it left may have computed temporaries
+
+		return new ValueListNode({ new BooleanNode(false), value });
+	}
+}
+
+// memostats(f) returns the hits, misses and evictions of f's result cache, all 0 without one
+static Expression* memostats(Environment* environment, std::vector<Expression*>& arguments)
+{
+	if (arguments.empty() || arguments[0]->type != Expression::Type::FUNCTION)
+		throw RuntimeError("bad argument #1 to 'memostats' (function expected)");
+
+	MemoCache* memo = static_cast<FunctionNode*>(arguments[0])->memo;
+	if (!memo)
+		return new ValueListNode({ new IntegerNode(0), new IntegerNode(0), new IntegerNode(0) });
+
+	return new ValueListNode({ new IntegerNode((int)memo->hits), new IntegerNode((int)memo->misses), new IntegerNode((int)memo->evictions) });
+}
+
+// One value of io.read for the format: "*n" a number, "*l" a line, "*a" the rest, or a count of
+// characters, the '*' being optional. Nil at the end of the input or where there is no number
+static Expression* readValue(Environment* environment, Expression* format)
+{
+	Input& input = environment->input;
+	const char* text = nullptr;
+	long unsigned int length = 0;
+
+	if (format->type == Expression::Type::INTEGER)
+	{
+		int count = 0;
+		format->evaluate(count);
+		if (count < 0 || !input.characters(count, text, length))
+			return NilNode::instance();
+		return new StringNode(std::string(text, length));
+	}
+
+	std::string name = "";
+	if (format->type == Expression::Type::STRING)
+		format->evaluate(name);
+	char kind = name.size() > 1 && name[0] == '*' ? name[1] : name.empty() ? '\0' : name[0];
+
+	switch (kind)
+	{
+		case 'n':
+		{
+			bool isFloat = false;
+			if (!input.numeral(text, length, isFloat))
+				return NilNode::instance();
+
+			int integer = 0;
+			if (!isFloat && parseInteger(text, length, integer))
+				return new IntegerNode(integer);
+			return new FloatNode(parseFloat(text, length));
+		}
+		case 'l':
+			if (!input.line(text, length))
+				return NilNode::instance();
+			return new StringNode(std::string(text, length));
+		case 'a':
+			input.all(text, length);
+			return new StringNode(std::string(text, length));
+		default:
+			throw RuntimeError("bad argument #1 to 'read' (invalid format)");
+	}
+}
+
+// io.read(...) reads a value for each format, a line without any. Stops at the first nil
+static Expression* ioRead(Environment* environment, std::vector<Expression*>& arguments)
+{
+	if (arguments.empty())
+	{
+		StringNode format("*l");
+		return readValue(environment, &format);
+	}
+
+	std::vector<Expression*> values;
+	for (auto format : arguments)
+	{
+		values.push_back(readValue(environment, format));
+		if (values.back()->type == Expression::Type::NIL)
+			break;
+	}
+
+	if (values.size() == 1)
+		return values[0];
+	return new ValueListNode(values);
+}
+
+// io.write(...) writes strings and numbers as they are, with nothing between them, into print's buffer
+static Expression* ioWrite(Environment* environment, std::vector<Expression*>& arguments)
+{
+	Output& output = environment->output;
+	for (long unsigned int i = 0; i < arguments.size(); i++)
+	{
+		Expression* value = arguments[i];
+		if (value->type == Expression::Type::STRING)
+			output.write(value->value);
+		else if (value->type == Expression::Type::INTEGER)
+		{
+			int number = 0;
+			value->evaluate(number);
+			output.writeInteger(number);
+		}
+		else if (value->type == Expression::Type::FLOAT)
+		{
+			float number = 0.0;
+			value->evaluate(number);
+			output.writeFloat(number);
+		}
+		else
+			throw RuntimeError("bad argument #" + std::to_string(i + 1) + " to 'write' (string expected, got " + value->typeName() + ")");
+	}
+
+	return NilNode::instance();
+}
+
+// What io.lines returns as the state of a generic for: the string every line is read into.
+// Being updated in place it is copied where it is stored, so a loop allocates no line it only looks at
+static Expression* nextLine(Environment* environment, std::vector<Expression*>& arguments)
+{
+	const char* text = nullptr;
+	long unsigned int length = 0;
+	if (!environment->input.line(text, length))
+		return NilNode::instance();
+
+	if (arguments.empty() || arguments[0]->type != Expression::Type::STRING || !arguments[0]->isUpdatedInPlace) // Called by hand
+		return new StringNode(std::string(text, length));
+
+	StringNode* line = static_cast<StringNode*>(arguments[0]);
+	line->setValue(text, length);
+	return line;
+}
+
+// for line in io.lines() do ... end
+static Expression* ioLines(Environment* environment, std::vector<Expression*>& arguments)
+{
+	StringNode* line = new StringNode("");
+	line->isUpdatedInPlace = true;
+
+	return new ValueListNode({ new BuiltinFunctionNode(environment, "io.lines iterator", nextLine), line });
+}
+
+void openBaseLibrary(Environment* environment)
+{
+	environment->write("setmetatable", new BuiltinFunctionNode(environment, "setmetatable", setmetatable));
+	environment->write("getmetatable", new BuiltinFunctionNode(environment, "getmetatable", getmetatable));
+	environment->write("error", new BuiltinFunctionNode(environment, "error", error));
+	environment->write("pcall", new BuiltinFunctionNode(environment, "pcall", pcall));
+	environment->write("memostats", new BuiltinFunctionNode(environment, "memostats", memostats));
+
+	// Named as they are reached, so a snapshot finds them again
+	TableNode* io = new TableNode();
+	io->rawSet("read", new BuiltinFunctionNode(environment, "io.read", ioRead));
+	io->rawSet("write", new BuiltinFunctionNode(environment, "io.write", ioWrite));
+	io->rawSet("lines", new BuiltinFunctionNode(environment, "io.lines", ioLines));
+	environment->write("io", io);
+}
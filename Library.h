@@ -0,0 +1,8 @@
+#ifndef LIBRARY_H
+#define LIBRARY_H
+
+class Environment;
+
+void openBaseLibrary(Environment* environment);
+
+#endif
@@ -0,0 +1,235 @@
+#include "Memoizer.h"
+#include "Environment.h"
+#include "Nodes.h"
+
+
+MemoCache::MemoCache(long unsigned int capacity)
+{
+	this->capacity = capacity;
+	this->hits = 0;
+	this->misses = 0;
+	this->evictions = 0;
+}
+
+// Writes the arguments as a key, each a type letter and its bytes. False when one is not a
+// nil, boolean, number or string, and so may change between calls
+bool MemoCache::key(const std::vector<Expression*>& arguments, std::string& key)
+{
+	for (auto argument : arguments)
+	{
+		switch (argument->type)
+		{
+			case Expression::Type::NIL:
+				key += 'n';
+				break;
+			case Expression::Type::BOOLEAN:
+			{
+				bool value = false;
+				argument->evaluate(value);
+				key += value ? 't' : 'f';
+				break;
+			}
+			case Expression::Type::INTEGER:
+			{
+				int value = 0;
+				argument->evaluate(value);
+				key += 'i';
+				key.append(reinterpret_cast<const char*>(&value), sizeof(value));
+				break;
+			}
+			case Expression::Type::FLOAT:
+			{
+				float value = 0.0;
+				argument->evaluate(value);
+				key += 'r';
+				key.append(reinterpret_cast<const char*>(&value), sizeof(value));
+				break;
+			}
+			case Expression::Type::STRING:
+			{
+				std::string value = "";
+				argument->evaluate(value);
+				long unsigned int length = value.size();
+				key += 's';
+				key.append(reinterpret_cast<const char*>(&length), sizeof(length));
+				key += value;
+				break;
+			}
+			default:
+				return false;
+		}
+	}
+
+	return true;
+}
+
+Expression* MemoCache::find(const std::string& key)
+{
+	auto found = index.find(key);
+	if (found == index.end())
+	{
+		misses++;
+		return nullptr;
+	}
+
+	hits++;
+	entries.splice(entries.begin(), entries, found->second);
+	return found->second->second;
+}
+
+void MemoCache::insert(const std::string& key, Expression* result)
+{
+	switch (result->type)
+	{
+		case Expression::Type::NIL:
+		case Expression::Type::BOOLEAN:
+		case Expression::Type::INTEGER:
+		case Expression::Type::FLOAT:
+		case Expression::Type::STRING:
+			break;
+		default: // A table or function may be changed by whoever gets it
+			return;
+	}
+
+	if (capacity == 0 || index.count(key) != 0) // A recursive call got there first
+		return;
+
+	if (entries.size() == capacity)
+	{
+		index.erase(entries.back().first);
+		entries.pop_back();
+		evictions++;
+	}
+
+	entries.emplace_front(key, result);
+	index[key] = entries.begin();
+}
+
+
+
+Memoizer::Memoizer(Environment* environment)
+{
+	this->environment = environment;
+}
+
+void Memoizer::run(Statement* root, long unsigned int capacity)
+{
+	collect(root, nullptr);
+
+	for (auto& definition : definitions)
+		if (assignments[definition.first] == 1)
+			pure.insert(definition.first);
+
+	// Every candidate starts out pure, calls between them included, until one is shown not to be
+	bool isChanged = true;
+	while (isChanged)
+	{
+		isChanged = false;
+		for (auto name = pure.begin(); name != pure.end(); )
+		{
+			if (isPure(definitions[*name]->body(), ownNames(definitions[*name])))
+				name++;
+			else
+			{
+				name = pure.erase(name);
+				isChanged = true;
+			}
+		}
+	}
+
+	for (auto& name : pure)
+		definitions[name]->memo = new MemoCache(capacity);
+}
+
+// Counts the assignments to every name, finds the functions assigned to them, and the names
+// used as globals somewhere
+void Memoizer::collect(Node* node, const std::set<std::string>* frame)
+{
+	if (node->tag == "FunctionNode")
+	{
+		FunctionNode* function = static_cast<FunctionNode*>(node);
+		std::set<std::string> names;
+		function->frameNames(names);
+		if (function->body())
+			collect(function->body(), &names);
+		return;
+	}
+
+	if (node->tag == "VariableNode" && (!frame || frame->count(node->value) == 0))
+		globals.insert(node->value);
+
+	if (node->tag == "AssignmentNode" && node->children[0]->tag == "VariableNode")
+	{
+		assignments[node->children[0]->value]++;
+		if (node->children[1]->tag == "FunctionNode")
+			definitions[node->children[0]->value] = static_cast<FunctionNode*>(node->children[1]);
+	}
+	else if (node->tag == "MultipleAssignmentNode")
+	{
+		for (auto target : static_cast<MultipleAssignmentNode*>(node)->targetList())
+			collect(target, frame);
+	}
+	else if (node->tag == "ForNode")
+		assignments[node->value]++;
+	else if (node->tag == "ForInNode")
+	{
+		for (auto& name : static_cast<ForInNode*>(node)->nameList())
+			assignments[name]++;
+	}
+
+	for (auto child : node->children)
+		collect(child, frame);
+}
+
+// The names a call of the function surely finds in its own frame. Frames are not scoped, so a
+// local read before its declaration runs reads the global, and a name no global ever has is
+// the same either way
+std::set<std::string> Memoizer::ownNames(FunctionNode* function)
+{
+	std::set<std::string> declared, names;
+	function->frameNames(declared);
+
+	const std::vector<std::string>& parameters = function->parameterList();
+	names.insert(parameters.begin(), parameters.end());
+
+	for (auto& name : declared)
+		if (globals.count(name) == 0 && !environment->exists(name))
+			names.insert(name);
+
+	return names;
+}
+
+bool Memoizer::isPure(Node* node, const std::set<std::string>& frame)
+{
+	if (node->tag == "PrintNode" || node->tag == "FunctionNode" || node->tag == "LazyBlock") // Not parsed yet, ./parser lazy
+		return false;
+
+	if (node->tag == "ForInNode") // Calls its iterator, whatever that is
+		return false;
+
+	if (node->tag == "VariableNode") // A global may change between calls
+		return frame.count(node->value) != 0;
+
+	if (node->tag == "CallNode")
+	{
+		Node* function = node->children[0];
+		if (!node->value.empty() || function->tag != "VariableNode" || frame.count(function->value) != 0)
+			return false;
+
+		bool isError = function->value == "error" && assignments.count("error") == 0;
+		if (!isError && pure.count(function->value) == 0)
+			return false;
+
+		for (long unsigned int i = 1; i < node->children.size(); i++)
+			if (!isPure(node->children[i], frame))
+				return false;
+
+		return true;
+	}
+
+	for (auto child : node->children)
+		if (!isPure(child, frame))
+			return false;
+
+	return true;
+}
@@ -0,0 +1,65 @@
+#ifndef MEMOIZER_H
+#define MEMOIZER_H
+
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Environment;
+class Expression;
+class FunctionNode;
+class Node;
+class Statement;
+
+// Results of a pure function by its arguments, the least recently used dropped past capacity
+class MemoCache
+{
+private:
+	long unsigned int capacity;
+	std::list<std::pair<std::string, Expression*>> entries; // Most recently used first
+	std::unordered_map<std::string, std::list<std::pair<std::string, Expression*>>::iterator> index;
+
+public:
+	unsigned long long hits;
+	unsigned long long misses;
+	unsigned long long evictions;
+
+	MemoCache(long unsigned int capacity);
+
+	static bool key(const std::vector<Expression*>& arguments, std::string& key);
+
+	Expression* find(const std::string& key);
+	void insert(const std::string& key, Expression* result);
+};
+
+
+// Purity analysis over the functions assigned to names, run once after parsing when caching
+// is on (./parser memo[=capacity]).
+//
+// A function is pure when its body reads and writes only its own frame, prints nothing, and
+// calls only error and pure functions, by names assigned nothing else. Its calls with nil,
+// boolean, number and string arguments then go through a MemoCache, which keeps results of
+// the same kinds. A table made during the call is never returned from the cache.
+class Memoizer
+{
+private:
+	Environment* environment;
+	std::map<std::string, int> assignments;
+	std::map<std::string, FunctionNode*> definitions;
+	std::set<std::string> globals; // Used outside of a frame declaring them
+	std::set<std::string> pure;
+
+	void collect(Node* node, const std::set<std::string>* frame);
+	std::set<std::string> ownNames(FunctionNode* function);
+	bool isPure(Node* node, const std::set<std::string>& frame);
+
+public:
+	Memoizer(Environment* environment);
+
+	void run(Statement* root, long unsigned int capacity);
+};
+
+#endif
@@ -1,24 +1,241 @@
 #include "Nodes.h"
 #include "Environment.h"
 #include "globals.h"
+#include "ValueNumbering.h"
+#include "NumericLoop.h"
+#include "Memoizer.h"
+#include "Compilation.h"
+#include "Optimizer.h"
 
+#include <deque>
 
-void log_assignments(std::string message)
+
+// Messages are C strings so the calls on every evaluation build nothing while logging is off
+void log_assignments(const std::string& message)
 {
 	if (debug_assignments)
 		std::cout << "-ASSIGNMENT-\t\t\t\t\t\t\t\t " + message + '\n';
 }
 
-void log_calls(std::string message)
+void log_calls(const char* message)
 {
 	if (debug_calls)
-		std::cout << "CALL:\t\t " + message + '\n';
+		std::cout << "CALL:\t\t " << message << '\n';
 }
 
-void log_evaluations(std::string message)
+void log_evaluations(const char* message)
 {
 	if (debug_evaluations)
-		std::cout << "EVALUATION:\t " + message + '\n';
+		std::cout << "EVALUATION:\t " << message << '\n';
+}
+
+// Executes the expression if needed and looks up variables, undeclared ones being nil
+static Expression* valueOf(Expression* expression)
+{
+	if (expression->isExecutable)
+		expression = expression->execute();
+
+	if (expression && expression->type == Expression::Type::VARIABLE)
+		expression->evaluate(expression);
+
+	if (!expression)
+		return NilNode::instance();
+
+	if (expression->type == Expression::Type::VALUELIST) // Only the first result of a call is kept
+	{
+		std::vector<Expression*>& values = static_cast<ValueListNode*>(expression)->values;
+		return values.empty() ? NilNode::instance() : values[0];
+	}
+
+	return expression;
+}
+
+// Evaluates an expression list, where a call in last position contributes all of its results
+static void valuesOf(std::vector<Expression*>& expressions, std::vector<Expression*>& values)
+{
+	if (expressions.empty())
+		return;
+
+	for (long unsigned int i = 0; i + 1 < expressions.size(); i++)
+		values.push_back(valueOf(expressions[i]));
+
+	Expression* last = expressions.back();
+	if (last->type != Expression::Type::CALL)
+	{
+		values.push_back(valueOf(last));
+		return;
+	}
+
+	Expression* result = last->execute();
+	if (result && result->type == Expression::Type::VALUELIST)
+	{
+		std::vector<Expression*>& results = static_cast<ValueListNode*>(result)->values;
+		values.insert(values.end(), results.begin(), results.end());
+	}
+	else
+		values.push_back(result ? result : NilNode::instance());
+}
+
+static bool isTruthy(Expression* value)
+{
+	if (value->type == Expression::Type::NIL)
+		return false;
+
+	if (value->type == Expression::Type::BOOLEAN)
+	{
+		bool truth = false;
+		value->evaluate(truth);
+		return truth;
+	}
+
+	return true;
+}
+
+// Reads an integer or a float as a float, the type mixed arithmetic uses
+static bool numberOf(Expression* value, float& number)
+{
+	if (value->type == Expression::Type::FLOAT)
+	{
+		value->evaluate(number);
+		return true;
+	}
+
+	if (value->type == Expression::Type::INTEGER)
+	{
+		int integer = 0;
+		value->evaluate(integer);
+		number = (float)integer;
+		return true;
+	}
+
+	return false;
+}
+
+static bool numberFrom(Expression* value, Number& number)
+{
+	if (value->type == Expression::Type::INTEGER)
+	{
+		number.isInteger = true;
+		value->evaluate(number.integer);
+		return true;
+	}
+
+	if (value->type == Expression::Type::FLOAT)
+	{
+		number.isInteger = false;
+		value->evaluate(number.real);
+		return true;
+	}
+
+	return false;
+}
+
+static float realOf(const Number& number)
+{
+	return number.isInteger ? (float)number.integer : number.real;
+}
+
+// The node for a number that escapes, stored or passed on
+static Expression* boxed(const Number& number)
+{
+	if (number.isInteger)
+		return new IntegerNode(number.integer);
+
+	return new FloatNode(number.real);
+}
+
+// Values outliving the statement that produced them must not be loop counters or lines being read.
+// A literal of a streamed statement is stored as it is, and kept when the statement is freed
+static Expression* stored(Expression* value)
+{
+	if (value->isTransient)
+	{
+		value->isTransient = false;
+		return value;
+	}
+
+	if (!value->isUpdatedInPlace)
+		return value;
+
+	if (value->type == Expression::Type::INTEGER)
+	{
+		int number = 0;
+		value->evaluate(number);
+		return new IntegerNode(number);
+	}
+
+	if (value->type == Expression::Type::STRING) // A line of io.lines
+	{
+		std::string text = "";
+		value->evaluate(text);
+		return new StringNode(text);
+	}
+
+	float number = 0.0;
+	value->evaluate(number);
+	return new FloatNode(number);
+}
+
+// Integers wrap around on overflow, which signed arithmetic leaves undefined, so they are
+// computed unsigned
+static int wrappedSum(int x, int y)
+{
+	return (int)((unsigned int)x + (unsigned int)y);
+}
+
+static int wrappedDifference(int x, int y)
+{
+	return (int)((unsigned int)x - (unsigned int)y);
+}
+
+static int wrappedProduct(int x, int y)
+{
+	return (int)((unsigned int)x * (unsigned int)y);
+}
+
+// Literals whose value is known when parsing
+static bool isConstant(Expression* expression)
+{
+	switch (expression->type)
+	{
+		case Expression::Type::STRING:
+		case Expression::Type::INTEGER:
+		case Expression::Type::FLOAT:
+		case Expression::Type::BOOLEAN:
+		case Expression::Type::NIL:
+			return true;
+		default:
+			return false;
+	}
+}
+
+// Exponentiation by squaring, for integer exponents
+static float powerOf(float base, int exponent)
+{
+	double result = 1.0, factor = base;
+	unsigned int n = exponent < 0 ? 0u - (unsigned int)exponent : (unsigned int)exponent;
+
+	for (; n != 0; n >>= 1)
+	{
+		if (n & 1)
+			result *= factor;
+		factor *= factor;
+	}
+
+	return (float)(exponent < 0 ? 1.0 / result : result);
+}
+
+static void foldAll(std::vector<Expression*>& expressions)
+{
+	for (auto& expression : expressions)
+		expression = expression->fold();
+}
+
+static std::string addressOf(Expression* value)
+{
+	std::ostringstream address;
+	address << static_cast<void*>(value);
+	return address.str();
 }
 
 
@@ -34,6 +251,8 @@ Node::Node(std::string tag, std::string value)
 	this->value = value;
 }
 
+Node::~Node() {}
+
 void Node::dump(int depth)
 {
 	for(int i = 0; i < depth; i++)
@@ -99,48 +318,50 @@ Expression::Expression(Expression::Type type, bool isExecutable, std::string tag
 {
 	this->type = type;
 	this->isExecutable = isExecutable;
+	this->isUpdatedInPlace = false;
+	this->isTransient = false;
 }
 
 Expression* Expression::operator == (Expression* obj)
 {
 	log_calls("Expression* Expression::operator == (Expression* obj)");
-	return nullptr;
+	throw RuntimeError("attempt to compare " + typeName() + " with " + obj->typeName());
 }
 
 Expression* Expression::operator != (Expression* obj)
 {
 	log_calls("Expression* Expression::operator != (Expression* obj)");
-	return nullptr;
+	throw RuntimeError("attempt to compare " + typeName() + " with " + obj->typeName());
 }
 
 Expression* Expression::operator + (Expression* obj)
 {
 	log_calls("Expression* Expression::operator + (Expression* obj)");
-	return nullptr;
+	throw RuntimeError("attempt to perform arithmetic on a " + typeName() + " value");
 }
 
 Expression* Expression::operator - (Expression* obj)
 {
 	log_calls("Expression* Expression::operator - (Expression* obj)");
-	return nullptr;
+	throw RuntimeError("attempt to perform arithmetic on a " + typeName() + " value");
 }
 
 Expression* Expression::operator * (Expression* obj)
 {
 	log_calls("Expression* Expression::operator * (Expression* obj)");
-	return nullptr;
+	throw RuntimeError("attempt to perform arithmetic on a " + typeName() + " value");
 }
 
 Expression* Expression::operator / (Expression* obj)
 {
 	log_calls("Expression* Expression::operator / (Expression* obj)");
-	return nullptr;
+	throw RuntimeError("attempt to perform arithmetic on a " + typeName() + " value");
 }
 
 Expression* Expression::operator ^ (Expression* obj)
 {
 	log_calls("Expression* Expression::operator ^ (Expression* obj)");
-	return nullptr;
+	throw RuntimeError("attempt to perform arithmetic on a " + typeName() + " value");
 }
 
 Expression::~Expression() {}
@@ -163,6 +384,8 @@ void Expression::evaluate(float& returnValue)
 void Expression::evaluate(bool& returnValue)
 {
 	log_calls("void Expression::evaluate(bool& returnValue)");
+
+	returnValue = isTruthy(valueOf(this));
 }
 
 void Expression::evaluate(Expression*& returnValue)
@@ -176,6 +399,28 @@ Expression* Expression::execute()
 	return nullptr;
 }
 
+// Computes the value into number when it is one, so the caller can use it without a node.
+// Returns the value otherwise
+Expression* Expression::evaluateNumber(Number& number)
+{
+	Expression* value = valueOf(this);
+
+	return numberFrom(value, number) ? nullptr : value;
+}
+
+// Returns the expression to use in place of this one, with constant subtrees computed
+Expression* Expression::fold()
+{
+	return this;
+}
+
+// Returns the key ValueNumbering identifies the value by, empty when it is not computed from
+// variables and literals alone
+std::string Expression::number(ValueNumbering& numbering)
+{
+	return isConstant(this) ? numbering.constant(this) : "";
+}
+
 bool Expression::sameType(Expression* other)
 {
 	log_calls("bool Expression::sameType(Expression* other)");
@@ -183,11 +428,80 @@ bool Expression::sameType(Expression* other)
 	return false;
 }
 
+std::string Expression::typeName()
+{
+	switch (type)
+	{
+		case Expression::Type::STRING:
+			return "string";
+		case Expression::Type::INTEGER:
+		case Expression::Type::FLOAT:
+			return "number";
+		case Expression::Type::BOOLEAN:
+			return "boolean";
+		case Expression::Type::NIL:
+			return "nil";
+		case Expression::Type::TABLE:
+			return "table";
+		case Expression::Type::FUNCTION:
+			return "function";
+		default: // Not a value
+			return "expression";
+	}
+}
+
+
+
+RuntimeError::RuntimeError(std::string message)
+{
+	this->message = message;
+	this->value = nullptr;
+	this->line = 0;
+}
+
+RuntimeError::RuntimeError(Expression* value)
+{
+	this->message = "";
+	this->value = value;
+	this->line = 0;
+}
+
+// Errors raised by the interpreter become "source:line: message" strings, as in Lua, the
+// source being stdin or the file a prelude, each-line script or reloaded version came from
+Expression* RuntimeError::errorObject(const std::string& source, int line)
+{
+	if (this->line == 0)
+		this->line = line;
+
+	if (!value)
+		value = new StringNode(source + ":" + std::to_string(this->line) + ": " + message);
+
+	return value;
+}
+
+std::string RuntimeError::describe(const std::string& source, int line)
+{
+	Expression* object = errorObject(source, line);
+
+	if (object->type != Expression::Type::STRING)
+		return "(error object is a " + object->typeName() + " value)";
+
+	std::string text = "";
+	object->evaluate(text);
+	return text;
+}
+
 
 
-Statement::Statement() {}
+Statement::Statement()
+{
+	this->line = 0;
+}
 
-Statement::Statement(std::string tag, std::string value) : Node(tag, value) {}
+Statement::Statement(std::string tag, std::string value) : Node(tag, value)
+{
+	this->line = 0;
+}
 
 Statement::~Statement() {}
 
@@ -222,13 +536,34 @@ Expression* Statement::execute()
 	return nullptr;
 }
 
+// Folds the expressions of the statement, returning the statement to use in its place
+Statement* Statement::fold()
+{
+	return this;
+}
+
+// Numbers the expressions of the statement, in the order they run
+void Statement::number(ValueNumbering& numbering)
+{
+}
+
+// True when running the statement always ends in return or break, so what follows it is dead
+bool Statement::alwaysExits()
+{
+	return false;
+}
+
 
 
-AssignmentNode::AssignmentNode() : Statement("AssignmentNode", "") {}
+AssignmentNode::AssignmentNode() : Statement("AssignmentNode", "")
+{
+	this->result = nullptr;
+	this->resultEpoch = 0;
+}
 
-AssignmentNode::AssignmentNode(Environment* environment, Expression* left, Expression* right) : Statement("AssignmentNode", "")
+AssignmentNode::AssignmentNode(Environment* environment, Expression* left, Expression* right, bool isLocal) : Statement("AssignmentNode", "")
 {
-	log_calls("AssignmentNode::AssignmentNode(Environment* environment, Expression* left, Expression* right)");
+	log_calls("AssignmentNode::AssignmentNode(Environment* environment, Expression* left, Expression* right, bool isLocal)");
 
 	this->children.push_back(left);
 	this->children.push_back(right);
@@ -236,6 +571,15 @@ AssignmentNode::AssignmentNode(Environment* environment, Expression* left, Expre
 	this->environment = environment;
 	this->left = left;
 	this->right = right;
+	this->isLocal = isLocal;
+	this->result = nullptr;
+	this->resultEpoch = 0;
+
+	if (left->type == Expression::Type::VARIABLE)
+		left->evaluate(this->name);
+
+	if (isLocal)
+		this->value = "local";
 }
 
 AssignmentNode::~AssignmentNode() {}
@@ -249,31 +593,114 @@ Expression* AssignmentNode::execute()
 {
 	log_calls("Expression* AssignmentNode::execute()");
 
-	if (left->isExecutable)
-		left = left->execute();
-	if (right->isExecutable)
-		right = right->execute();
+	if (left->type == Expression::Type::INDEX) // t[k] = exp and t.name = exp
+	{
+		assign(valueOf(right));
+		return nullptr;
+	}
 
-	if (left->type != Expression::Type::VARIABLE) // Can't assign a non-variable
+	if (right->type == Expression::Type::BINARYOPERATION || right->type == Expression::Type::CALL) // A number result may not need a new node
 	{
-		std::cout << "SYNTAX ERROR: non-VARIABLE assignment\n";
+		Number number;
+		Expression* value = right->evaluateNumber(number);
+
+		if (value)
+			assign(value);
+		else
+			assignNumber(number);
+
 		return nullptr;
 	}
 
 	Expression* rightExpression = right;
 
-	if (right->type == Expression::Type::VARIABLE)
+	if (rightExpression->isExecutable)
+		rightExpression = valueOf(rightExpression);
+
+	if (rightExpression->type == Expression::Type::VARIABLE)
 	{
-		right->evaluate(rightExpression);
+		std::string rightName = "";
+		rightExpression->evaluate(rightName);
+
+		rightExpression->evaluate(rightExpression);
 		if (!rightExpression) // Check if right variable exists
-		{
-			std::cout << "SYNTAX ERROR: trying to assign a var to an undeclared variable\n";
-			return nullptr;
-		}
+			throw RuntimeError("attempt to assign the undeclared variable '" + rightName + "'");
+	}
+
+	assign(rightExpression);
+	return nullptr;
+}
+
+Statement* AssignmentNode::fold()
+{
+	log_calls("Statement* AssignmentNode::fold()");
+
+	left = left->fold();
+	right = right->fold();
+	this->children = { left, right };
+
+	return this;
+}
+
+void AssignmentNode::number(ValueNumbering& numbering)
+{
+	log_calls("void AssignmentNode::number(ValueNumbering& numbering)");
+
+	numbering.expression(right);
+
+	if (left->type == Expression::Type::INDEX)
+		left->number(numbering);
+	else
+	{
+		std::string name = "";
+		left->evaluate(name);
+		numbering.assign(name);
 	}
+}
+
+// The previous result is overwritten in place when nothing else can hold it: the variable still
+// refers to it, storing it anywhere else copies it, and no call started since it was stored, so
+// no parameter is bound to it and no caller has it pending
+void AssignmentNode::assignNumber(const Number& number)
+{
+	log_calls("void AssignmentNode::assignNumber(const Number& number)");
+
+	Expression::Type type = number.isInteger ? Expression::Type::INTEGER : Expression::Type::FLOAT;
+
+	if (result && result->type == type && resultEpoch == environment->epoch && environment->read(name) == result)
+	{
+		if (number.isInteger)
+			static_cast<IntegerNode*>(result)->setValue(number.integer);
+		else
+			static_cast<FloatNode*>(result)->setValue(number.real);
+		return;
+	}
+
+	Expression* value = boxed(number);
+	assign(value);
+
+	value->isUpdatedInPlace = true; // Only now, assign() would have stored a copy
+	result = value;
+	resultEpoch = environment->epoch;
+}
+
+void AssignmentNode::assign(Expression* rightExpression)
+{
+	log_calls("void AssignmentNode::assign(Expression* rightExpression)");
+
+	if (left->type == Expression::Type::INDEX)
+	{
+		static_cast<IndexNode*>(left)->assign(rightExpression);
+		return;
+	}
+
+	if (left->type != Expression::Type::VARIABLE) // Can't assign a non-variable
+		throw RuntimeError("attempt to assign to a " + left->typeName() + " value");
 
+	std::string leftName = "";
+	left->evaluate(leftName);
 
-	if (environment->exists(left)) // Check if type doesn't match
+	if (!isLocal && environment->exists(left)) // Check if type doesn't match
 	{
 		if (!left->sameType(rightExpression))
 		{
@@ -282,23 +709,26 @@ Expression* AssignmentNode::execute()
 			Expression::Type lType = leftExpression->type;
 			Expression::Type rType = rightExpression->type;
 
-			// To allow int = float and float = int
-			if (!((lType == Expression::Type::INTEGER && rType == Expression::Type::FLOAT) || (lType == Expression::Type::FLOAT && rType == Expression::Type::INTEGER)))
-			{
-				std::cout << "SYNTAX ERROR: trying to assign a variable with an expression of the wrong type" << lType << ", " << rType << '\n';
-				return nullptr;
-			}
+			// To allow int = float, float = int and clearing or declaring through nil
+			if (!((lType == Expression::Type::INTEGER && rType == Expression::Type::FLOAT) || (lType == Expression::Type::FLOAT && rType == Expression::Type::INTEGER)
+				|| lType == Expression::Type::NIL || rType == Expression::Type::NIL))
+				throw RuntimeError("attempt to assign a " + rightExpression->typeName() + " value to the " + leftExpression->typeName() + " variable '" + leftName + "'");
 		}
 	}
 
 
-	environment->write(left, rightExpression);
+	rightExpression = stored(rightExpression);
+
+	if (isLocal)
+		environment->declare(leftName, rightExpression);
+	else
+		environment->write(leftName, rightExpression);
 
 	/* --- Output the assignment --- */
-	std::string leftName = "";
-	std::string output = "";
+	if (!debug_assignments) // Built only to be logged
+		return;
 
-	left->evaluate(leftName);
+	std::string output = "";
 
 
 	switch (rightExpression->type)
@@ -339,16 +769,99 @@ Expression* AssignmentNode::execute()
 				output = leftName + " = false";
 			break;
 		}
+		case Expression::Type::NIL:
+			output = leftName + " = nil";
+			break;
+		case Expression::Type::TABLE:
+			output = leftName + " = table: " + addressOf(rightExpression);
+			break;
+		case Expression::Type::FUNCTION:
+			output = leftName + " = function: " + addressOf(rightExpression);
+			break;
+		case Expression::Type::VALUELIST:
 		case Expression::Type::PARENTHESIS:
 		case Expression::Type::BINARYOPERATION:
+		case Expression::Type::LOGICALOPERATION:
+		case Expression::Type::UNARYOPERATION:
+		case Expression::Type::TABLECONSTRUCTOR:
+		case Expression::Type::INDEX:
+		case Expression::Type::CALL:
+		case Expression::Type::TEMPORARY:
+		case Expression::Type::ARGUMENT:
 			break;
 	}
 
 	log_assignments(output);
+}
+
+
+
+MultipleAssignmentNode::MultipleAssignmentNode() : Statement("MultipleAssignmentNode", "") {}
+
+MultipleAssignmentNode::MultipleAssignmentNode(Environment* environment, std::vector<Expression*> variables, std::vector<Expression*> expressions, bool isLocal) : Statement("MultipleAssignmentNode", "")
+{
+	log_calls("MultipleAssignmentNode::MultipleAssignmentNode(Environment* environment, std::vector<Expression*> variables, std::vector<Expression*> expressions, bool isLocal)");
+
+	for (auto variable : variables)
+	{
+		this->children.push_back(variable);
+		this->targets.push_back(new AssignmentNode(environment, variable, NilNode::instance(), isLocal));
+	}
+	for (auto expression : expressions)
+		this->children.push_back(expression);
+
+	this->expressions = expressions;
+
+	if (isLocal)
+		this->value = "local";
+}
+
+MultipleAssignmentNode::~MultipleAssignmentNode() {}
+
+const std::vector<AssignmentNode*>& MultipleAssignmentNode::targetList()
+{
+	return targets;
+}
+
+Expression* MultipleAssignmentNode::execute()
+{
+	log_calls("Expression* MultipleAssignmentNode::execute()");
+
+	// Every value is computed before the first store, so a, b = b, a swaps
+	std::vector<Expression*> values;
+	valuesOf(expressions, values);
+
+	for (long unsigned int i = 0; i < targets.size(); i++)
+		targets[i]->assign(i < values.size() ? values[i] : NilNode::instance());
 
 	return nullptr;
 }
 
+Statement* MultipleAssignmentNode::fold()
+{
+	log_calls("Statement* MultipleAssignmentNode::fold()");
+
+	for (auto target : targets)
+		target->fold();
+	foldAll(expressions);
+
+	this->children.resize(targets.size());
+	this->children.insert(this->children.end(), expressions.begin(), expressions.end());
+
+	return this;
+}
+
+void MultipleAssignmentNode::number(ValueNumbering& numbering)
+{
+	log_calls("void MultipleAssignmentNode::number(ValueNumbering& numbering)");
+
+	for (auto& expression : expressions)
+		numbering.expression(expression);
+
+	for (auto target : targets)
+		target->number(numbering);
+}
+
 
 
 VariableNode::VariableNode() {}
@@ -451,15 +964,21 @@ void VariableNode::evaluate(Expression*& returnValue)
 {
 	log_evaluations("VariableNode::evaluate(Expression*& returnValue)");
 
-	returnValue = environment->read(this);
+	returnValue = environment->read(name);
 }
 
 void VariableNode::evaluate(std::string& returnValue)
 {
-	log_evaluations("VariableNode::evaluate(std::string& returnValue)\t = " + name);
+	if (debug_evaluations)
+		log_evaluations(("VariableNode::evaluate(std::string& returnValue)\t = " + name).c_str());
 	returnValue = name;
 }
 
+std::string VariableNode::number(ValueNumbering& numbering)
+{
+	return numbering.variable(name);
+}
+
 bool VariableNode::sameType(Expression* other)
 {
 	log_calls("bool VariableNode::sameType(Expression* other)");
@@ -488,10 +1007,7 @@ Expression* IntegerNode::operator == (Expression* obj)
 		obj->evaluate(objExpression);
 
 	if (objExpression->type != Expression::Type::INTEGER && objExpression->type != Expression::Type::FLOAT)
-	{
-		std::cout << "SYNTAX ERROR: different types when checking equality\n";
-		return nullptr;
-	}
+		throw RuntimeError("attempt to compare " + this->typeName() + " with " + objExpression->typeName());
 
 	if (objExpression->type == Expression::Type::FLOAT)
 	{
@@ -517,10 +1033,7 @@ Expression* IntegerNode::operator != (Expression* obj)
 		obj->evaluate(objExpression);
 
 	if (objExpression->type != Expression::Type::INTEGER && objExpression->type != Expression::Type::FLOAT)
-	{
-		std::cout << "SYNTAX ERROR: different types when checking equality\n";
-		return nullptr;
-	}
+		throw RuntimeError("attempt to compare " + this->typeName() + " with " + objExpression->typeName());
 
 	if (objExpression->type == Expression::Type::FLOAT)
 	{
@@ -547,10 +1060,7 @@ Expression* IntegerNode::operator + (Expression* obj)
 
 
 	if (objExpression->type != Expression::Type::INTEGER && objExpression->type != Expression::Type::FLOAT)
-	{
-		std::cout << "SYNTAX ERROR: different types when checking equality\n";
-		return nullptr;
-	}
+		throw RuntimeError("attempt to perform arithmetic on a " + objExpression->typeName() + " value");
 
 	if (objExpression->type == Expression::Type::FLOAT)
 	{
@@ -563,7 +1073,7 @@ Expression* IntegerNode::operator + (Expression* obj)
 	int objValue = 0;
 	objExpression->evaluate(objValue);
 
-	return new IntegerNode(this->value + objValue);
+	return new IntegerNode(wrappedSum(this->value, objValue));
 }
 
 Expression* IntegerNode::operator - (Expression* obj)
@@ -577,10 +1087,7 @@ Expression* IntegerNode::operator - (Expression* obj)
 
 
 	if (objExpression->type != Expression::Type::INTEGER && objExpression->type != Expression::Type::FLOAT)
-	{
-		std::cout << "SYNTAX ERROR: different types when checking equality\n";
-		return nullptr;
-	}
+		throw RuntimeError("attempt to perform arithmetic on a " + objExpression->typeName() + " value");
 
 	if (objExpression->type == Expression::Type::FLOAT)
 	{
@@ -593,7 +1100,7 @@ Expression* IntegerNode::operator - (Expression* obj)
 	int objValue = 0;
 	objExpression->evaluate(objValue);
 
-	return new IntegerNode(this->value - objValue);
+	return new IntegerNode(wrappedDifference(this->value, objValue));
 }
 
 Expression* IntegerNode::operator * (Expression* obj)
@@ -607,10 +1114,7 @@ Expression* IntegerNode::operator * (Expression* obj)
 
 
 	if (objExpression->type != Expression::Type::INTEGER && objExpression->type != Expression::Type::FLOAT)
-	{
-		std::cout << "SYNTAX ERROR: different types when checking equality\n";
-		return nullptr;
-	}
+		throw RuntimeError("attempt to perform arithmetic on a " + objExpression->typeName() + " value");
 
 	if (objExpression->type == Expression::Type::FLOAT)
 	{
@@ -623,7 +1127,7 @@ Expression* IntegerNode::operator * (Expression* obj)
 	int objValue = 0;
 	objExpression->evaluate(objValue);
 
-	return new IntegerNode(this->value * objValue);
+	return new IntegerNode(wrappedProduct(this->value, objValue));
 }
 
 Expression* IntegerNode::operator / (Expression* obj)
@@ -637,10 +1141,7 @@ Expression* IntegerNode::operator / (Expression* obj)
 
 
 	if (objExpression->type != Expression::Type::INTEGER && objExpression->type != Expression::Type::FLOAT)
-	{
-		std::cout << "SYNTAX ERROR: wrong types when checking equality\n";
-		return nullptr;
-	}
+		throw RuntimeError("attempt to perform arithmetic on a " + objExpression->typeName() + " value");
 
 	// Int / Float edge-case
 	if (objExpression->type == Expression::Type::FLOAT)
@@ -649,10 +1150,7 @@ Expression* IntegerNode::operator / (Expression* obj)
 		objExpression->evaluate(objValue);
 
 		if (objValue == 0.0)
-		{
-			std::cout << "SYNTAX ERROR: division by zero\n";
-			return nullptr;
-		}
+			throw RuntimeError("attempt to divide by zero");
 
 		return new FloatNode((float)this->value / objValue);
 	}
@@ -661,10 +1159,7 @@ Expression* IntegerNode::operator / (Expression* obj)
 	objExpression->evaluate(objValue);
 
 	if (objValue == 0)
-	{
-		std::cout << "SYNTAX ERROR: division by zero\n";
-		return nullptr;
-	}
+		throw RuntimeError("attempt to divide by zero");
 
 	return new FloatNode((float)this->value / objValue);
 }
@@ -680,10 +1175,7 @@ Expression* IntegerNode::operator ^ (Expression* obj)
 
 
 	if (objExpression->type != Expression::Type::INTEGER && objExpression->type != Expression::Type::FLOAT)
-	{
-		std::cout << "SYNTAX ERROR: different types when checking equality\n";
-		return nullptr;
-	}
+		throw RuntimeError("attempt to perform arithmetic on a " + objExpression->typeName() + " value");
 
 	if (objExpression->type == Expression::Type::FLOAT)
 	{
@@ -696,14 +1188,20 @@ Expression* IntegerNode::operator ^ (Expression* obj)
 	int objValue = 0;
 	objExpression->evaluate(objValue);
 
-	return new FloatNode(std::pow((float)this->value, objValue));
+	return new FloatNode(powerOf((float)this->value, objValue));
 }
 
 IntegerNode::~IntegerNode() {}
 
+void IntegerNode::setValue(int value)
+{
+	this->value = value;
+}
+
 void IntegerNode::evaluate(int& returnValue)
 {
-	log_evaluations("IntegerNode::evaluate(int& returnValue)\t\t = " + std::to_string(value));
+	if (debug_evaluations)
+		log_evaluations(("IntegerNode::evaluate(int& returnValue)\t\t = " + std::to_string(value)).c_str());
 	returnValue = value;
 }
 
@@ -728,10 +1226,7 @@ Expression* FloatNode::operator == (Expression* obj)
 		obj->evaluate(objExpression);
 
 	if (objExpression->type != Expression::Type::FLOAT && objExpression->type != Expression::Type::INTEGER)
-	{
-		std::cout << "SYNTAX ERROR: different types when checking equality\n";
-		return nullptr;
-	}
+		throw RuntimeError("attempt to compare " + this->typeName() + " with " + objExpression->typeName());
 
 	if (objExpression->type == Expression::Type::INTEGER)
 	{
@@ -757,10 +1252,7 @@ Expression* FloatNode::operator != (Expression* obj)
 		obj->evaluate(objExpression);
 
 	if (objExpression->type != Expression::Type::FLOAT && objExpression->type != Expression::Type::INTEGER)
-	{
-		std::cout << "SYNTAX ERROR: different types when checking equality\n";
-		return nullptr;
-	}
+		throw RuntimeError("attempt to compare " + this->typeName() + " with " + objExpression->typeName());
 
 	if (objExpression->type == Expression::Type::INTEGER)
 	{
@@ -787,10 +1279,7 @@ Expression* FloatNode::operator + (Expression* obj)
 
 
 	if (objExpression->type != Expression::Type::FLOAT && objExpression->type != Expression::Type::INTEGER)
-	{
-		std::cout << "SYNTAX ERROR: different types when checking equality\n";
-		return nullptr;
-	}
+		throw RuntimeError("attempt to perform arithmetic on a " + objExpression->typeName() + " value");
 
 	if (objExpression->type == Expression::Type::INTEGER)
 	{
@@ -817,10 +1306,7 @@ Expression* FloatNode::operator - (Expression* obj)
 
 
 	if (objExpression->type != Expression::Type::FLOAT && objExpression->type != Expression::Type::INTEGER)
-	{
-		std::cout << "SYNTAX ERROR: different types when checking equality\n";
-		return nullptr;
-	}
+		throw RuntimeError("attempt to perform arithmetic on a " + objExpression->typeName() + " value");
 
 	if (objExpression->type == Expression::Type::INTEGER)
 	{
@@ -847,10 +1333,7 @@ Expression* FloatNode::operator * (Expression* obj)
 
 
 	if (objExpression->type != Expression::Type::FLOAT && objExpression->type != Expression::Type::INTEGER)
-	{
-		std::cout << "SYNTAX ERROR: different types when checking equality\n";
-		return nullptr;
-	}
+		throw RuntimeError("attempt to perform arithmetic on a " + objExpression->typeName() + " value");
 
 	if (objExpression->type == Expression::Type::INTEGER)
 	{
@@ -877,10 +1360,7 @@ Expression* FloatNode::operator / (Expression* obj)
 
 
 	if (objExpression->type != Expression::Type::FLOAT && objExpression->type != Expression::Type::INTEGER)
-	{
-		std::cout << "SYNTAX ERROR: different types when checking equality\n";
-		return nullptr;
-	}
+		throw RuntimeError("attempt to perform arithmetic on a " + objExpression->typeName() + " value");
 
 	if (objExpression->type == Expression::Type::INTEGER)
 	{
@@ -907,17 +1387,14 @@ Expression* FloatNode::operator ^ (Expression* obj)
 
 
 	if (objExpression->type != Expression::Type::FLOAT && objExpression->type != Expression::Type::INTEGER)
-	{
-		std::cout << "SYNTAX ERROR: different types when checking equality\n";
-		return nullptr;
-	}
+		throw RuntimeError("attempt to perform arithmetic on a " + objExpression->typeName() + " value");
 
 	if (objExpression->type == Expression::Type::INTEGER)
 	{
-		int objValue = 0.0;
+		int objValue = 0;
 		objExpression->evaluate(objValue);
 
-		return new FloatNode(std::pow(this->value, objValue));
+		return new FloatNode(powerOf(this->value, objValue));
 	}
 
 	float objValue = 0.0;
@@ -929,6 +1406,11 @@ Expression* FloatNode::operator ^ (Expression* obj)
 
 FloatNode::~FloatNode() {}
 
+void FloatNode::setValue(float value)
+{
+	this->value = value;
+}
+
 void FloatNode::evaluate(float& returnValue)
 {
 	log_evaluations("void FloatNode::evaluate(float& returnValue)");
@@ -957,10 +1439,7 @@ Expression* StringNode::operator == (Expression* obj)
 		obj->evaluate(objExpression);
 
 	if (objExpression->type != Expression::Type::STRING)
-	{
-		std::cout << "SYNTAX ERROR: different types when checking equality " << this->type << ", " << objExpression->type << '\n';
-		return nullptr;
-	}
+		throw RuntimeError("attempt to compare " + this->typeName() + " with " + objExpression->typeName());
 
 	std::string objValue = "";
 	objExpression->evaluate(objValue);
@@ -978,10 +1457,7 @@ Expression* StringNode::operator != (Expression* obj)
 		obj->evaluate(objExpression);
 
 	if (objExpression->type != Expression::Type::STRING)
-	{
-		std::cout << "SYNTAX ERROR: different types when checking equality " << this->type << ", " << objExpression->type << '\n';
-		return nullptr;
-	}
+		throw RuntimeError("attempt to compare " + this->typeName() + " with " + objExpression->typeName());
 
 	std::string objValue = "";
 	objExpression->evaluate(objValue);
@@ -1000,10 +1476,7 @@ Expression* StringNode::operator + (Expression* obj)
 
 
 	if (objExpression->type != Expression::Type::STRING)
-	{
-		std::cout << "SYNTAX ERROR: different types when checking equality\n";
-		return nullptr;
-	}
+		throw RuntimeError("attempt to concatenate a " + objExpression->typeName() + " value");
 
 	std::string objValue = "";
 	objExpression->evaluate(objValue);
@@ -1022,10 +1495,7 @@ Expression* StringNode::operator * (Expression* obj)
 
 
 	if (objExpression->type != Expression::Type::INTEGER)
-	{
-		std::cout << "SYNTAX ERROR: wrong types when checking equality\n";
-		return nullptr;
-	}
+		throw RuntimeError("attempt to repeat a string " + objExpression->typeName() + " times");
 
 	std::string result = "";
 	int objValue = 0;
@@ -1039,6 +1509,13 @@ Expression* StringNode::operator * (Expression* obj)
 
 StringNode::~StringNode() {}
 
+// For a line io hands out, reusing the storage of the one before
+void StringNode::setValue(const char* text, long unsigned int length)
+{
+	this->value.assign(text, length);
+	Node::value.assign(text, length);
+}
+
 void StringNode::evaluate(std::string& returnValue)
 {
 	log_evaluations("StringNode::evaluate(std::string& returnValue)");
@@ -1067,10 +1544,7 @@ Expression* BooleanNode::operator == (Expression* obj)
 		obj->evaluate(objExpression); // Extract the underlying expression
 
 	if (objExpression->type != Expression::Type::BOOLEAN)
-	{
-		std::cout << "SYNTAX ERROR: different types when checking equality\n";
-		return nullptr;
-	}
+		throw RuntimeError("attempt to compare " + this->typeName() + " with " + objExpression->typeName());
 
 	bool objValue = false;
 	objExpression->evaluate(objValue);
@@ -1088,10 +1562,7 @@ Expression* BooleanNode::operator != (Expression* obj)
 		obj->evaluate(objExpression); // Extract the underlying expression
 
 	if (objExpression->type != Expression::Type::BOOLEAN)
-	{
-		std::cout << "SYNTAX ERROR: different types when checking equality\n";
-		return nullptr;
-	}
+		throw RuntimeError("attempt to compare " + this->typeName() + " with " + objExpression->typeName());
 
 	bool objValue = false;
 	objExpression->evaluate(objValue);
@@ -1113,202 +1584,1818 @@ void BooleanNode::evaluate(bool& returnValue)
 
 
 
-BinaryOperationNode::BinaryOperationNode() {}
-
-BinaryOperationNode::BinaryOperationNode(Expression* left, Expression* right, BinaryOperationNode::Operation operation) : Expression(Expression::Type::BINARYOPERATION, true, "BinaryOperationNode", "")
+NilNode::NilNode() : Expression(Expression::Type::NIL, false, "NilNode", "nil")
 {
-	log_calls("BinaryOperationNode::BinaryOperationNode(Expression* left, Expression* right, BinaryOperationNode::Operation operation)");
+	log_calls("NilNode::NilNode()");
+}
 
-	this->children.push_back(left);
-	this->children.push_back(right);
+NilNode::~NilNode() {}
 
-	this->left = left;
-	this->right = right;
-	this->operation = operation;
+Expression* NilNode::instance()
+{
+	static NilNode nil;
+	return &nil;
+}
 
-	switch(this->operation)
-	{
-		case BinaryOperationNode::Operation::EQUALS:
-			this->value = "'=='";
-			break;
-		case BinaryOperationNode::Operation::NOT_EQUALS:
-			this->value = "'!='";
-			break;
-		case BinaryOperationNode::Operation::PLUS:
-			this->value = "'+'";
-			break;
-		case BinaryOperationNode::Operation::MINUS:
-			this->value = "'-'";
-			break;
-		case BinaryOperationNode::Operation::MULTIPLICATION:
-			this->value = "'*'";
-			break;
-		case BinaryOperationNode::Operation::DIVISION:
-			this->value = "'/'";
-			break;
-		case BinaryOperationNode::Operation::POWER_OF:
-			this->value = "'^'";
-			break;
-	}
+void NilNode::evaluate(bool& returnValue)
+{
+	log_evaluations("NilNode::evaluate(bool& returnValue)\t\t = false");
+
+	returnValue = false;
 }
 
-BinaryOperationNode::~BinaryOperationNode() {}
 
-Expression* BinaryOperationNode::execute()
-{
-	log_calls("Expression* BinaryOperationNode::execute()");
 
-	if (left->isExecutable)
-		left = left->execute();
-	if (right->isExecutable)
-		right = right->execute();
+ValueListNode::ValueListNode() {}
 
-	switch(this->operation)
-	{
-		case BinaryOperationNode::Operation::EQUALS:
-			return *left == right;
-		case BinaryOperationNode::Operation::NOT_EQUALS:
-			return *left != right;
-		case BinaryOperationNode::Operation::PLUS:
-			return *left + right;
-		case BinaryOperationNode::Operation::MINUS:
-			return *left - right;
-		case BinaryOperationNode::Operation::MULTIPLICATION:
-			return *left * right;
-		case BinaryOperationNode::Operation::DIVISION:
-			return *left / right;
-		case BinaryOperationNode::Operation::POWER_OF:
-			return *left ^ right;
-	}
+ValueListNode::ValueListNode(std::vector<Expression*> values) : Expression(Expression::Type::VALUELIST, false, "ValueListNode", "")
+{
+	log_calls("ValueListNode::ValueListNode(std::vector<Expression*> values)");
 
-	return nullptr;
+	this->values = values;
 }
 
+ValueListNode::~ValueListNode() {}
 
 
-ParenthesisNode::ParenthesisNode() {}
 
-ParenthesisNode::ParenthesisNode(Expression* expression) : Expression(Expression::Type::PARENTHESIS, true, "ParenthesisNode", "")
+TableNode::TableNode() : Expression(Expression::Type::TABLE, false, "TableNode", "")
 {
-	log_calls("ParenthesisNode::ParenthesisNode(Expression* expression)");
-	this->children.push_back(expression);
+	log_calls("TableNode::TableNode()");
 
-	this->expression = expression;
+	this->absentMetamethods = 0;
+	this->metatable = nullptr;
 }
 
-ParenthesisNode::~ParenthesisNode() {}
+TableNode::~TableNode() {}
 
-Expression* ParenthesisNode::operator == (Expression* obj)
+void TableNode::migrateToArray()
 {
-	log_calls("Expression* ParenthesisNode::operator == (Expression* obj)");
-	return *this->expression == obj;
+	while (!integers.empty())
+	{
+		auto next = integers.find(array.size() + 1);
+		if (next == integers.end())
+			break;
+
+		array.push_back(next->second);
+		integers.erase(next);
+	}
 }
 
-Expression* ParenthesisNode::operator != (Expression* obj)
+// The border Lua's # gives: the array part never ends in nil and key n + 1 is never outside it
+int TableNode::length()
 {
-	log_calls("Expression* ParenthesisNode::operator != (Expression* obj)");
-	return *this->expression != obj;
+	return (int)array.size();
 }
 
-Expression* ParenthesisNode::operator + (Expression* obj)
+std::vector<Expression*>& TableNode::arrayPart()
 {
-	log_calls("Expression* ParenthesisNode::operator + (Expression* obj)");
-	return *this->expression + obj;
+	return array;
 }
 
-Expression* ParenthesisNode::operator - (Expression* obj)
+// Every key with its value, the array part first and in order, leaving out its holes
+std::vector<std::pair<Expression*, Expression*>> TableNode::entries()
 {
-	log_calls("Expression* ParenthesisNode::operator - (Expression* obj)");
-	return *this->expression - obj;
+	std::vector<std::pair<Expression*, Expression*>> entries;
+	for (long unsigned int i = 0; i < array.size(); i++)
+		if (array[i])
+			entries.push_back(std::make_pair(new IntegerNode((int)i + 1), array[i]));
+	for (auto& integer : integers)
+		entries.push_back(std::make_pair(new IntegerNode(integer.first), integer.second));
+	for (auto& field : fields)
+		entries.push_back(std::make_pair(new StringNode(field.first), field.second));
+	for (auto& object : objects)
+		entries.push_back(object);
+
+	return entries;
 }
 
-Expression* ParenthesisNode::operator * (Expression* obj)
+Expression* TableNode::rawGet(Expression* key)
 {
-	log_calls("Expression* ParenthesisNode::operator * (Expression* obj)");
-	return *this->expression * obj;
+	switch (key->type)
+	{
+		case Expression::Type::STRING:
+		{
+			std::string name = "";
+			key->evaluate(name);
+			return rawGet(name);
+		}
+		case Expression::Type::INTEGER:
+		{
+			int index = 0;
+			key->evaluate(index);
+			return rawGet(index);
+		}
+		case Expression::Type::FLOAT:
+		{
+			float number = 0.0;
+			key->evaluate(number);
+			if (number == (int)number)
+				return rawGet((int)number);
+			return nullptr;
+		}
+		case Expression::Type::TABLE:
+		case Expression::Type::FUNCTION:
+		{
+			auto found = objects.find(key);
+			if (found != objects.end())
+				return found->second;
+			return nullptr;
+		}
+		default:
+			return nullptr;
+	}
 }
 
-Expression* ParenthesisNode::operator / (Expression* obj)
+Expression* TableNode::rawGet(const std::string& key)
 {
-	log_calls("Expression* ParenthesisNode::operator / (Expression* obj)");
-	return *this->expression / obj;
+	auto found = fields.find(key);
+	if (found != fields.end())
+		return found->second;
+
+	return nullptr;
 }
 
-Expression* ParenthesisNode::operator ^ (Expression* obj)
+Expression* TableNode::rawGet(int key)
 {
-	log_calls("Expression* ParenthesisNode::operator ^ (Expression* obj)");
-	return *this->expression ^ obj;
+	if (key >= 1 && key <= (int)array.size())
+		return array[key - 1];
+
+	auto found = integers.find(key);
+	if (found != integers.end())
+		return found->second;
+
+	return nullptr;
 }
 
-void ParenthesisNode::evaluate(Expression*& returnValue)
+void TableNode::rawSet(Expression* key, Expression* value)
 {
-	log_evaluations("ParenthesisNode::evaluate(Expression*& returnValue)");
+	value = stored(value);
+
+	switch (key->type)
+	{
+		case Expression::Type::STRING:
+		{
+			std::string name = "";
+			key->evaluate(name);
+			rawSet(name, value);
+			return;
+		}
+		case Expression::Type::INTEGER:
+		{
+			int index = 0;
+			key->evaluate(index);
+			rawSet(index, value);
+			return;
+		}
+		case Expression::Type::FLOAT:
+		{
+			float number = 0.0;
+			key->evaluate(number);
+			if (number == (int)number)
+			{
+				rawSet((int)number, value);
+				return;
+			}
+			break;
+		}
+		case Expression::Type::TABLE:
+		case Expression::Type::FUNCTION:
+		{
+			if (value->type == Expression::Type::NIL)
+				objects.erase(key);
+			else
+				objects[key] = value;
+			return;
+		}
+		default:
+			break;
+	}
 
-	returnValue = this->expression;
+	throw RuntimeError("attempt to use a " + key->typeName() + " value as a table key");
 }
 
-void ParenthesisNode::evaluate(bool& returnValue)
+void TableNode::rawSet(const std::string& key, Expression* value)
 {
-	log_evaluations("ParenthesisNode::evaluate(Expression*& returnValue)");
+	value = stored(value);
 
-	this->expression->evaluate(returnValue);
+	if (key.compare(0, 2, "__") == 0) // May add a metamethod
+		absentMetamethods = 0;
+
+	if (value->type == Expression::Type::NIL)
+		fields.erase(key);
+	else
+		fields[key] = value;
 }
 
-Expression* ParenthesisNode::execute()
+void TableNode::rawSet(int key, Expression* value)
 {
-	log_calls("Expression* ParenthesisNode::execute()");
+	value = stored(value);
+	bool isNil = value->type == Expression::Type::NIL;
 
-	if (this->expression->isExecutable)
-		this->expression = this->expression->execute();
+	if (key >= 1 && key <= (int)array.size())
+	{
+		if (!isNil)
+			array[key - 1] = value;
+		else if (key < (int)array.size())
+			array[key - 1] = nullptr;
+		else
+		{
+			array.pop_back();
+			while (!array.empty() && !array.back())
+				array.pop_back();
+		}
+		return;
+	}
 
-	return this->expression;
+	if (isNil)
+		integers.erase(key);
+	else if (key == (int)array.size() + 1)
+	{
+		array.push_back(value);
+		migrateToArray();
+	}
+	else
+		integers[key] = value;
 }
 
+Expression* TableNode::get(Expression* key)
+{
+	log_calls("Expression* TableNode::get(Expression* key)");
 
+	TableNode* table = this;
 
-PrintNode::PrintNode() {}
+	while (true) // Follow the __index chain without recursing
+	{
+		Expression* value = table->rawGet(key);
+		if (value)
+			return value;
 
-PrintNode::PrintNode(std::vector<Expression*>  expressions) : Statement("PrintNode", "")
-{
-	for (auto expression : expressions)
-		this->children.push_back(expression);
+		Expression* handler = TableNode::metamethod(table, TableNode::Metamethod::INDEX);
+		if (!handler)
+			return NilNode::instance();
 
-	this->expressions = expressions;
+		if (handler->type != Expression::Type::TABLE)
+		{
+			std::vector<Expression*> arguments = { table, key };
+			return CallNode::call(handler, arguments);
+		}
+
+		table = static_cast<TableNode*>(handler);
+	}
 }
 
-PrintNode::~PrintNode() {}
+Expression* TableNode::get(const std::string& key)
+{
+	log_calls("Expression* TableNode::get(const std::string& key)");
 
-Expression* PrintNode::execute()
+	TableNode* table = this;
+
+	while (true)
+	{
+		Expression* value = table->rawGet(key);
+		if (value)
+			return value;
+
+		Expression* handler = TableNode::metamethod(table, TableNode::Metamethod::INDEX);
+		if (!handler)
+			return NilNode::instance();
+
+		if (handler->type != Expression::Type::TABLE)
+		{
+			std::vector<Expression*> arguments = { table, new StringNode(key) };
+			return CallNode::call(handler, arguments);
+		}
+
+		table = static_cast<TableNode*>(handler);
+	}
+}
+
+void TableNode::set(Expression* key, Expression* value)
 {
-	std::string output = "";
+	log_calls("void TableNode::set(Expression* key, Expression* value)");
 
-	for (auto expression : this->expressions)
+	TableNode* table = this;
+
+	while (true)
 	{
-		if (expression->isExecutable)
-			expression = expression->execute();
-			
-		if (expression->type == Expression::Type::VARIABLE)
-			expression->evaluate(expression);
+		Expression* handler = nullptr;
+		if (!table->rawGet(key)) // __newindex is only consulted for absent keys
+			handler = TableNode::metamethod(table, TableNode::Metamethod::NEWINDEX);
 
-		switch (expression->type)
+		if (!handler)
 		{
-			case Expression::Type::STRING:
-			{
-				expression->evaluate(output);
-				break;
-			}
-			case Expression::Type::INTEGER:
-			{
-				int value = 0;
-				expression->evaluate(value);
-				output += std::to_string(value);
-				break;
-			}
+			table->rawSet(key, value);
+			return;
+		}
+
+		if (handler->type != Expression::Type::TABLE)
+		{
+			std::vector<Expression*> arguments = { table, key, value };
+			CallNode::call(handler, arguments);
+			return;
+		}
+
+		table = static_cast<TableNode*>(handler);
+	}
+}
+
+Expression* TableNode::getMetamethod(TableNode::Metamethod event)
+{
+	if (absentMetamethods & (1u << event))
+		return nullptr;
+
+	static const std::string names[TableNode::Metamethod::METAMETHOD_COUNT] =
+		{ "__index", "__newindex", "__call", "__eq", "__add", "__sub", "__mul", "__div", "__pow", "__lt", "__le" };
+
+	auto found = fields.find(names[event]);
+	if (found == fields.end())
+	{
+		absentMetamethods |= 1u << event;
+		return nullptr;
+	}
+
+	return found->second;
+}
+
+Expression* TableNode::metamethod(Expression* value, TableNode::Metamethod event)
+{
+	if (value->type != Expression::Type::TABLE)
+		return nullptr;
+
+	TableNode* metatable = static_cast<TableNode*>(value)->metatable;
+	if (!metatable)
+		return nullptr;
+
+	return metatable->getMetamethod(event);
+}
+
+
+
+TableConstructorNode::TableConstructorNode() {}
+
+TableConstructorNode::TableConstructorNode(std::vector<std::pair<Expression*, Expression*>> fields) : Expression(Expression::Type::TABLECONSTRUCTOR, true, "TableConstructorNode", "")
+{
+	log_calls("TableConstructorNode::TableConstructorNode(std::vector<std::pair<Expression*, Expression*>> fields)");
+
+	for (auto field : fields)
+	{
+		if (field.first)
+			this->children.push_back(field.first);
+		this->children.push_back(field.second);
+	}
+
+	this->fields = fields;
+}
+
+TableConstructorNode::~TableConstructorNode() {}
+
+const std::vector<std::pair<Expression*, Expression*>>& TableConstructorNode::fieldList()
+{
+	return fields;
+}
+
+Expression* TableConstructorNode::execute()
+{
+	log_calls("Expression* TableConstructorNode::execute()");
+
+	TableNode* table = new TableNode();
+	int index = 1;
+
+	for (long unsigned int i = 0; i < fields.size(); i++)
+	{
+		Expression* key = fields[i].first;
+		Expression* value = fields[i].second;
+
+		if (key)
+			table->rawSet(valueOf(key), valueOf(value));
+		else if (i + 1 == fields.size() && value->type == Expression::Type::CALL) // {f()} keeps every result
+		{
+			std::vector<Expression*> expressions = { value }, values;
+			valuesOf(expressions, values);
+			for (auto result : values)
+				table->rawSet(index++, result);
+		}
+		else
+			table->rawSet(index++, valueOf(value));
+	}
+
+	return table;
+}
+
+Expression* TableConstructorNode::fold()
+{
+	log_calls("Expression* TableConstructorNode::fold()");
+
+	this->children.clear();
+
+	for (auto& field : fields)
+	{
+		if (field.first)
+		{
+			field.first = field.first->fold();
+			this->children.push_back(field.first);
+		}
+		field.second = field.second->fold();
+		this->children.push_back(field.second);
+	}
+
+	return this;
+}
+
+std::string TableConstructorNode::number(ValueNumbering& numbering)
+{
+	log_calls("std::string TableConstructorNode::number(ValueNumbering& numbering)");
+
+	for (auto& field : fields)
+	{
+		if (field.first)
+			numbering.expression(field.first);
+		numbering.expression(field.second);
+	}
+
+	return "";
+}
+
+
+
+IndexNode::IndexNode() {}
+
+IndexNode::IndexNode(Expression* object, Expression* key) : Expression(Expression::Type::INDEX, true, "IndexNode", "")
+{
+	log_calls("IndexNode::IndexNode(Expression* object, Expression* key)");
+
+	this->children.push_back(object);
+	this->children.push_back(key);
+
+	this->object = object;
+	this->key = key;
+
+	if (key->type == Expression::Type::STRING)
+		key->evaluate(this->name);
+}
+
+IndexNode::~IndexNode() {}
+
+void IndexNode::assign(Expression* value)
+{
+	log_calls("void IndexNode::assign(Expression* value)");
+
+	Expression* objectValue = valueOf(object);
+
+	if (objectValue->type != Expression::Type::TABLE)
+		throw RuntimeError("attempt to index a " + objectValue->typeName() + " value");
+
+	static_cast<TableNode*>(objectValue)->set(valueOf(key), value);
+}
+
+Expression* IndexNode::execute()
+{
+	log_calls("Expression* IndexNode::execute()");
+
+	Expression* objectValue = valueOf(object);
+
+	if (objectValue->type != Expression::Type::TABLE)
+		throw RuntimeError("attempt to index a " + objectValue->typeName() + " value");
+
+	TableNode* table = static_cast<TableNode*>(objectValue);
+
+	if (key->type == Expression::Type::STRING)
+		return table->get(name);
+
+	return table->get(valueOf(key));
+}
+
+Expression* IndexNode::fold()
+{
+	log_calls("Expression* IndexNode::fold()");
+
+	object = object->fold();
+	key = key->fold();
+	this->children = { object, key };
+
+	if (key->type == Expression::Type::STRING)
+		key->evaluate(this->name);
+
+	return this;
+}
+
+std::string IndexNode::number(ValueNumbering& numbering)
+{
+	log_calls("std::string IndexNode::number(ValueNumbering& numbering)");
+
+	// Tables change under any store, so indexing is never a reusable value
+	numbering.expression(object);
+	numbering.expression(key);
+
+	return "";
+}
+
+
+
+FunctionNode::FunctionNode()
+{
+	this->memo = nullptr;
+	this->isOptimized = true;
+	this->source = nullptr;
+}
+
+FunctionNode::FunctionNode(Environment* environment, std::vector<std::string> parameters, Statement* block, std::string* source) : Expression(Expression::Type::FUNCTION, false, "FunctionNode", "")
+{
+	log_calls("FunctionNode::FunctionNode(Environment* environment, std::vector<std::string> parameters, Statement* block, std::string* source)");
+
+	for (auto parameter : parameters)
+		this->value += this->value.length() ? ", " + parameter : parameter;
+
+	if (block)
+		this->children.push_back(block);
+
+	this->environment = environment;
+	this->parameters = parameters;
+	this->block = block;
+	this->memo = nullptr;
+	this->isOptimized = true;
+	this->source = source;
+}
+
+FunctionNode::~FunctionNode() {}
+
+const std::vector<std::string>& FunctionNode::parameterList()
+{
+	return parameters;
+}
+
+Statement* FunctionNode::body()
+{
+	return block;
+}
+
+static void collectFrameNames(Node* node, std::set<std::string>& names)
+{
+	if (node->tag == "AssignmentNode" && node->value == "local")
+		names.insert(node->children[0]->value);
+	else if (node->tag == "MultipleAssignmentNode" && node->value == "local")
+	{
+		for (auto target : static_cast<MultipleAssignmentNode*>(node)->targetList())
+			names.insert(target->children[0]->value);
+	}
+	else if (node->tag == "ForNode")
+		names.insert(node->value);
+	else if (node->tag == "ForInNode")
+	{
+		const std::vector<std::string>& variables = static_cast<ForInNode*>(node)->nameList();
+		names.insert(variables.begin(), variables.end());
+	}
+
+	for (auto child : node->children)
+		if (child->tag != "FunctionNode") // Has a frame of its own
+			collectFrameNames(child, names);
+}
+
+// The names a call declares in its frame: the parameters, locals and loop variables
+void FunctionNode::frameNames(std::set<std::string>& names)
+{
+	names.insert(parameters.begin(), parameters.end());
+	if (block)
+		collectFrameNames(block, names);
+}
+
+Expression* FunctionNode::call(std::vector<Expression*>& arguments)
+{
+	log_calls("Expression* FunctionNode::call(std::vector<Expression*>& arguments)");
+
+	// A pure function gives what it gave before for the same arguments, and writes nothing
+	std::string key = "";
+	bool isMemoized = memo && MemoCache::key(arguments, key);
+	if (isMemoized)
+	{
+		Expression* cached = memo->find(key);
+		if (cached)
+			return cached;
+	}
+
+	if (block->tag == "LazyBlock" || !isOptimized)
+		compileBody();
+
+	int line = environment->line; // Restored on return only, an error keeps the line it happened on
+	const std::string* caller = environment->source;
+	if (source)
+		environment->source = source;
+
+	environment->epoch++;
+
+	environment->pushFrame();
+
+	for (long unsigned int i = 0; i < parameters.size(); i++)
+		environment->declare(parameters[i], i < arguments.size() ? arguments[i] : NilNode::instance());
+
+	Expression* result = block->execute();
+
+	if (environment->controlFlow != Environment::ControlFlow::RETURN || !result)
+		result = NilNode::instance();
+
+	environment->controlFlow = Environment::ControlFlow::NORMAL;
+	environment->popFrame();
+	environment->line = line;
+	environment->source = caller;
+	environment->epoch++; // The body may have computed the caller's temporaries for its own frame
+
+	if (isMemoized)
+		memo->insert(key, stored(result));
+
+	return result;
+}
+
+// Parses and optimizes a body left as source, or optimizes a restored one, as its own unit.
+// A syntax error leaves it unparsed
+void FunctionNode::compileBody()
+{
+	log_calls("void FunctionNode::compileBody()");
+
+	int line = 0;
+	if (block->tag == "LazyBlock")
+	{
+		LazyBlock* lazy = static_cast<LazyBlock*>(block);
+		block = lazy->parse(source);
+		this->children = { block };
+		line = lazy->line;
+	}
+	else if (!block->children.empty()) // Where the body starts, the function's own line is not kept
+		line = static_cast<Statement*>(block->children[0])->line;
+
+	isOptimized = true;
+	Optimizer(environment, 1).runBody(this, line);
+}
+
+Expression* FunctionNode::fold()
+{
+	log_calls("Expression* FunctionNode::fold()");
+
+	return this;
+}
+
+// Left out of fold, the Optimizer folds every body as a unit of its own
+void FunctionNode::foldBody()
+{
+	log_calls("void FunctionNode::foldBody()");
+
+	if (block)
+	{
+		block = block->fold();
+		this->children = { block };
+	}
+}
+
+std::string FunctionNode::number(ValueNumbering& numbering)
+{
+	log_calls("std::string FunctionNode::number(ValueNumbering& numbering)");
+
+	if (block && block->tag != "LazyBlock") // Numbered once parsed
+		numbering.function(this);
+
+	return "";
+}
+
+
+
+BuiltinFunctionNode::BuiltinFunctionNode() {}
+
+BuiltinFunctionNode::BuiltinFunctionNode(Environment* environment, std::string name, BuiltinFunctionNode::Function function) : FunctionNode(environment, {}, nullptr)
+{
+	log_calls("BuiltinFunctionNode::BuiltinFunctionNode(Environment* environment, std::string name, BuiltinFunctionNode::Function function)");
+
+	this->tag = "BuiltinFunctionNode";
+	this->value = name;
+	this->function = function;
+}
+
+BuiltinFunctionNode::~BuiltinFunctionNode() {}
+
+Expression* BuiltinFunctionNode::call(std::vector<Expression*>& arguments)
+{
+	if (debug_calls)
+		log_calls(("Expression* BuiltinFunctionNode::call(std::vector<Expression*>& arguments)\t = " + value).c_str());
+
+	return function(environment, arguments);
+}
+
+
+
+CallNode::CallNode()
+{
+	this->environment = nullptr;
+	this->inlined = nullptr;
+	this->inlinedBody = nullptr;
+	this->inlinedLine = 0;
+}
+
+CallNode::CallNode(Expression* function, std::vector<Expression*> arguments) : Expression(Expression::Type::CALL, true, "CallNode", "")
+{
+	log_calls("CallNode::CallNode(Expression* function, std::vector<Expression*> arguments)");
+
+	this->children.push_back(function);
+	for (auto argument : arguments)
+		this->children.push_back(argument);
+
+	this->function = function;
+	this->arguments = arguments;
+	this->environment = nullptr;
+	this->inlined = nullptr;
+	this->inlinedBody = nullptr;
+	this->inlinedLine = 0;
+}
+
+CallNode::CallNode(Expression* object, std::string method, std::vector<Expression*> arguments) : Expression(Expression::Type::CALL, true, "CallNode", method)
+{
+	log_calls("CallNode::CallNode(Expression* object, std::string method, std::vector<Expression*> arguments)");
+
+	this->children.push_back(object);
+	for (auto argument : arguments)
+		this->children.push_back(argument);
+
+	this->function = object;
+	this->method = method;
+	this->arguments = arguments;
+	this->environment = nullptr;
+	this->inlined = nullptr;
+	this->inlinedBody = nullptr;
+	this->inlinedLine = 0;
+}
+
+CallNode::~CallNode() {}
+
+Expression* CallNode::call(Expression* function, std::vector<Expression*>& arguments)
+{
+	if (function->type == Expression::Type::FUNCTION)
+		return static_cast<FunctionNode*>(function)->call(arguments);
+
+	Expression* handler = TableNode::metamethod(function, TableNode::Metamethod::CALL);
+	if (handler)
+	{
+		arguments.insert(arguments.begin(), function);
+		return call(handler, arguments);
+	}
+
+	throw RuntimeError("attempt to call a " + function->typeName() + " value");
+}
+
+void CallNode::inlineBody(Environment* environment, FunctionNode* callee, Expression* body, std::vector<ArgumentNode*> parameters, int line)
+{
+	log_calls("void CallNode::inlineBody(Environment* environment, FunctionNode* callee, Expression* body, std::vector<ArgumentNode*> parameters, int line)");
+
+	this->environment = environment;
+	this->inlined = callee;
+	this->inlinedBody = body;
+	this->inlinedParameters = parameters;
+	this->inlinedLine = line;
+}
+
+// Moves the line the inlined body reports errors on, when lines are added or removed above it
+void CallNode::shiftLines(int after, int delta)
+{
+	log_calls("void CallNode::shiftLines(int after, int delta)");
+
+	if (inlinedLine > after)
+		inlinedLine += delta;
+}
+
+Expression* CallNode::execute()
+{
+	log_calls("Expression* CallNode::execute()");
+
+	return run(nullptr);
+}
+
+Expression* CallNode::evaluateNumber(Number& number)
+{
+	log_calls("Expression* CallNode::evaluateNumber(Number& number)");
+
+	return run(&number);
+}
+
+// Makes the call. With number set, a first result that is a number goes there and nullptr is
+// returned, as from evaluateNumber
+Expression* CallNode::run(Number* number)
+{
+	std::vector<Expression*> values;
+	Expression* callee = nullptr;
+
+	if (method.empty())
+		callee = valueOf(function);
+	else
+	{
+		Expression* object = valueOf(function);
+		if (object->type != Expression::Type::TABLE)
+			throw RuntimeError("attempt to index a " + object->typeName() + " value");
+
+		callee = static_cast<TableNode*>(object)->get(method);
+		values.push_back(object);
+	}
+
+	if (inlined && callee == inlined)
+		return executeInlined(number);
+
+	valuesOf(arguments, values);
+	Expression* result = call(callee, values);
+
+	if (!number)
+		return result;
+
+	result = valueOf(result);
+	return numberFrom(result, *number) ? nullptr : result;
+}
+
+// Runs the copy of the callee's body as the call would, without a frame: the body only reads
+// parameters, globals the caller does not shadow, and literals
+Expression* CallNode::executeInlined(Number* number)
+{
+	log_calls("Expression* CallNode::executeInlined(Number* number)");
+
+	// The arguments as valuesOf gives them, kept here since computing one may run this call again
+	Expression* values[CallNode::maxInlinedParameters];
+	long unsigned int count = inlinedParameters.size();
+	for (long unsigned int i = 0; i < count; i++)
+		values[i] = NilNode::instance();
+
+	for (long unsigned int i = 0; i < arguments.size(); i++)
+	{
+		if (i + 1 < arguments.size() || arguments[i]->type != Expression::Type::CALL)
+		{
+			Expression* value = valueOf(arguments[i]);
+			if (i < count)
+				values[i] = value;
+			continue;
+		}
+
+		Expression* result = arguments[i]->execute(); // The last argument, a call, gives all its results
+		if (result && result->type == Expression::Type::VALUELIST)
+		{
+			std::vector<Expression*>& results = static_cast<ValueListNode*>(result)->values;
+			for (long unsigned int j = 0; i + j < count && j < results.size(); j++)
+				values[i + j] = results[j];
+		}
+		else if (result && i < count)
+			values[i] = result;
+	}
+
+	// Bound over the arguments of a run this one interrupted, a metamethod in the body may call
+	// here again, and those are put back after
+	for (long unsigned int i = 0; i < count; i++)
+		std::swap(values[i], inlinedParameters[i]->argument);
+
+	int line = environment->line;
+	const std::string* caller = environment->source;
+	environment->line = inlinedLine;
+	if (inlined->source)
+		environment->source = inlined->source;
+
+	Expression* result = nullptr;
+	try
+	{
+		result = number ? inlinedBody->evaluateNumber(*number) : valueOf(inlinedBody);
+	}
+	catch (RuntimeError& error)
+	{
+		for (long unsigned int i = count; i-- > 0; )
+			inlinedParameters[i]->argument = values[i];
+		throw;
+	}
+
+	for (long unsigned int i = count; i-- > 0; )
+		inlinedParameters[i]->argument = values[i];
+
+	environment->line = line;
+	environment->source = caller;
+
+	return result;
+}
+
+Expression* CallNode::fold()
+{
+	log_calls("Expression* CallNode::fold()");
+
+	function = function->fold();
+	foldAll(arguments);
+
+	this->children = { function };
+	this->children.insert(this->children.end(), arguments.begin(), arguments.end());
+
+	return this;
+}
+
+std::string CallNode::number(ValueNumbering& numbering)
+{
+	log_calls("std::string CallNode::number(ValueNumbering& numbering)");
+
+	numbering.expression(function);
+	for (auto& argument : arguments)
+		numbering.expression(argument);
+
+	return "";
+}
+
+
+
+BinaryOperationNode::BinaryOperationNode() {}
+
+BinaryOperationNode::BinaryOperationNode(Expression* left, Expression* right, BinaryOperationNode::Operation operation) : Expression(Expression::Type::BINARYOPERATION, true, "BinaryOperationNode", "")
+{
+	log_calls("BinaryOperationNode::BinaryOperationNode(Expression* left, Expression* right, BinaryOperationNode::Operation operation)");
+
+	this->children.push_back(left);
+	this->children.push_back(right);
+
+	this->left = left;
+	this->right = right;
+	this->operation = operation;
+	this->isComparison = false;
+	this->isIntegerPower = false;
+	this->exponent = 0;
+
+	switch(this->operation)
+	{
+		case BinaryOperationNode::Operation::EQUALS:
+			this->value = "'=='";
+			this->isComparison = true;
+			break;
+		case BinaryOperationNode::Operation::NOT_EQUALS:
+			this->value = "'!='";
+			this->isComparison = true;
+			break;
+		case BinaryOperationNode::Operation::PLUS:
+			this->value = "'+'";
+			break;
+		case BinaryOperationNode::Operation::MINUS:
+			this->value = "'-'";
+			break;
+		case BinaryOperationNode::Operation::MULTIPLICATION:
+			this->value = "'*'";
+			break;
+		case BinaryOperationNode::Operation::DIVISION:
+			this->value = "'/'";
+			break;
+		case BinaryOperationNode::Operation::POWER_OF:
+			this->value = "'^'";
+			break;
+		case BinaryOperationNode::Operation::LESS:
+			this->value = "'<'";
+			this->isComparison = true;
+			break;
+		case BinaryOperationNode::Operation::MORE:
+			this->value = "'>'";
+			this->isComparison = true;
+			break;
+		case BinaryOperationNode::Operation::LESS_OR_EQUAL:
+			this->value = "'<='";
+			this->isComparison = true;
+			break;
+		case BinaryOperationNode::Operation::MORE_OR_EQUAL:
+			this->value = "'>='";
+			this->isComparison = true;
+			break;
+	}
+}
+
+BinaryOperationNode::~BinaryOperationNode() {}
+
+void BinaryOperationNode::evaluate(bool& returnValue)
+{
+	log_evaluations("void BinaryOperationNode::evaluate(bool& returnValue)");
+
+	// A comparison used as a condition branches on its result directly, without a BooleanNode
+	if (isComparison)
+		returnValue = compareOperands();
+	else
+		Expression::evaluate(returnValue);
+}
+
+Expression* BinaryOperationNode::execute()
+{
+	log_calls("Expression* BinaryOperationNode::execute()");
+
+	if (isComparison)
+		return new BooleanNode(compareOperands());
+
+	// Only the final result gets a node, the intermediate ones of nested arithmetic stay numbers
+	Number number;
+	Expression* value = evaluateNumber(number);
+
+	return value ? value : boxed(number);
+}
+
+Expression* BinaryOperationNode::evaluateNumber(Number& number)
+{
+	log_calls("Expression* BinaryOperationNode::evaluateNumber(Number& number)");
+
+	if (isComparison)
+		return Expression::evaluateNumber(number);
+
+	// Operands are evaluated into locals so the node can be executed again
+	Number leftNumber, rightNumber;
+	Expression* leftValue = left->evaluateNumber(leftNumber);
+	Expression* rightValue = right->evaluateNumber(rightNumber);
+
+	if (!leftValue && !rightValue)
+	{
+		arithmetic(leftNumber, rightNumber, number);
+		return nullptr;
+	}
+
+	// Strings, tables and errors take the general path
+	if (!leftValue)
+		leftValue = boxed(leftNumber);
+	if (!rightValue)
+		rightValue = boxed(rightNumber);
+
+	Expression* value = operate(leftValue, rightValue);
+	if (value->type == Expression::Type::VALUELIST) // From a metamethod
+		return valueOf(value);
+
+	return value;
+}
+
+// Mirrors the operators of IntegerNode and FloatNode
+void BinaryOperationNode::arithmetic(const Number& leftNumber, const Number& rightNumber, Number& result)
+{
+	result.isInteger = leftNumber.isInteger && rightNumber.isInteger;
+
+	switch(this->operation)
+	{
+		case BinaryOperationNode::Operation::PLUS:
+			if (result.isInteger)
+				result.integer = wrappedSum(leftNumber.integer, rightNumber.integer);
+			else
+				result.real = realOf(leftNumber) + realOf(rightNumber);
+			return;
+		case BinaryOperationNode::Operation::MINUS:
+			if (result.isInteger)
+				result.integer = wrappedDifference(leftNumber.integer, rightNumber.integer);
+			else
+				result.real = realOf(leftNumber) - realOf(rightNumber);
+			return;
+		case BinaryOperationNode::Operation::MULTIPLICATION:
+			if (result.isInteger)
+				result.integer = wrappedProduct(leftNumber.integer, rightNumber.integer);
+			else
+				result.real = realOf(leftNumber) * realOf(rightNumber);
+			return;
+		case BinaryOperationNode::Operation::DIVISION:
+			if (leftNumber.isInteger && realOf(rightNumber) == 0.0)
+				throw RuntimeError("attempt to divide by zero");
+			result.isInteger = false;
+			result.real = realOf(leftNumber) / realOf(rightNumber);
+			return;
+		case BinaryOperationNode::Operation::POWER_OF:
+			result.isInteger = false;
+			if (isIntegerPower)
+				result.real = powerOf(realOf(leftNumber), exponent);
+			else if (rightNumber.isInteger)
+				result.real = powerOf(realOf(leftNumber), rightNumber.integer);
+			else
+				result.real = std::pow(realOf(leftNumber), rightNumber.real);
+			return;
+		case BinaryOperationNode::Operation::EQUALS:
+		case BinaryOperationNode::Operation::NOT_EQUALS:
+		case BinaryOperationNode::Operation::LESS:
+		case BinaryOperationNode::Operation::MORE:
+		case BinaryOperationNode::Operation::LESS_OR_EQUAL:
+		case BinaryOperationNode::Operation::MORE_OR_EQUAL:
+			return;
+	}
+}
+
+Expression* BinaryOperationNode::operate(Expression* leftValue, Expression* rightValue)
+{
+	log_calls("Expression* BinaryOperationNode::operate(Expression* leftValue, Expression* rightValue)");
+
+	if (leftValue->type == Expression::Type::TABLE || rightValue->type == Expression::Type::TABLE)
+		return executeMetamethod(leftValue, rightValue);
+
+	switch(this->operation)
+	{
+		case BinaryOperationNode::Operation::PLUS:
+			return *leftValue + rightValue;
+		case BinaryOperationNode::Operation::MINUS:
+			return *leftValue - rightValue;
+		case BinaryOperationNode::Operation::MULTIPLICATION:
+			return *leftValue * rightValue;
+		case BinaryOperationNode::Operation::DIVISION:
+			return *leftValue / rightValue;
+		case BinaryOperationNode::Operation::POWER_OF:
+		{
+			float base = 0.0;
+			if (isIntegerPower && numberOf(leftValue, base))
+				return new FloatNode(powerOf(base, exponent));
+			return *leftValue ^ rightValue;
+		}
+		case BinaryOperationNode::Operation::EQUALS:
+		case BinaryOperationNode::Operation::NOT_EQUALS:
+		case BinaryOperationNode::Operation::LESS:
+		case BinaryOperationNode::Operation::MORE:
+		case BinaryOperationNode::Operation::LESS_OR_EQUAL:
+		case BinaryOperationNode::Operation::MORE_OR_EQUAL:
+			break;
+	}
+
+	return nullptr;
+}
+
+// Compares numeric operands as numbers, without nodes for them
+bool BinaryOperationNode::compareOperands()
+{
+	Number leftNumber, rightNumber;
+	Expression* leftValue = left->evaluateNumber(leftNumber);
+	Expression* rightValue = right->evaluateNumber(rightNumber);
+
+	if (leftValue || rightValue)
+		return compare(leftValue ? leftValue : boxed(leftNumber), rightValue ? rightValue : boxed(rightNumber));
+
+	bool isInteger = leftNumber.isInteger && rightNumber.isInteger;
+	float leftReal = realOf(leftNumber), rightReal = realOf(rightNumber);
+
+	switch(this->operation)
+	{
+		case BinaryOperationNode::Operation::EQUALS:
+			return isInteger ? leftNumber.integer == rightNumber.integer : leftReal == rightReal;
+		case BinaryOperationNode::Operation::NOT_EQUALS:
+			return isInteger ? leftNumber.integer != rightNumber.integer : leftReal != rightReal;
+		case BinaryOperationNode::Operation::LESS:
+			return isInteger ? leftNumber.integer < rightNumber.integer : leftReal < rightReal;
+		case BinaryOperationNode::Operation::MORE:
+			return isInteger ? leftNumber.integer > rightNumber.integer : leftReal > rightReal;
+		case BinaryOperationNode::Operation::LESS_OR_EQUAL:
+			return isInteger ? leftNumber.integer <= rightNumber.integer : leftReal <= rightReal;
+		case BinaryOperationNode::Operation::MORE_OR_EQUAL:
+			return isInteger ? leftNumber.integer >= rightNumber.integer : leftReal >= rightReal;
+		case BinaryOperationNode::Operation::PLUS:
+		case BinaryOperationNode::Operation::MINUS:
+		case BinaryOperationNode::Operation::MULTIPLICATION:
+		case BinaryOperationNode::Operation::DIVISION:
+		case BinaryOperationNode::Operation::POWER_OF:
+			break;
+	}
+
+	return false;
+}
+
+Expression* BinaryOperationNode::fold()
+{
+	log_calls("Expression* BinaryOperationNode::fold()");
+
+	left = left->fold();
+	right = right->fold();
+	this->children = { left, right };
+
+	if (isConstant(left) && isConstant(right))
+	{
+		try
+		{
+			return execute();
+		}
+		catch (RuntimeError& error) {} // Left for the statement to raise, with its line
+	}
+
+	// x ^ 2 multiplies instead of calling std::pow
+	if (operation == BinaryOperationNode::Operation::POWER_OF && right->type == Expression::Type::INTEGER)
+	{
+		right->evaluate(exponent);
+		isIntegerPower = true;
+	}
+
+	return this;
+}
+
+std::string BinaryOperationNode::number(ValueNumbering& numbering)
+{
+	log_calls("std::string BinaryOperationNode::number(ValueNumbering& numbering)");
+
+	static const char* symbols[] = { "==", "~=", "+", "-", "*", "/", "^", "<", ">", "<=", ">=" };
+
+	std::string leftKey = numbering.expression(left);
+	std::string rightKey = numbering.expression(right);
+
+	if (leftKey.empty() || rightKey.empty())
+		return "";
+
+	// Tables compare raw without calling anything, until a metatable write the pass does not see
+	// gives them __eq. A literal on either side never calls it
+	if ((operation == BinaryOperationNode::Operation::EQUALS || operation == BinaryOperationNode::Operation::NOT_EQUALS) && !isConstant(left) && !isConstant(right))
+		return "";
+
+	return "(" + std::string(symbols[operation]) + " " + leftKey + " " + rightKey + ")";
+}
+
+Expression* BinaryOperationNode::executeMetamethod(Expression* leftValue, Expression* rightValue)
+{
+	log_calls("Expression* BinaryOperationNode::executeMetamethod(Expression* leftValue, Expression* rightValue)");
+
+	TableNode::Metamethod event = TableNode::Metamethod::ADD;
+
+	switch(this->operation)
+	{
+		case BinaryOperationNode::Operation::PLUS:
+			event = TableNode::Metamethod::ADD;
+			break;
+		case BinaryOperationNode::Operation::MINUS:
+			event = TableNode::Metamethod::SUB;
+			break;
+		case BinaryOperationNode::Operation::MULTIPLICATION:
+			event = TableNode::Metamethod::MUL;
+			break;
+		case BinaryOperationNode::Operation::DIVISION:
+			event = TableNode::Metamethod::DIV;
+			break;
+		case BinaryOperationNode::Operation::POWER_OF:
+			event = TableNode::Metamethod::POW;
+			break;
+		case BinaryOperationNode::Operation::EQUALS: // Comparisons go through compare()
+		case BinaryOperationNode::Operation::NOT_EQUALS:
+		case BinaryOperationNode::Operation::LESS:
+		case BinaryOperationNode::Operation::MORE:
+		case BinaryOperationNode::Operation::LESS_OR_EQUAL:
+		case BinaryOperationNode::Operation::MORE_OR_EQUAL:
+			return nullptr;
+	}
+
+	// The left operand's handler wins, as in Lua
+	Expression* handler = TableNode::metamethod(leftValue, event);
+	if (!handler)
+		handler = TableNode::metamethod(rightValue, event);
+
+	if (!handler)
+		throw RuntimeError("attempt to perform arithmetic on a table value");
+
+	std::vector<Expression*> arguments = { leftValue, rightValue };
+	return CallNode::call(handler, arguments);
+}
+
+bool BinaryOperationNode::compare(Expression* leftValue, Expression* rightValue)
+{
+	log_calls("bool BinaryOperationNode::compare(Expression* leftValue, Expression* rightValue)");
+
+	// a > b and a >= b are b < a and b <= a, as in Lua
+	switch(this->operation)
+	{
+		case BinaryOperationNode::Operation::EQUALS:
+			return isEqual(leftValue, rightValue);
+		case BinaryOperationNode::Operation::NOT_EQUALS:
+			return !isEqual(leftValue, rightValue);
+		case BinaryOperationNode::Operation::LESS:
+			return isLess(leftValue, rightValue, false);
+		case BinaryOperationNode::Operation::MORE:
+			return isLess(rightValue, leftValue, false);
+		case BinaryOperationNode::Operation::LESS_OR_EQUAL:
+			return isLess(leftValue, rightValue, true);
+		case BinaryOperationNode::Operation::MORE_OR_EQUAL:
+			return isLess(rightValue, leftValue, true);
+		case BinaryOperationNode::Operation::PLUS:
+		case BinaryOperationNode::Operation::MINUS:
+		case BinaryOperationNode::Operation::MULTIPLICATION:
+		case BinaryOperationNode::Operation::DIVISION:
+		case BinaryOperationNode::Operation::POWER_OF:
+			break;
+	}
+
+	return false;
+}
+
+bool BinaryOperationNode::isEqual(Expression* leftValue, Expression* rightValue)
+{
+	log_calls("bool BinaryOperationNode::isEqual(Expression* leftValue, Expression* rightValue)");
+
+	if (leftValue == rightValue)
+		return true;
+
+	Expression::Type lType = leftValue->type;
+	Expression::Type rType = rightValue->type;
+
+	if (lType == Expression::Type::INTEGER && rType == Expression::Type::INTEGER)
+	{
+		int lValue = 0, rValue = 0;
+		leftValue->evaluate(lValue);
+		rightValue->evaluate(rValue);
+		return lValue == rValue;
+	}
+
+	float lNumber = 0.0, rNumber = 0.0;
+	if (numberOf(leftValue, lNumber) && numberOf(rightValue, rNumber))
+		return lNumber == rNumber;
+
+	if (lType != rType) // Values of different types are never equal
+		return false;
+
+	switch (lType)
+	{
+		case Expression::Type::STRING:
+		{
+			std::string lValue = "", rValue = "";
+			leftValue->evaluate(lValue);
+			rightValue->evaluate(rValue);
+			return lValue == rValue;
+		}
+		case Expression::Type::BOOLEAN:
+			return isTruthy(leftValue) == isTruthy(rightValue);
+		case Expression::Type::TABLE:
+			break;
+		default: // Nil and functions compare by identity
+			return false;
+	}
+
+	Expression* handler = TableNode::metamethod(leftValue, TableNode::Metamethod::EQ);
+	if (!handler)
+		handler = TableNode::metamethod(rightValue, TableNode::Metamethod::EQ);
+
+	if (!handler)
+		return false;
+
+	std::vector<Expression*> arguments = { leftValue, rightValue };
+	return isTruthy(valueOf(CallNode::call(handler, arguments)));
+}
+
+bool BinaryOperationNode::isLess(Expression* leftValue, Expression* rightValue, bool orEqual)
+{
+	log_calls("bool BinaryOperationNode::isLess(Expression* leftValue, Expression* rightValue, bool orEqual)");
+
+	Expression::Type lType = leftValue->type;
+	Expression::Type rType = rightValue->type;
+
+	if (lType == Expression::Type::INTEGER && rType == Expression::Type::INTEGER)
+	{
+		int lValue = 0, rValue = 0;
+		leftValue->evaluate(lValue);
+		rightValue->evaluate(rValue);
+		return orEqual ? lValue <= rValue : lValue < rValue;
+	}
+
+	float lNumber = 0.0, rNumber = 0.0;
+	if (numberOf(leftValue, lNumber) && numberOf(rightValue, rNumber))
+		return orEqual ? lNumber <= rNumber : lNumber < rNumber;
+
+	if (lType == Expression::Type::STRING && rType == Expression::Type::STRING)
+	{
+		std::string lValue = "", rValue = "";
+		leftValue->evaluate(lValue);
+		rightValue->evaluate(rValue);
+		return orEqual ? lValue <= rValue : lValue < rValue;
+	}
+
+	TableNode::Metamethod event = orEqual ? TableNode::Metamethod::LE : TableNode::Metamethod::LT;
+	Expression* handler = TableNode::metamethod(leftValue, event);
+	if (!handler)
+		handler = TableNode::metamethod(rightValue, event);
+
+	if (!handler)
+	{
+		if (leftValue->typeName() == rightValue->typeName())
+			throw RuntimeError("attempt to compare two " + leftValue->typeName() + " values");
+		throw RuntimeError("attempt to compare " + leftValue->typeName() + " with " + rightValue->typeName());
+	}
+
+	std::vector<Expression*> arguments = { leftValue, rightValue };
+	return isTruthy(valueOf(CallNode::call(handler, arguments)));
+}
+
+
+
+LogicalOperationNode::LogicalOperationNode() {}
+
+LogicalOperationNode::LogicalOperationNode(Expression* left, Expression* right, LogicalOperationNode::Operation operation) : Expression(Expression::Type::LOGICALOPERATION, true, "LogicalOperationNode", "")
+{
+	log_calls("LogicalOperationNode::LogicalOperationNode(Expression* left, Expression* right, LogicalOperationNode::Operation operation)");
+
+	this->children.push_back(left);
+	this->children.push_back(right);
+
+	this->left = left;
+	this->right = right;
+	this->operation = operation;
+
+	if (operation == LogicalOperationNode::Operation::AND)
+		this->value = "and";
+	else
+		this->value = "or";
+}
+
+LogicalOperationNode::~LogicalOperationNode() {}
+
+void LogicalOperationNode::evaluate(bool& returnValue)
+{
+	log_evaluations("void LogicalOperationNode::evaluate(bool& returnValue)");
+
+	left->evaluate(returnValue);
+
+	// The right operand only decides when the left one didn't
+	if (returnValue == (operation == LogicalOperationNode::Operation::AND))
+		right->evaluate(returnValue);
+}
+
+Expression* LogicalOperationNode::execute()
+{
+	log_calls("Expression* LogicalOperationNode::execute()");
+
+	// Like Lua, the result is one of the operands rather than a boolean
+	Expression* leftValue = valueOf(left);
+
+	if (isTruthy(leftValue) == (operation == LogicalOperationNode::Operation::AND))
+		return valueOf(right);
+
+	return leftValue;
+}
+
+Expression* LogicalOperationNode::fold()
+{
+	log_calls("Expression* LogicalOperationNode::fold()");
+
+	left = left->fold();
+	right = right->fold();
+	this->children = { left, right };
+
+	if (!isConstant(left))
+		return this;
+
+	if (isTruthy(left) != (operation == LogicalOperationNode::Operation::AND))
+		return left;
+
+	if (right->type == Expression::Type::CALL) // Only the call's first result is the operand
+		return new ParenthesisNode(right);
+
+	return right;
+}
+
+std::string LogicalOperationNode::number(ValueNumbering& numbering)
+{
+	log_calls("std::string LogicalOperationNode::number(ValueNumbering& numbering)");
+
+	std::string leftKey = numbering.expression(left);
+
+	// The right operand does not always run, what it computes is not available after it
+	numbering.pushScope();
+	std::string rightKey = numbering.expression(right);
+	numbering.popScope();
+
+	if (leftKey.empty() || rightKey.empty())
+		return "";
+
+	return "(" + value + " " + leftKey + " " + rightKey + ")";
+}
+
+
+
+UnaryOperationNode::UnaryOperationNode() {}
+
+UnaryOperationNode::UnaryOperationNode(Expression* expression, UnaryOperationNode::Operation operation) : Expression(Expression::Type::UNARYOPERATION, true, "UnaryOperationNode", "not")
+{
+	log_calls("UnaryOperationNode::UnaryOperationNode(Expression* expression, UnaryOperationNode::Operation operation)");
+
+	this->children.push_back(expression);
+
+	this->expression = expression;
+	this->operation = operation;
+
+	if (operation == UnaryOperationNode::Operation::LENGTH)
+		this->value = "#";
+}
+
+UnaryOperationNode::~UnaryOperationNode() {}
+
+void UnaryOperationNode::evaluate(bool& returnValue)
+{
+	log_evaluations("void UnaryOperationNode::evaluate(bool& returnValue)");
+
+	if (operation == UnaryOperationNode::Operation::LENGTH) // A number, always true
+	{
+		Expression::evaluate(returnValue);
+		return;
+	}
+
+	expression->evaluate(returnValue);
+	returnValue = !returnValue;
+}
+
+Expression* UnaryOperationNode::execute()
+{
+	log_calls("Expression* UnaryOperationNode::execute()");
+
+	if (operation == UnaryOperationNode::Operation::LENGTH)
+		return length(valueOf(expression));
+
+	bool truth = false;
+	expression->evaluate(truth);
+
+	return new BooleanNode(!truth);
+}
+
+Expression* UnaryOperationNode::length(Expression* value)
+{
+	if (value->type == Expression::Type::TABLE)
+		return new IntegerNode(static_cast<TableNode*>(value)->length());
+
+	if (value->type == Expression::Type::STRING)
+	{
+		std::string text = "";
+		value->evaluate(text);
+		return new IntegerNode((int)text.size());
+	}
+
+	throw RuntimeError("attempt to get length of a " + value->typeName() + " value");
+}
+
+Expression* UnaryOperationNode::fold()
+{
+	log_calls("Expression* UnaryOperationNode::fold()");
+
+	expression = expression->fold();
+	this->children = { expression };
+
+	if (operation == UnaryOperationNode::Operation::LENGTH)
+	{
+		if (expression->type == Expression::Type::STRING)
+			return length(expression);
+		return this;
+	}
+
+	if (isConstant(expression))
+		return new BooleanNode(!isTruthy(expression));
+
+	return this;
+}
+
+std::string UnaryOperationNode::number(ValueNumbering& numbering)
+{
+	log_calls("std::string UnaryOperationNode::number(ValueNumbering& numbering)");
+
+	std::string key = numbering.expression(expression);
+
+	// A table's length changes with stores into it, which assign no variable
+	if (key.empty() || operation == UnaryOperationNode::Operation::LENGTH)
+		return "";
+
+	return "(not " + key + ")";
+}
+
+
+
+ParenthesisNode::ParenthesisNode() {}
+
+ParenthesisNode::ParenthesisNode(Expression* expression) : Expression(Expression::Type::PARENTHESIS, true, "ParenthesisNode", "")
+{
+	log_calls("ParenthesisNode::ParenthesisNode(Expression* expression)");
+	this->children.push_back(expression);
+
+	this->expression = expression;
+}
+
+ParenthesisNode::~ParenthesisNode() {}
+
+Expression* ParenthesisNode::operator == (Expression* obj)
+{
+	log_calls("Expression* ParenthesisNode::operator == (Expression* obj)");
+	return *valueOf(this->expression) == obj;
+}
+
+Expression* ParenthesisNode::operator != (Expression* obj)
+{
+	log_calls("Expression* ParenthesisNode::operator != (Expression* obj)");
+	return *valueOf(this->expression) != obj;
+}
+
+Expression* ParenthesisNode::operator + (Expression* obj)
+{
+	log_calls("Expression* ParenthesisNode::operator + (Expression* obj)");
+	return *valueOf(this->expression) + obj;
+}
+
+Expression* ParenthesisNode::operator - (Expression* obj)
+{
+	log_calls("Expression* ParenthesisNode::operator - (Expression* obj)");
+	return *valueOf(this->expression) - obj;
+}
+
+Expression* ParenthesisNode::operator * (Expression* obj)
+{
+	log_calls("Expression* ParenthesisNode::operator * (Expression* obj)");
+	return *valueOf(this->expression) * obj;
+}
+
+Expression* ParenthesisNode::operator / (Expression* obj)
+{
+	log_calls("Expression* ParenthesisNode::operator / (Expression* obj)");
+	return *valueOf(this->expression) / obj;
+}
+
+Expression* ParenthesisNode::operator ^ (Expression* obj)
+{
+	log_calls("Expression* ParenthesisNode::operator ^ (Expression* obj)");
+	return *valueOf(this->expression) ^ obj;
+}
+
+void ParenthesisNode::evaluate(Expression*& returnValue)
+{
+	log_evaluations("ParenthesisNode::evaluate(Expression*& returnValue)");
+
+	returnValue = valueOf(this->expression);
+}
+
+void ParenthesisNode::evaluate(bool& returnValue)
+{
+	log_evaluations("ParenthesisNode::evaluate(Expression*& returnValue)");
+
+	this->expression->evaluate(returnValue);
+}
+
+Expression* ParenthesisNode::getExpression()
+{
+	return this->expression;
+}
+
+Expression* ParenthesisNode::execute()
+{
+	log_calls("Expression* ParenthesisNode::execute()");
+
+	if (this->expression->isExecutable)
+		return this->expression->execute();
+
+	return this->expression;
+}
+
+Expression* ParenthesisNode::fold()
+{
+	log_calls("Expression* ParenthesisNode::fold()");
+
+	expression = expression->fold();
+	this->children = { expression };
+
+	// Parentheses only matter when they truncate the results of a call
+	if (expression->type == Expression::Type::CALL)
+		return this;
+
+	return expression;
+}
+
+std::string ParenthesisNode::number(ValueNumbering& numbering)
+{
+	log_calls("std::string ParenthesisNode::number(ValueNumbering& numbering)");
+
+	numbering.expression(expression); // A call, after folding
+	return "";
+}
+
+
+
+TemporaryNode::TemporaryNode() {}
+
+TemporaryNode::TemporaryNode(Environment* environment, Expression* expression, TemporaryNode* source) : Expression(Expression::Type::TEMPORARY, true, "TemporaryNode", "")
+{
+	log_calls("TemporaryNode::TemporaryNode(Environment* environment, Expression* expression, TemporaryNode* source)");
+
+	this->children.push_back(expression);
+
+	this->environment = environment;
+	this->expression = expression;
+	this->source = source ? source : this;
+	this->loopEntries = nullptr;
+	this->entry = 0;
+	this->epoch = 0;
+	this->isValid = false;
+	this->result = nullptr;
+
+	if (source)
+		this->value = source->value;
+}
+
+TemporaryNode::~TemporaryNode() {}
+
+void TemporaryNode::hoist(const unsigned long long* loopEntries)
+{
+	this->loopEntries = loopEntries;
+}
+
+Expression* TemporaryNode::execute()
+{
+	log_calls("Expression* TemporaryNode::execute()");
+
+	// The pass saw every assignment in between, a call is the only way a variable changed unseen
+	if (source != this)
+	{
+		if (source->isValid && source->epoch == environment->epoch)
+			return source->result;
+		return valueOf(expression);
+	}
+
+	if (loopEntries && isValid && epoch == environment->epoch && entry == *loopEntries)
+		return result;
+
+	unsigned long long calls = environment->epoch;
+	isValid = false;
+	result = valueOf(expression);
+
+	isValid = environment->epoch == calls; // A metamethod ran, skipping it would skip its effects
+	epoch = calls;
+	entry = loopEntries ? *loopEntries : 0;
+
+	return result;
+}
+
+
+
+ArgumentNode::ArgumentNode() {}
+
+ArgumentNode::ArgumentNode(std::string name) : Expression(Expression::Type::ARGUMENT, true, "ArgumentNode", name)
+{
+	log_calls("ArgumentNode::ArgumentNode(std::string name)");
+
+	this->argument = nullptr;
+}
+
+ArgumentNode::~ArgumentNode() {}
+
+Expression* ArgumentNode::execute()
+{
+	log_calls("Expression* ArgumentNode::execute()");
+
+	return argument;
+}
+
+
+
+CallStatementNode::CallStatementNode() : Statement("CallStatementNode", "") {}
+
+CallStatementNode::CallStatementNode(Expression* call) : Statement("CallStatementNode", "")
+{
+	log_calls("CallStatementNode::CallStatementNode(Expression* call)");
+
+	this->children.push_back(call);
+	this->call = call;
+}
+
+CallStatementNode::~CallStatementNode() {}
+
+Expression* CallStatementNode::execute()
+{
+	log_calls("Expression* CallStatementNode::execute()");
+
+	call->execute();
+	return nullptr;
+}
+
+Statement* CallStatementNode::fold()
+{
+	log_calls("Statement* CallStatementNode::fold()");
+
+	call = call->fold();
+	this->children = { call };
+
+	return this;
+}
+
+void CallStatementNode::number(ValueNumbering& numbering)
+{
+	log_calls("void CallStatementNode::number(ValueNumbering& numbering)");
+
+	numbering.expression(call);
+}
+
+
+
+PrintNode::PrintNode() {}
+
+PrintNode::PrintNode(Environment* environment, std::vector<Expression*>  expressions) : Statement("PrintNode", "")
+{
+	this->children.assign(expressions.begin(), expressions.end());
+
+	this->environment = environment;
+	this->expressions = std::move(expressions);
+}
+
+PrintNode::~PrintNode() {}
+
+// Written straight to the environment's output, numbers without a string in between
+Expression* PrintNode::execute()
+{
+	Output& output = environment->output;
+
+	std::vector<Expression*> values;
+	valuesOf(this->expressions, values);
+
+	for (auto expression : values)
+	{
+		switch (expression->type)
+		{
+			case Expression::Type::STRING:
+				output.write(expression->value);
+				break;
+			case Expression::Type::INTEGER:
+			{
+				int value = 0;
+				expression->evaluate(value);
+				output.writeInteger(value);
+				break;
+			}
 			case Expression::Type::FLOAT:
 			{
 				float value = 0.0;
 				expression->evaluate(value);
-				output += std::to_string(value);
+				output.writeFloat(value);
 				break;
 			}
 			case Expression::Type::BOOLEAN:
@@ -1316,131 +3403,719 @@ Expression* PrintNode::execute()
 				bool value = false;
 				expression->evaluate(value);
 				if (value)
-					output += "true";
+					output.write("true", 4);
 				else
-					output += "false";
+					output.write("false", 5);
 				break;
 			}
+			case Expression::Type::NIL:
+				output.write("nil", 3);
+				break;
+			case Expression::Type::TABLE:
+				output.write("table: " + addressOf(expression));
+				break;
+			case Expression::Type::FUNCTION:
+				output.write("function: " + addressOf(expression));
+				break;
+			case Expression::Type::VALUELIST:
 			case Expression::Type::PARENTHESIS:
 			case Expression::Type::BINARYOPERATION:
+			case Expression::Type::LOGICALOPERATION:
+			case Expression::Type::UNARYOPERATION:
+			case Expression::Type::TABLECONSTRUCTOR:
+			case Expression::Type::INDEX:
+			case Expression::Type::CALL:
+			case Expression::Type::TEMPORARY:
+			case Expression::Type::ARGUMENT:
 			case Expression::Type::VARIABLE:
 				break;
 		}
 
-		output += '\t';
+		output.put('\t');
+	}
+
+	output.put('\n');
+
+	return nullptr;
+}
+
+Statement* PrintNode::fold()
+{
+	log_calls("Statement* PrintNode::fold()");
+
+	foldAll(expressions);
+	this->children.assign(expressions.begin(), expressions.end());
+
+	return this;
+}
+
+void PrintNode::number(ValueNumbering& numbering)
+{
+	log_calls("void PrintNode::number(ValueNumbering& numbering)");
+
+	for (auto& expression : expressions)
+		numbering.expression(expression);
+}
+
+
+
+IfStatementNode::IfStatementNode() : Statement("IfStatementNode", "") {}
+
+IfStatementNode::IfStatementNode(std::vector<Statement*> ifNodes) : Statement("IfStatementNode", "")
+{
+	log_calls("IfStatementNode::IfStatementNode(std::vector<Statement*> ifNodes)");
+
+	this->children.assign(ifNodes.begin(), ifNodes.end());
+
+	this->ifNodes = std::move(ifNodes);
+}
+
+IfStatementNode::~IfStatementNode() {}
+
+void IfStatementNode::evaluate()
+{
+	log_evaluations("void IfStatementNode::evaluate()");
+}
+
+Expression* IfStatementNode::execute()
+{
+	log_calls("Expression* IfStatementNode::execute()");
+
+	for (auto ifNode : ifNodes)
+	{
+		bool returnValue = false;
+		ifNode->evaluate(returnValue);
+		if (returnValue)
+			return ifNode->execute();
+	}
+
+	return nullptr;
+}
+
+Statement* IfStatementNode::fold()
+{
+	log_calls("Statement* IfStatementNode::fold()");
+
+	std::vector<Statement*> reachable;
+
+	for (auto ifNode : ifNodes)
+	{
+		Statement* folded = ifNode->fold();
+		if (!folded) // Its condition is constantly false
+			continue;
+
+		reachable.push_back(folded);
+		if (dynamic_cast<ElseNode*>(folded)) // Always taken, the branches after it are dead
+			break;
+	}
+
+	this->ifNodes = reachable;
+	this->children.assign(ifNodes.begin(), ifNodes.end());
+
+	if (ifNodes.empty())
+		return nullptr;
+
+	if (dynamic_cast<ElseNode*>(ifNodes[0])) // No condition left to test
+		return ifNodes[0];
+
+	return this;
+}
+
+void IfStatementNode::number(ValueNumbering& numbering)
+{
+	log_calls("void IfStatementNode::number(ValueNumbering& numbering)");
+
+	numbering.beginBranches();
+	for (auto ifNode : ifNodes)
+	{
+		numbering.nextBranch();
+		numbering.statement(ifNode);
+	}
+	numbering.endBranches();
+}
+
+bool IfStatementNode::alwaysExits()
+{
+	if (!dynamic_cast<ElseNode*>(ifNodes.back())) // Without an else, no branch may be taken
+		return false;
+
+	for (auto ifNode : ifNodes)
+		if (!ifNode->alwaysExits())
+			return false;
+
+	return true;
+}
+
+
+
+IfNode::IfNode() : Statement("IfNode", "") {}
+
+IfNode::IfNode(Expression* expression, Statement* block) : Statement("IfNode", "")
+{
+	log_calls("IfNode::IfNode(Expression* expression, Statement* block)");
+
+	this->children.push_back(expression);
+	this->children.push_back(block);
+
+	this->expression = expression;
+	this->block = block;
+}
+
+IfNode::~IfNode() {}
+
+void IfNode::evaluate(bool& returnValue)
+{
+	log_evaluations("void IfNode::evaluate(bool& returnValue)");
+
+	expression->evaluate(returnValue);
+}
+
+Expression* IfNode::execute()
+{
+	log_calls("Expression* IfNode::execute()");
+
+	return block->execute();
+}
+
+Statement* IfNode::fold()
+{
+	log_calls("Statement* IfNode::fold()");
+
+	expression = expression->fold();
+	block = block->fold();
+	this->children = { expression, block };
+
+	// A constant condition makes the branch either dead or unconditional
+	if (isConstant(expression))
+		return isTruthy(expression) ? new ElseNode(block) : nullptr;
+
+	return this;
+}
+
+void IfNode::number(ValueNumbering& numbering)
+{
+	log_calls("void IfNode::number(ValueNumbering& numbering)");
+
+	numbering.expression(expression);
+	numbering.statement(block);
+}
+
+bool IfNode::alwaysExits()
+{
+	return block->alwaysExits();
+}
+
+
+
+ElseNode::ElseNode() : Statement("ElseNode", "")
+{
+	this->block = nullptr;
+}
+
+ElseNode::ElseNode(Statement* block) : Statement("ElseNode", "")
+{
+	log_calls("ElseNode::ElseNode(Statement* block)");
+
+	if (block)
+	{
+		this->children.push_back(block);
+		this->block = block;
+	}
+	else
+		this->block = nullptr;
+}
+
+ElseNode::~ElseNode() {}
+
+void ElseNode::evaluate(bool& returnValue)
+{
+	log_evaluations("void ElseNode::evaluate(bool& returnValue)");
+
+	returnValue = true;
+}
+
+Expression* ElseNode::execute()
+{
+	log_calls("Expression* ElseNode::execute()");
+
+	if (block != nullptr)
+		return block->execute();
+	return nullptr;
+}
+
+Statement* ElseNode::fold()
+{
+	log_calls("Statement* ElseNode::fold()");
+
+	if (block)
+	{
+		block = block->fold();
+		this->children = { block };
+	}
+
+	return this;
+}
+
+void ElseNode::number(ValueNumbering& numbering)
+{
+	log_calls("void ElseNode::number(ValueNumbering& numbering)");
+
+	if (block)
+		numbering.statement(block);
+}
+
+bool ElseNode::alwaysExits()
+{
+	return block && block->alwaysExits();
+}
+
+
+
+ForNode::ForNode() : Statement("ForNode", "")
+{
+	this->entries = 0;
+	this->kernel = nullptr;
+}
+
+ForNode::ForNode(Environment* environment, std::string name, Expression* start, Expression* limit, Expression* step, Statement* block) : Statement("ForNode", name)
+{
+	log_calls("ForNode::ForNode(Environment* environment, std::string name, Expression* start, Expression* limit, Expression* step, Statement* block)");
+
+	this->children.push_back(start);
+	this->children.push_back(limit);
+	if (step)
+		this->children.push_back(step);
+	this->children.push_back(block);
+
+	this->environment = environment;
+	this->name = name;
+	this->start = start;
+	this->limit = limit;
+	this->step = step;
+	this->block = block;
+	this->entries = 0;
+	this->kernel = nullptr;
+}
+
+ForNode::~ForNode() {}
+
+Expression* ForNode::execute()
+{
+	log_calls("Expression* ForNode::execute()");
+
+	entries++;
+
+	// The control expressions are evaluated once, before the first iteration
+	Expression* startValue = valueOf(start);
+	Expression* limitValue = valueOf(limit);
+	Expression* stepValue = step ? valueOf(step) : nullptr;
+
+	for (auto value : { startValue, limitValue, stepValue ? stepValue : startValue })
+	{
+		if (value->type != Expression::Type::INTEGER && value->type != Expression::Type::FLOAT)
+			throw RuntimeError("'for' initial value, limit and step must be numbers");
+	}
+
+	bool isInteger = startValue->type == Expression::Type::INTEGER && limitValue->type == Expression::Type::INTEGER
+		&& (!stepValue || stepValue->type == Expression::Type::INTEGER);
+
+	if (isInteger)
+	{
+		int startNumber = 0, limitNumber = 0, stepNumber = 1;
+		startValue->evaluate(startNumber);
+		limitValue->evaluate(limitNumber);
+		if (stepValue)
+			stepValue->evaluate(stepNumber);
+
+		if (kernel && stepNumber == 1 && kernel->run(environment, startNumber, limitNumber))
+			return nullptr;
+
+		return executeInteger(startNumber, limitNumber, stepNumber);
+	}
+
+	double numbers[3] = { 0.0, 0.0, 1.0 };
+	Expression* values[3] = { startValue, limitValue, stepValue };
+
+	for (int i = 0; i < 3; i++)
+	{
+		if (!values[i])
+			continue;
+
+		if (values[i]->type == Expression::Type::INTEGER)
+		{
+			int number = 0;
+			values[i]->evaluate(number);
+			numbers[i] = number;
+		}
+		else
+		{
+			float number = 0.0;
+			values[i]->evaluate(number);
+			numbers[i] = number;
+		}
+	}
+
+	return executeFloat(numbers[0], numbers[1], numbers[2]);
+}
+
+Statement* ForNode::fold()
+{
+	log_calls("Statement* ForNode::fold()");
+
+	start = start->fold();
+	limit = limit->fold();
+	this->children = { start, limit };
+	if (step)
+	{
+		step = step->fold();
+		this->children.push_back(step);
 	}
+	block = block->fold();
+	this->children.push_back(block);
+
+	kernel = NumericLoop::match(name, block);
+
+	return this;
+}
+
+void ForNode::number(ValueNumbering& numbering)
+{
+	log_calls("void ForNode::number(ValueNumbering& numbering)");
+
+	numbering.expression(start);
+	numbering.expression(limit);
+	if (step)
+		numbering.expression(step);
+
+	numbering.beginLoop(&entries, block, name);
+	numbering.statement(block);
+	numbering.endLoop();
+}
+
+Expression* ForNode::executeInteger(int start, int limit, int step)
+{
+	log_calls("Expression* ForNode::executeInteger(int start, int limit, int step)");
+
+	if (step == 0)
+		throw RuntimeError("'for' step is zero");
 
-	std::cout << output << '\n';
+	if (step > 0 ? start > limit : start < limit)
+		return nullptr;
+
+	// Counting the iterations up front keeps the control variable from overflowing past the limit
+	long long remaining = ((long long)limit - start) / step;
+
+	IntegerNode* counter = new IntegerNode(start);
+	counter->isUpdatedInPlace = true;
+	LoopVariable variable(environment, name, counter);
+	Expression*& slot = *variable.slot;
+
+	for (int i = start; ; i += step)
+	{
+		counter->setValue(i);
+		slot = counter; // The body may have assigned to the control variable
+
+		Expression* res = block->execute();
+
+		if (environment->controlFlow == Environment::ControlFlow::BREAK)
+		{
+			environment->controlFlow = Environment::ControlFlow::NORMAL;
+			break;
+		}
+		if (environment->controlFlow == Environment::ControlFlow::RETURN)
+			return res;
+
+		if (remaining-- == 0)
+			break;
+	}
 
 	return nullptr;
 }
 
+Expression* ForNode::executeFloat(double start, double limit, double step)
+{
+	log_calls("Expression* ForNode::executeFloat(double start, double limit, double step)");
 
+	if (step == 0.0)
+		throw RuntimeError("'for' step is zero");
 
-IfStatementNode::IfStatementNode() : Statement("IfStatementNode", "") {}
+	FloatNode* counter = new FloatNode(start);
+	counter->isUpdatedInPlace = true;
+	LoopVariable variable(environment, name, counter);
+	Expression*& slot = *variable.slot;
 
-IfStatementNode::IfStatementNode(std::vector<Statement*> ifNodes) : Statement("IfStatementNode", "")
+	for (double i = start; step > 0 ? i <= limit : i >= limit; i += step)
+	{
+		counter->setValue(i);
+		slot = counter;
+
+		Expression* res = block->execute();
+
+		if (environment->controlFlow == Environment::ControlFlow::BREAK)
+		{
+			environment->controlFlow = Environment::ControlFlow::NORMAL;
+			break;
+		}
+		if (environment->controlFlow == Environment::ControlFlow::RETURN)
+			return res;
+	}
+
+	return nullptr;
+}
+
+
+
+ForInNode::ForInNode() : Statement("ForInNode", "")
 {
-	log_calls("IfStatementNode::IfStatementNode(std::vector<Statement*> ifNodes)");
+	this->entries = 0;
+}
 
-	for (auto ifNode : ifNodes)
-		this->children.push_back(ifNode);
+ForInNode::ForInNode(Environment* environment, std::vector<Expression*> variables, std::vector<Expression*> expressions, Statement* block) : Statement("ForInNode", "")
+{
+	log_calls("ForInNode::ForInNode(Environment* environment, std::vector<Expression*> variables, std::vector<Expression*> expressions, Statement* block)");
+
+	this->children.insert(this->children.end(), variables.begin(), variables.end());
+	this->children.insert(this->children.end(), expressions.begin(), expressions.end());
+	this->children.push_back(block);
 
-	this->ifNodes = ifNodes;
+	this->environment = environment;
+	for (auto variable : variables)
+		this->names.push_back(variable->value);
+	this->expressions = expressions;
+	this->block = block;
+	this->entries = 0;
 }
 
-IfStatementNode::~IfStatementNode() {}
+ForInNode::~ForInNode() {}
 
-void IfStatementNode::evaluate()
+const std::vector<std::string>& ForInNode::nameList()
 {
-	log_evaluations("void IfStatementNode::evaluate()");
+	return names;
 }
 
-Expression* IfStatementNode::execute()
+// for names in f, s, control: calls f(s, control) before every iteration and stops at a nil
+// first result, which is the next control value. The results are bound as they are, so a line
+// of io.lines is only copied when the body stores it, and the names are local to the loop
+Expression* ForInNode::execute()
 {
-	log_calls("Expression* IfStatementNode::execute()");
+	log_calls("Expression* ForInNode::execute()");
 
-	for (auto ifNode : ifNodes)
+	entries++;
+
+	std::vector<Expression*> values;
+	valuesOf(expressions, values);
+	values.resize(3, NilNode::instance());
+	Expression* function = values[0];
+	Expression* state = values[1];
+	Expression* control = values[2];
+
+	std::vector<Expression*> results;
+	std::deque<LoopVariable> variables; // Unbound again however the loop ends
+	std::vector<Expression**> slots;
+	for (auto& name : names)
 	{
-		bool returnValue = false;
-		ifNode->evaluate(returnValue);
-		if (returnValue)
-			return ifNode->execute();
+		variables.emplace_back(environment, name, NilNode::instance());
+		slots.push_back(variables.back().slot);
+	}
+
+	std::vector<Expression*> arguments;
+	while (true)
+	{
+		arguments.assign({ state, control });
+		Expression* result = CallNode::call(function, arguments);
+
+		results.clear();
+		if (result && result->type == Expression::Type::VALUELIST)
+		{
+			std::vector<Expression*>& list = static_cast<ValueListNode*>(result)->values;
+			results.insert(results.end(), list.begin(), list.end());
+		}
+		else if (result)
+			results.push_back(result);
+
+		if (results.empty() || results[0]->type == Expression::Type::NIL)
+			break;
+
+		control = results[0];
+		for (long unsigned int i = 0; i < slots.size(); i++)
+			*slots[i] = i < results.size() ? results[i] : NilNode::instance();
+
+		Expression* res = block->execute();
+
+		if (environment->controlFlow == Environment::ControlFlow::BREAK)
+		{
+			environment->controlFlow = Environment::ControlFlow::NORMAL;
+			break;
+		}
+		if (environment->controlFlow == Environment::ControlFlow::RETURN)
+			return res;
 	}
 
 	return nullptr;
 }
 
+Statement* ForInNode::fold()
+{
+	log_calls("Statement* ForInNode::fold()");
 
+	foldAll(expressions);
+	block = block->fold();
 
-IfNode::IfNode() : Statement("IfNode", "") {}
+	this->children.resize(names.size());
+	this->children.insert(this->children.end(), expressions.begin(), expressions.end());
+	this->children.push_back(block);
 
-IfNode::IfNode(Expression* expression, Statement* block) : Statement("IfNode", "")
+	return this;
+}
+
+void ForInNode::number(ValueNumbering& numbering)
 {
-	log_calls("IfNode::IfNode(Expression* expression, Statement* block)");
+	log_calls("void ForInNode::number(ValueNumbering& numbering)");
+
+	for (auto& expression : expressions)
+		numbering.expression(expression);
+
+	numbering.beginLoop(&entries, this); // Finds the variables among the names the loop assigns
+	numbering.statement(block);
+	numbering.endLoop();
+}
+
+
+
+WhileNode::WhileNode() : Statement("WhileNode", "")
+{
+	this->entries = 0;
+}
+
+WhileNode::WhileNode(Environment* environment, Expression* expression, Statement* block) : Statement("WhileNode", "")
+{
+	log_calls("WhileNode::WhileNode(Environment* environment, Expression* expression, Statement* block)");
 
 	this->children.push_back(expression);
 	this->children.push_back(block);
 
+	this->environment = environment;
 	this->expression = expression;
 	this->block = block;
+	this->entries = 0;
 }
 
-IfNode::~IfNode() {}
+WhileNode::~WhileNode() {}
 
-void IfNode::evaluate(bool& returnValue)
+Expression* WhileNode::execute()
 {
-	log_evaluations("void IfNode::evaluate(bool& returnValue)");
+	log_calls("Expression* WhileNode::execute()");
 
-	if (expression->isExecutable)
-		expression = expression->execute();
+	entries++;
 
-	expression->evaluate(returnValue);
+	bool truth = false;
+
+	while ((expression->evaluate(truth), truth))
+	{
+		Expression* res = block->execute();
+
+		if (environment->controlFlow == Environment::ControlFlow::BREAK)
+		{
+			environment->controlFlow = Environment::ControlFlow::NORMAL;
+			break;
+		}
+		if (environment->controlFlow == Environment::ControlFlow::RETURN)
+			return res;
+	}
+
+	return nullptr;
 }
 
-Expression* IfNode::execute()
+Statement* WhileNode::fold()
 {
-	log_calls("Expression* IfNode::execute()");
+	log_calls("Statement* WhileNode::fold()");
 
-	return block->execute();
+	expression = expression->fold();
+	block = block->fold();
+	this->children = { expression, block };
+
+	if (isConstant(expression) && !isTruthy(expression)) // The body never runs
+		return nullptr;
+
+	return this;
+}
+
+void WhileNode::number(ValueNumbering& numbering)
+{
+	log_calls("void WhileNode::number(ValueNumbering& numbering)");
+
+	numbering.beginLoop(&entries, block);
+	numbering.expression(expression);
+	numbering.statement(block);
+	numbering.endLoop();
 }
 
 
 
-ElseNode::ElseNode() : Statement("ElseNode", "")
+RepeatNode::RepeatNode() : Statement("RepeatNode", "")
 {
-	this->block = nullptr;
+	this->entries = 0;
 }
 
-ElseNode::ElseNode(Statement* block) : Statement("ElseNode", "")
+RepeatNode::RepeatNode(Environment* environment, Statement* block, Expression* expression) : Statement("RepeatNode", "")
 {
-	log_calls("ElseNode::ElseNode(Statement* block)");
+	log_calls("RepeatNode::RepeatNode(Environment* environment, Statement* block, Expression* expression)");
 
-	if (block)
+	this->children.push_back(block);
+	this->children.push_back(expression);
+
+	this->environment = environment;
+	this->block = block;
+	this->expression = expression;
+	this->entries = 0;
+}
+
+RepeatNode::~RepeatNode() {}
+
+Expression* RepeatNode::execute()
+{
+	log_calls("Expression* RepeatNode::execute()");
+
+	entries++;
+
+	bool truth = false;
+
+	do
 	{
-		this->children.push_back(block);
-		this->block = block;
+		Expression* res = block->execute();
+
+		if (environment->controlFlow == Environment::ControlFlow::BREAK)
+		{
+			environment->controlFlow = Environment::ControlFlow::NORMAL;
+			break;
+		}
+		if (environment->controlFlow == Environment::ControlFlow::RETURN)
+			return res;
 	}
-	else
-		this->block = nullptr;
-}
+	while ((expression->evaluate(truth), !truth));
 
-ElseNode::~ElseNode() {}
+	return nullptr;
+}
 
-void ElseNode::evaluate(bool& returnValue)
+Statement* RepeatNode::fold()
 {
-	log_evaluations("void ElseNode::evaluate(bool& returnValue)");
+	log_calls("Statement* RepeatNode::fold()");
 
-	returnValue = true;
+	block = block->fold();
+	expression = expression->fold();
+	this->children = { block, expression };
+
+	return this;
 }
 
-Expression* ElseNode::execute()
+void RepeatNode::number(ValueNumbering& numbering)
 {
-	log_calls("Expression* ElseNode::execute()");
+	log_calls("void RepeatNode::number(ValueNumbering& numbering)");
 
-	if (block != nullptr)
-		return block->execute();
-	return nullptr;
+	numbering.beginLoop(&entries, block);
+	numbering.statement(block);
+	numbering.expression(expression);
+	numbering.endLoop();
 }
 
 
@@ -1464,12 +4139,15 @@ Expression* LastStatement::execute()
 
 ReturnNode::ReturnNode() : Statement("ReturnNode", "") {}
 
-ReturnNode::ReturnNode(Expression* expression) : Statement("ReturnNode", "")
+ReturnNode::ReturnNode(Environment* environment, std::vector<Expression*> expressions) : Statement("ReturnNode", "")
 {
-	log_calls("ReturnNode::ReturnNode(Expression* expression)");
+	log_calls("ReturnNode::ReturnNode(Environment* environment, std::vector<Expression*> expressions)");
 
-	this->children.push_back(expression);
-	this->expression = expression;
+	for (auto expression : expressions)
+		this->children.push_back(expression);
+
+	this->environment = environment;
+	this->expressions = expressions;
 }
 
 ReturnNode::~ReturnNode() {}
@@ -1479,10 +4157,59 @@ void ReturnNode::evaluate()
 	log_evaluations("void ReturnNode::evaluate()");
 }
 
+Expression* ReturnNode::execute()
+{
+	log_calls("Expression* ReturnNode::execute()");
+
+	Expression* result = NilNode::instance();
+
+	if (expressions.size() == 1 && expressions[0]->type != Expression::Type::CALL)
+		result = valueOf(expressions[0]);
+	else if (!expressions.empty())
+	{
+		std::vector<Expression*> values;
+		valuesOf(expressions, values);
+		result = values.size() == 1 ? values[0] : new ValueListNode(values);
+	}
+
+	environment->controlFlow = Environment::ControlFlow::RETURN;
+	return result;
+}
+
+Statement* ReturnNode::fold()
+{
+	log_calls("Statement* ReturnNode::fold()");
+
+	foldAll(expressions);
+	this->children.assign(expressions.begin(), expressions.end());
+
+	return this;
+}
+
+void ReturnNode::number(ValueNumbering& numbering)
+{
+	log_calls("void ReturnNode::number(ValueNumbering& numbering)");
+
+	for (auto& expression : expressions)
+		numbering.expression(expression);
+}
+
+bool ReturnNode::alwaysExits()
+{
+	return true;
+}
+
 
 
 BreakNode::BreakNode() : Statement("BreakNode", "") {}
 
+BreakNode::BreakNode(Environment* environment) : Statement("BreakNode", "")
+{
+	log_calls("BreakNode::BreakNode(Environment* environment)");
+
+	this->environment = environment;
+}
+
 BreakNode::~BreakNode() {}
 
 void BreakNode::evaluate()
@@ -1490,6 +4217,19 @@ void BreakNode::evaluate()
 	log_evaluations("void BreakNode::evaluate()");
 }
 
+Expression* BreakNode::execute()
+{
+	log_calls("Expression* BreakNode::execute()");
+
+	environment->controlFlow = Environment::ControlFlow::BREAK;
+	return nullptr;
+}
+
+bool BreakNode::alwaysExits()
+{
+	return true;
+}
+
 
 
 SemicolonNode::SemicolonNode() : Statement("SemicolonNode", "")
@@ -1515,14 +4255,14 @@ void SemicolonNode::evaluate()
 
 Block::Block() : Statement("Block", "") {}
 
-Block::Block(std::vector<Statement*> statements) : Statement("Block", "")
+Block::Block(Environment* environment, std::vector<Statement*> statements) : Statement("Block", "")
 {
-	log_calls("Block::Block(std::vector<Statement*> statements)");
+	log_calls("Block::Block(Environment* environment, std::vector<Statement*> statements)");
 
-	for(auto statement : statements)
-		this->children.push_back(statement);
+	this->children.assign(statements.begin(), statements.end());
 
-	this->statements = statements;
+	this->environment = environment;
+	this->statements = std::move(statements);
 }
 
 Block::~Block() {}
@@ -1540,8 +4280,90 @@ Expression* Block::execute()
 
 	for(auto statement : statements)
 	{
+		environment->line = statement->line;
 		res = statement->execute();
+		if (environment->controlFlow != Environment::ControlFlow::NORMAL) // return or break
+			break;
 	}
 
 	return res;
 }
+
+Statement* Block::fold()
+{
+	log_calls("Statement* Block::fold()");
+
+	std::vector<Statement*> reachable;
+
+	for (auto statement : statements)
+	{
+		int line = statement->line;
+		Statement* folded = statement->fold();
+		if (!folded) // Can never run
+			continue;
+
+		folded->line = line;
+		reachable.push_back(folded);
+
+		if (folded->alwaysExits()) // The statements after it are unreachable
+			break;
+	}
+
+	this->statements = reachable;
+	this->children.assign(statements.begin(), statements.end());
+
+	return this;
+}
+
+void Block::number(ValueNumbering& numbering)
+{
+	log_calls("void Block::number(ValueNumbering& numbering)");
+
+	for (auto statement : statements)
+		numbering.statement(statement);
+}
+
+bool Block::alwaysExits()
+{
+	return !statements.empty() && statements.back()->alwaysExits();
+}
+
+
+
+LazyBlock::LazyBlock() : Statement("LazyBlock", "") {}
+
+LazyBlock::LazyBlock(Environment* environment, std::string name, std::string source, int line, int column) : Statement("LazyBlock", "")
+{
+	log_calls("LazyBlock::LazyBlock(Environment* environment, std::string name, std::string source, int line, int column)");
+
+	this->environment = environment;
+	this->name = name;
+	this->source = source;
+	this->line = line;
+	this->column = column;
+}
+
+LazyBlock::~LazyBlock() {}
+
+// The body as a Block, not optimized yet. Functions defined in it are left as source in turn
+// The functions in the body keep the name of the source of the function it is of
+Statement* LazyBlock::parse(std::string* sourceName)
+{
+	log_calls("Statement* LazyBlock::parse(std::string* sourceName)");
+
+	std::string file = sourceName ? *sourceName : name; // A reloaded script's is its last version
+	Compilation compilation(file, 1, environment);
+	compilation.isBody = true;
+	if (sourceName)
+		compilation.sourceName = sourceName;
+	compilation.load(source.data(), source.size());
+	compilation.location.initialize(nullptr, line, column);
+	if (!compilation.parse())
+	{
+		// Already "name:line: message", past what main prints syntax errors with
+		std::string error = compilation.errors[0];
+		throw RuntimeError(new StringNode(error.substr(error.find(file + ":"))));
+	}
+
+	return compilation.root;
+}
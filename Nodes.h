@@ -7,8 +7,24 @@
 #include <queue>
 #include <fstream>
 #include <cmath>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <sstream>
 
 class Environment;
+class ValueNumbering;
+class NumericLoop;
+class MemoCache;
+
+
+// A number computed without a node, for values that only feed the next operation
+struct Number
+{
+	bool isInteger;
+	int integer;
+	float real;
+};
 
 class Node
 {
@@ -17,6 +33,7 @@ public:
 	std::vector<Node*> children;
 	Node(std::string t, std::string v);
 	Node();
+	virtual ~Node();
 
 	void dump(int depth=0);
 	void createGraphViz();
@@ -29,9 +46,11 @@ public:
 class Expression : public Node
 {
 public:
-	enum Type { VARIABLE, STRING, INTEGER, FLOAT, BOOLEAN, PARENTHESIS, BINARYOPERATION } type;
+	enum Type { VARIABLE, STRING, INTEGER, FLOAT, BOOLEAN, NIL, TABLE, FUNCTION, VALUELIST, PARENTHESIS, BINARYOPERATION, LOGICALOPERATION, UNARYOPERATION, TABLECONSTRUCTOR, INDEX, CALL, TEMPORARY, ARGUMENT } type;
 
 	bool isExecutable;
+	bool isUpdatedInPlace; // A loop counter or an assignment's result, copied when stored
+	bool isTransient; // A literal of a streamed statement, freed once the statement ran unless stored
 
 	Expression();
 	Expression(Expression::Type type, bool isExecutable, std::string tag, std::string value);
@@ -51,14 +70,38 @@ public:
 	virtual void evaluate(Expression*& returnValue);
 
 	virtual Expression* execute();
+	virtual Expression* evaluateNumber(Number& number);
+	virtual Expression* fold();
+	virtual std::string number(ValueNumbering& numbering);
 
 	virtual bool sameType(Expression* other);
+
+	std::string typeName();
+};
+
+
+// Thrown by failing operations and by error(). Only pcall and main catch it, so the
+// non-error path carries no status checks
+class RuntimeError
+{
+public:
+	std::string message;
+	Expression* value; // What error() was called with, null for errors raised by the interpreter
+	int line; // 0 until the error is positioned where it was caught
+
+	RuntimeError(std::string message);
+	RuntimeError(Expression* value);
+
+	Expression* errorObject(const std::string& source, int line);
+	std::string describe(const std::string& source, int line);
 };
 
 
 class Statement : public Node
 {
 public:
+	int line; // Source line, set by the parser for statements of a block
+
 	Statement();
 	Statement(std::string tag, std::string value);
 	~Statement();
@@ -70,6 +113,9 @@ public:
 	virtual void evaluate(Expression*& returnValue);
 
 	virtual Expression* execute();
+	virtual Statement* fold();
+	virtual void number(ValueNumbering& numbering);
+	virtual bool alwaysExits();
 };
 
 
@@ -79,14 +125,43 @@ private:
 	Environment* environment;
 	Expression* left;
 	Expression* right;
+	bool isLocal;
+	std::string name; // Of the assigned variable, empty for t[k] = exp
+
+	Expression* result; // The last number stored, overwritten while nothing else can hold it
+	unsigned long long resultEpoch;
+
+	void assignNumber(const Number& number);
 
 public:
 	AssignmentNode();
-	AssignmentNode(Environment* environment, Expression* left, Expression* right);
+	AssignmentNode(Environment* environment, Expression* left, Expression* right, bool isLocal = false);
 	~AssignmentNode();
 
 	void evaluate();
-	Expression* execute();
+	void assign(Expression* value);
+	Expression* execute();	Statement* fold();
+	void number(ValueNumbering& numbering);
+
+};
+
+
+class MultipleAssignmentNode : public Statement
+{
+private:
+	std::vector<AssignmentNode*> targets; // Assign the values computed by this node
+	std::vector<Expression*> expressions;
+
+public:
+	MultipleAssignmentNode();
+	MultipleAssignmentNode(Environment* environment, std::vector<Expression*> variables, std::vector<Expression*> expressions, bool isLocal = false);
+	~MultipleAssignmentNode();
+
+	const std::vector<AssignmentNode*>& targetList();
+
+	Expression* execute();	Statement* fold();
+	void number(ValueNumbering& numbering);
+
 };
 
 
@@ -110,6 +185,7 @@ public:
 
 	void evaluate(Expression*& returnValue);
 	void evaluate(std::string& returnValue);
+	std::string number(ValueNumbering& numbering);
 
 	bool sameType(Expression* other);
 };
@@ -132,6 +208,7 @@ public:
 	Expression* operator ^ (Expression* obj);
 	~IntegerNode();
 
+	void setValue(int value);
 	void evaluate(int& returnValue);
 	Expression* right;
 };
@@ -154,6 +231,7 @@ public:
 	Expression* operator ^ (Expression* obj);
 	~FloatNode();
 
+	void setValue(float value);
 	void evaluate(float& returnValue);
 };
 
@@ -166,6 +244,7 @@ private:
 public:
 	StringNode();
 	StringNode(std::string value);
+	void setValue(const char* text, long unsigned int length);
 	Expression* operator == (Expression* obj);
 	Expression* operator != (Expression* obj);
 	Expression* operator + (Expression* obj);
@@ -192,20 +271,264 @@ public:
 };
 
 
+class NilNode : public Expression
+{
+public:
+	NilNode();
+	~NilNode();
+
+	static Expression* instance();
+
+	void evaluate(bool& returnValue);
+};
+
+
+// The results of a call returning several values. Only ever a call's result, never stored
+class ValueListNode : public Expression
+{
+public:
+	std::vector<Expression*> values;
+
+	ValueListNode();
+	ValueListNode(std::vector<Expression*> values);
+	~ValueListNode();
+};
+
+
+class TableNode : public Expression
+{
+public:
+	// The first events are the ones looked up on every table access
+	enum Metamethod { INDEX, NEWINDEX, CALL, EQ, ADD, SUB, MUL, DIV, POW, LT, LE, METAMETHOD_COUNT };
+
+private:
+	std::unordered_map<std::string, Expression*> fields;
+	std::vector<Expression*> array; // Keys 1..n
+	std::map<int, Expression*> integers; // Integer keys outside of the array part
+	std::map<Expression*, Expression*> objects; // Tables and functions, keyed by identity
+	unsigned int absentMetamethods; // Bit set = this table, used as a metatable, lacks that event
+
+	void migrateToArray();
+
+public:
+	TableNode* metatable;
+
+	TableNode();
+	~TableNode();
+
+	int length();
+	std::vector<Expression*>& arrayPart();
+	std::vector<std::pair<Expression*, Expression*>> entries();
+
+	Expression* rawGet(Expression* key);
+	Expression* rawGet(const std::string& key);
+	Expression* rawGet(int key);
+	void rawSet(Expression* key, Expression* value);
+	void rawSet(const std::string& key, Expression* value);
+	void rawSet(int key, Expression* value);
+
+	Expression* get(Expression* key);
+	Expression* get(const std::string& key);
+	void set(Expression* key, Expression* value);
+
+	Expression* getMetamethod(TableNode::Metamethod event);
+	static Expression* metamethod(Expression* value, TableNode::Metamethod event);
+};
+
+
+class TableConstructorNode : public Expression
+{
+private:
+	std::vector<std::pair<Expression*, Expression*>> fields; // Positional fields have no key
+
+public:
+	TableConstructorNode();
+	TableConstructorNode(std::vector<std::pair<Expression*, Expression*>> fields);
+	~TableConstructorNode();
+
+	const std::vector<std::pair<Expression*, Expression*>>& fieldList();
+
+	Expression* execute();	Expression* fold();
+	std::string number(ValueNumbering& numbering);
+
+};
+
+
+class IndexNode : public Expression
+{
+private:
+	Expression* object;
+	Expression* key;
+	std::string name; // Set when the key is a string literal, as in obj.name
+
+public:
+	IndexNode();
+	IndexNode(Expression* object, Expression* key);
+	~IndexNode();
+
+	void assign(Expression* value);
+
+	Expression* execute();	Expression* fold();
+	std::string number(ValueNumbering& numbering);
+
+};
+
+
+class FunctionNode : public Expression
+{
+protected:
+	Environment* environment;
+	std::vector<std::string> parameters;
+	Statement* block;
+
+public:
+	MemoCache* memo; // Set by the Memoizer when the function is pure
+	bool isOptimized; // Unset for a body restored from a snapshot, optimized on the first call
+	std::string* source; // Name of the source parsed from, in runtime errors, null for builtins
+
+	FunctionNode();
+	FunctionNode(Environment* environment, std::vector<std::string> parameters, Statement* block, std::string* source = nullptr);
+	~FunctionNode();
+
+	const std::vector<std::string>& parameterList();
+	Statement* body();
+	void frameNames(std::set<std::string>& names);
+
+	virtual Expression* call(std::vector<Expression*>& arguments);
+	void compileBody();
+	Expression* fold();
+	void foldBody();
+	std::string number(ValueNumbering& numbering);
+};
+
+
+class BuiltinFunctionNode : public FunctionNode
+{
+public:
+	typedef Expression* (*Function)(Environment* environment, std::vector<Expression*>& arguments);
+
+private:
+	Function function;
+
+public:
+	BuiltinFunctionNode();
+	BuiltinFunctionNode(Environment* environment, std::string name, Function function);
+	~BuiltinFunctionNode();
+
+	Expression* call(std::vector<Expression*>& arguments);
+};
+
+
+class ArgumentNode;
+
+class CallNode : public Expression
+{
+private:
+	Expression* function;
+	std::string method; // Set for obj:method(...) calls
+	std::vector<Expression*> arguments;
+
+	// Set by the Inliner: the callee's returned expression, run in place while function is still it
+	Environment* environment;
+	FunctionNode* inlined;
+	Expression* inlinedBody;
+	std::vector<ArgumentNode*> inlinedParameters;
+	int inlinedLine;
+
+	Expression* run(Number* number);
+	Expression* executeInlined(Number* number);
+
+public:
+	static const long unsigned int maxInlinedParameters = 4;
+
+	CallNode();
+	CallNode(Expression* function, std::vector<Expression*> arguments);
+	CallNode(Expression* object, std::string method, std::vector<Expression*> arguments);
+	~CallNode();
+
+	static Expression* call(Expression* function, std::vector<Expression*>& arguments);
+
+	void inlineBody(Environment* environment, FunctionNode* callee, Expression* body, std::vector<ArgumentNode*> parameters, int line);
+	void shiftLines(int after, int delta);
+
+	Expression* execute();	Expression* fold();
+	std::string number(ValueNumbering& numbering);
+	Expression* evaluateNumber(Number& number);
+
+};
+
+
 class BinaryOperationNode : public Expression
 {
 private:
 	Expression* left;
 	Expression* right;
 
+	bool isComparison;
+	bool isIntegerPower; // x ^ n with an integer literal n, computed by squaring
+	int exponent;
+
+	Expression* operate(Expression* leftValue, Expression* rightValue);
+	void arithmetic(const Number& leftNumber, const Number& rightNumber, Number& result);
+	bool compareOperands();
+	Expression* executeMetamethod(Expression* leftValue, Expression* rightValue);
+	bool compare(Expression* leftValue, Expression* rightValue);
+	bool isEqual(Expression* leftValue, Expression* rightValue);
+	bool isLess(Expression* leftValue, Expression* rightValue, bool orEqual);
+
 public:
-	enum Operation { EQUALS, NOT_EQUALS, PLUS, MINUS, MULTIPLICATION, DIVISION, POWER_OF } operation;
+	enum Operation { EQUALS, NOT_EQUALS, PLUS, MINUS, MULTIPLICATION, DIVISION, POWER_OF, LESS, MORE, LESS_OR_EQUAL, MORE_OR_EQUAL } operation;
 
 	BinaryOperationNode();
 	BinaryOperationNode(Expression* left, Expression* right, BinaryOperationNode::Operation operation);
 	~BinaryOperationNode();
 
-	Expression* execute();
+	void evaluate(bool& returnValue);
+	Expression* execute();	Expression* fold();
+	std::string number(ValueNumbering& numbering);
+	Expression* evaluateNumber(Number& number);
+
+};
+
+
+class LogicalOperationNode : public Expression
+{
+private:
+	Expression* left;
+	Expression* right;
+
+public:
+	enum Operation { AND, OR } operation;
+
+	LogicalOperationNode();
+	LogicalOperationNode(Expression* left, Expression* right, LogicalOperationNode::Operation operation);
+	~LogicalOperationNode();
+
+	void evaluate(bool& returnValue);
+	Expression* execute();	Expression* fold();
+	std::string number(ValueNumbering& numbering);
+
+};
+
+
+class UnaryOperationNode : public Expression
+{
+private:
+	Expression* expression;
+
+	Expression* length(Expression* value);
+
+public:
+	enum Operation { NOT, LENGTH } operation;
+
+	UnaryOperationNode();
+	UnaryOperationNode(Expression* expression, UnaryOperationNode::Operation operation);
+	~UnaryOperationNode();
+
+	void evaluate(bool& returnValue);
+	Expression* execute();	Expression* fold();
+	std::string number(ValueNumbering& numbering);
+
 };
 
 
@@ -229,21 +552,81 @@ public:
 	void evaluate(Expression*& returnValue);
 	void evaluate(bool& returnValue);
 
+	Expression* getExpression();
+	Expression* execute();	Expression* fold();
+	std::string number(ValueNumbering& numbering);
+
+};
+
+
+// The value of a computation kept for reuse, put in the tree by ValueNumbering. The node at the
+// first computation stores it, the ones at later computations of the same value read it
+class TemporaryNode : public Expression
+{
+private:
+	Environment* environment;
+	Expression* expression; // Computes the value, also when a reuse finds it missing
+	TemporaryNode* source; // Holds the value, this node for the one storing it
+	const unsigned long long* loopEntries; // Set when the value is kept across the iterations of that loop
+	unsigned long long entry;
+	unsigned long long epoch; // Calls and returns before the value was computed
+	bool isValid;
+	Expression* result;
+
+public:
+	TemporaryNode();
+	TemporaryNode(Environment* environment, Expression* expression, TemporaryNode* source = nullptr);
+	~TemporaryNode();
+
+	void hoist(const unsigned long long* loopEntries);
+	Expression* execute();
+};
+
+
+// A parameter in the copy of an inlined function's body, holding the argument of the running call
+class ArgumentNode : public Expression
+{
+public:
+	Expression* argument;
+
+	ArgumentNode();
+	ArgumentNode(std::string name);
+	~ArgumentNode();
+
 	Expression* execute();
 };
 
 
+class CallStatementNode : public Statement
+{
+private:
+	Expression* call;
+
+public:
+	CallStatementNode();
+	CallStatementNode(Expression* call);
+	~CallStatementNode();
+
+	Expression* execute();	Statement* fold();
+	void number(ValueNumbering& numbering);
+
+};
+
+
 class PrintNode : public Statement
 {
 private:
+	Environment* environment;
 	std::vector<Expression*>  expressions;
 
 public:
 	PrintNode();
-	PrintNode(std::vector<Expression*> expression);
+	PrintNode(Environment* environment, std::vector<Expression*> expression);
 	~PrintNode();
 
-	Expression* execute();
+	Expression* execute();	Statement* fold();
+	void number(ValueNumbering& numbering);
+
 };
 
 
@@ -258,7 +641,10 @@ public:
 	~IfStatementNode();
 
 	void evaluate();
-	Expression* execute();
+	Expression* execute();	Statement* fold();
+	void number(ValueNumbering& numbering);
+	bool alwaysExits();
+
 };
 
 
@@ -274,7 +660,10 @@ public:
 	~IfNode();
 
 	void evaluate(bool& returnValue);
-	Expression* execute();
+	Expression* execute();	Statement* fold();
+	void number(ValueNumbering& numbering);
+	bool alwaysExits();
+
 };
 
 
@@ -289,7 +678,99 @@ public:
 	~ElseNode();
 
 	void evaluate(bool& returnValue);
-	Expression* execute();
+	Expression* execute();	Statement* fold();
+	void number(ValueNumbering& numbering);
+	bool alwaysExits();
+
+};
+
+
+
+class ForNode : public Statement
+{
+private:
+	Environment* environment;
+	std::string name;
+	Expression* start;
+	Expression* limit;
+	Expression* step;
+	Statement* block;
+	unsigned long long entries; // Times the loop was entered, values kept across iterations belong to one
+	NumericLoop* kernel; // Set when the body is a reduction or map over array parts
+
+	Expression* executeInteger(int start, int limit, int step);
+	Expression* executeFloat(double start, double limit, double step);
+
+public:
+	ForNode();
+	ForNode(Environment* environment, std::string name, Expression* start, Expression* limit, Expression* step, Statement* block);
+	~ForNode();
+
+	Expression* execute();	Statement* fold();
+	void number(ValueNumbering& numbering);
+
+};
+
+
+
+class ForInNode : public Statement
+{
+private:
+	Environment* environment;
+	std::vector<std::string> names;
+	std::vector<Expression*> expressions; // Give the iterator, its state and the first control value
+	Statement* block;
+	unsigned long long entries;
+
+public:
+	ForInNode();
+	ForInNode(Environment* environment, std::vector<Expression*> variables, std::vector<Expression*> expressions, Statement* block);
+	~ForInNode();
+
+	const std::vector<std::string>& nameList();
+
+	Expression* execute();	Statement* fold();
+	void number(ValueNumbering& numbering);
+
+};
+
+
+
+class WhileNode : public Statement
+{
+private:
+	Environment* environment;
+	Expression* expression;
+	Statement* block;
+	unsigned long long entries;
+
+public:
+	WhileNode();
+	WhileNode(Environment* environment, Expression* expression, Statement* block);
+	~WhileNode();
+
+	Expression* execute();	Statement* fold();
+	void number(ValueNumbering& numbering);
+
+};
+
+
+class RepeatNode : public Statement
+{
+private:
+	Environment* environment;
+	Statement* block;
+	Expression* expression;
+	unsigned long long entries;
+
+public:
+	RepeatNode();
+	RepeatNode(Environment* environment, Statement* block, Expression* expression);
+	~RepeatNode();
+
+	Expression* execute();	Statement* fold();
+	void number(ValueNumbering& numbering);
+
 };
 
 
@@ -310,26 +791,35 @@ public:
 class ReturnNode : public Statement
 {
 private:
-	Expression* expression;
+	Environment* environment;
+	std::vector<Expression*> expressions;
 
 public:
 	ReturnNode();
-	ReturnNode(Expression* expression);
+	ReturnNode(Environment* environment, std::vector<Expression*> expressions);
 	~ReturnNode();
 
 	void evaluate();
+	Expression* execute();	Statement* fold();
+	void number(ValueNumbering& numbering);
+	bool alwaysExits();
+
 };
 
 
 class BreakNode : public Statement
 {
 private:
+	Environment* environment;
 
 public:
 	BreakNode();
+	BreakNode(Environment* environment);
 	~BreakNode();
 
 	void evaluate();
+	Expression* execute();
+	bool alwaysExits();
 };
 
 
@@ -351,15 +841,40 @@ public:
 class Block : public Statement
 {
 private:
+	Environment* environment;
 	std::vector<Statement*> statements;
 
 public:
 	Block();
-	Block(std::vector<Statement*> statements);
+	Block(Environment* environment, std::vector<Statement*> statements);
 	~Block();
 
 	void evaluate();
-	Expression* execute();
+	Expression* execute();	Statement* fold();
+	void number(ValueNumbering& numbering);
+	bool alwaysExits();
+
+};
+
+
+// A function body left as its source text until the function is first called (./parser lazy).
+// Scanning it found only where it ends, by matching its blocks, so its syntax errors are
+// reported on that call
+class LazyBlock : public Statement
+{
+private:
+	Environment* environment;
+
+public:
+	std::string name; // Of the script, in syntax errors
+	std::string source;
+	int column; // Where the source starts on line
+
+	LazyBlock();
+	LazyBlock(Environment* environment, std::string name, std::string source, int line, int column);
+	~LazyBlock();
+
+	Statement* parse(std::string* sourceName);
 };
 
 
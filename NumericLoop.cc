@@ -0,0 +1,523 @@
+#include "NumericLoop.h"
+#include "Environment.h"
+#include "Nodes.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define NUMERIC_LOOP_X86
+#include <immintrin.h>
+#endif
+
+
+// The kernels work on whole lanes. Integers wrap around like the interpreter's do, and floats
+// are combined one operation per element, so every result is the one the loop would compute.
+// Sums of floats are the exception: each SIMD lane adds every fourth or eighth element, and
+// the lanes are added at the end
+struct Kernels
+{
+	void (*integers)(int operation, const int* left, const int* right, int* result, long unsigned int count);
+	void (*reals)(int operation, const float* left, const float* right, float* result, long unsigned int count);
+	unsigned int (*sum)(const int* values, long unsigned int count);
+	float (*sumReals)(const float* values, long unsigned int count);
+};
+
+static void combineIntegers(int operation, const int* left, const int* right, int* result, long unsigned int count)
+{
+	for (long unsigned int i = 0; i < count; i++)
+	{
+		unsigned int x = left[i], y = right[i];
+		result[i] = operation == 0 ? x + y : operation == 1 ? x - y : x * y;
+	}
+}
+
+static void combineReals(int operation, const float* left, const float* right, float* result, long unsigned int count)
+{
+	for (long unsigned int i = 0; i < count; i++)
+		result[i] = operation == 0 ? left[i] + right[i] : operation == 1 ? left[i] - right[i] : left[i] * right[i];
+}
+
+static unsigned int sumIntegers(const int* values, long unsigned int count)
+{
+	unsigned int sum = 0;
+	for (long unsigned int i = 0; i < count; i++)
+		sum += values[i];
+
+	return sum;
+}
+
+static float sumReals(const float* values, long unsigned int count)
+{
+	float sum = 0.0;
+	for (long unsigned int i = 0; i < count; i++)
+		sum = sum + values[i];
+
+	return sum;
+}
+
+#ifdef NUMERIC_LOOP_X86
+
+__attribute__((target("sse2")))
+static void combineIntegersSse2(int operation, const int* left, const int* right, int* result, long unsigned int count)
+{
+	if (operation == 2) // No 32 bit multiply before SSE4.1
+		return combineIntegers(operation, left, right, result, count);
+
+	long unsigned int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i x = _mm_loadu_si128((const __m128i*)(left + i));
+		__m128i y = _mm_loadu_si128((const __m128i*)(right + i));
+		_mm_storeu_si128((__m128i*)(result + i), operation == 0 ? _mm_add_epi32(x, y) : _mm_sub_epi32(x, y));
+	}
+
+	combineIntegers(operation, left + i, right + i, result + i, count - i);
+}
+
+__attribute__((target("sse2")))
+static void combineRealsSse2(int operation, const float* left, const float* right, float* result, long unsigned int count)
+{
+	long unsigned int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(left + i), y = _mm_loadu_ps(right + i);
+		_mm_storeu_ps(result + i, operation == 0 ? _mm_add_ps(x, y) : operation == 1 ? _mm_sub_ps(x, y) : _mm_mul_ps(x, y));
+	}
+
+	combineReals(operation, left + i, right + i, result + i, count - i);
+}
+
+__attribute__((target("sse2")))
+static unsigned int sumIntegersSse2(const int* values, long unsigned int count)
+{
+	__m128i sums = _mm_setzero_si128();
+	long unsigned int i = 0;
+	for (; i + 4 <= count; i += 4)
+		sums = _mm_add_epi32(sums, _mm_loadu_si128((const __m128i*)(values + i)));
+
+	unsigned int lanes[4];
+	_mm_storeu_si128((__m128i*)lanes, sums);
+	return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sumIntegers(values + i, count - i);
+}
+
+__attribute__((target("sse2")))
+static float sumRealsSse2(const float* values, long unsigned int count)
+{
+	__m128 sums = _mm_setzero_ps();
+	long unsigned int i = 0;
+	for (; i + 4 <= count; i += 4)
+		sums = _mm_add_ps(sums, _mm_loadu_ps(values + i));
+
+	float lanes[4];
+	_mm_storeu_ps(lanes, sums);
+	return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + sumReals(values + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void combineIntegersAvx2(int operation, const int* left, const int* right, int* result, long unsigned int count)
+{
+	long unsigned int i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256i x = _mm256_loadu_si256((const __m256i*)(left + i));
+		__m256i y = _mm256_loadu_si256((const __m256i*)(right + i));
+		__m256i combined = operation == 0 ? _mm256_add_epi32(x, y) : operation == 1 ? _mm256_sub_epi32(x, y) : _mm256_mullo_epi32(x, y);
+		_mm256_storeu_si256((__m256i*)(result + i), combined);
+	}
+
+	combineIntegers(operation, left + i, right + i, result + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void combineRealsAvx2(int operation, const float* left, const float* right, float* result, long unsigned int count)
+{
+	long unsigned int i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 x = _mm256_loadu_ps(left + i), y = _mm256_loadu_ps(right + i);
+		_mm256_storeu_ps(result + i, operation == 0 ? _mm256_add_ps(x, y) : operation == 1 ? _mm256_sub_ps(x, y) : _mm256_mul_ps(x, y));
+	}
+
+	combineReals(operation, left + i, right + i, result + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static unsigned int sumIntegersAvx2(const int* values, long unsigned int count)
+{
+	__m256i sums = _mm256_setzero_si256();
+	long unsigned int i = 0;
+	for (; i + 8 <= count; i += 8)
+		sums = _mm256_add_epi32(sums, _mm256_loadu_si256((const __m256i*)(values + i)));
+
+	unsigned int lanes[8];
+	_mm256_storeu_si256((__m256i*)lanes, sums);
+
+	unsigned int sum = 0;
+	for (auto lane : lanes)
+		sum += lane;
+
+	return sum + sumIntegers(values + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static float sumRealsAvx2(const float* values, long unsigned int count)
+{
+	__m256 sums = _mm256_setzero_ps();
+	long unsigned int i = 0;
+	for (; i + 8 <= count; i += 8)
+		sums = _mm256_add_ps(sums, _mm256_loadu_ps(values + i));
+
+	float lanes[8];
+	_mm256_storeu_ps(lanes, sums);
+
+	float sum = 0.0;
+	for (auto lane : lanes)
+		sum = sum + lane;
+
+	return sum + sumReals(values + i, count - i);
+}
+
+#endif
+
+static Kernels selectKernels()
+{
+#ifdef NUMERIC_LOOP_X86
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2"))
+		return { combineIntegersAvx2, combineRealsAvx2, sumIntegersAvx2, sumRealsAvx2 };
+
+	if (__builtin_cpu_supports("sse2"))
+		return { combineIntegersSse2, combineRealsSse2, sumIntegersSse2, sumRealsSse2 };
+#endif
+
+	return { combineIntegers, combineReals, sumIntegers, sumReals };
+}
+
+static const Kernels& kernels()
+{
+	static const Kernels selected = selectKernels();
+	return selected;
+}
+
+// table[counter], with table a variable other than the counter
+static bool isElement(Node* node, const std::string& counter, std::string& table)
+{
+	if (node->tag != "IndexNode" || node->children[0]->tag != "VariableNode" || node->children[1]->tag != "VariableNode")
+		return false;
+
+	if (node->children[0]->value == counter || node->children[1]->value != counter)
+		return false;
+
+	table = node->children[0]->value;
+	return true;
+}
+
+// The array part of the table named, when it holds keys start..limit
+static TableNode* arrayOf(Environment* environment, const std::string& name, int start, int limit)
+{
+	Expression* value = environment->read(name);
+	if (!value || value->type != Expression::Type::TABLE)
+		return nullptr;
+
+	TableNode* table = static_cast<TableNode*>(value);
+	if (start < 1 || limit > table->length())
+		return nullptr;
+
+	return table;
+}
+
+
+
+NumericLoop::NumericLoop()
+{
+	this->left = { "", "", nullptr };
+	this->right = { "", "", nullptr };
+	this->hasRight = false;
+	this->operation = NumericLoop::Operation::ADD;
+	for (auto& lane : lanes)
+		lane.isInteger = false;
+	this->stored = nullptr;
+	this->storedStart = 0;
+	this->storedEpoch = 0;
+}
+
+NumericLoop* NumericLoop::match(const std::string& counter, Statement* body)
+{
+	if (body->tag != "Block" || body->children.size() != 1)
+		return nullptr;
+
+	Node* statement = body->children[0];
+	if (statement->tag != "AssignmentNode" || statement->value == "local")
+		return nullptr;
+
+	NumericLoop loop;
+	loop.counter = counter;
+
+	Node* target = statement->children[0];
+	Node* term = statement->children[1];
+
+	if (target->tag == "VariableNode") // acc = acc + term
+	{
+		loop.accumulator = target->value;
+		if (loop.accumulator == counter || term->tag != "BinaryOperationNode")
+			return nullptr;
+
+		BinaryOperationNode* sum = static_cast<BinaryOperationNode*>(term);
+		if (sum->operation != BinaryOperationNode::Operation::PLUS)
+			return nullptr;
+		if (sum->children[0]->tag != "VariableNode" || sum->children[0]->value != loop.accumulator)
+			return nullptr;
+
+		term = sum->children[1];
+	}
+	else if (!isElement(target, counter, loop.destination)) // t[i] = term
+		return nullptr;
+
+	if (!loop.accumulator.empty() && isElement(term, counter, loop.left.table)) // A plain sum
+		return new NumericLoop(loop);
+
+	if (term->tag != "BinaryOperationNode")
+		return nullptr;
+
+	BinaryOperationNode* operation = static_cast<BinaryOperationNode*>(term);
+
+	switch (operation->operation)
+	{
+		case BinaryOperationNode::Operation::PLUS:
+			loop.operation = NumericLoop::Operation::ADD;
+			break;
+		case BinaryOperationNode::Operation::MINUS:
+			loop.operation = NumericLoop::Operation::SUBTRACT;
+			break;
+		case BinaryOperationNode::Operation::MULTIPLICATION:
+			loop.operation = NumericLoop::Operation::MULTIPLY;
+			break;
+		default:
+			return nullptr;
+	}
+
+	loop.hasRight = true;
+	if (!loop.matchOperand(operation->children[0], loop.left) || !loop.matchOperand(operation->children[1], loop.right))
+		return nullptr;
+
+	if (loop.left.table.empty() && loop.right.table.empty()) // Nothing varies over the range
+		return nullptr;
+
+	return new NumericLoop(loop);
+}
+
+bool NumericLoop::matchOperand(Node* node, Operand& operand)
+{
+	if (isElement(node, counter, operand.table))
+		return true;
+
+	if (node->tag == "VariableNode") // Read once, so the loop must not assign it
+	{
+		operand.variable = node->value;
+		return operand.variable != counter && operand.variable != accumulator;
+	}
+
+	if (node->tag == "IntegerNode" || node->tag == "FloatNode")
+	{
+		operand.constant = static_cast<Expression*>(node);
+		return true;
+	}
+
+	return false;
+}
+
+// Runs the loop for start..limit, with a step of 1. Everything is checked before anything is
+// stored, and false means nothing ran and the loop should run as written
+bool NumericLoop::run(Environment* environment, int start, int limit)
+{
+	if (start > limit)
+		return false;
+
+	if (!load(environment, left, start, limit, lanes[0]))
+		return false;
+
+	Lane* terms = &lanes[0];
+	if (hasRight)
+	{
+		if (!load(environment, right, start, limit, lanes[1]))
+			return false;
+
+		combine(lanes[0], lanes[1], lanes[2]);
+		terms = &lanes[2];
+	}
+
+	if (accumulator.empty())
+	{
+		TableNode* table = arrayOf(environment, destination, start, limit);
+		if (!table)
+			return false;
+
+		store(environment, table, start, *terms);
+	}
+	else
+	{
+		Expression* initial = environment->read(accumulator);
+		if (!initial || (initial->type != Expression::Type::INTEGER && initial->type != Expression::Type::FLOAT))
+			return false;
+
+		environment->write(accumulator, reduce(initial, *terms));
+	}
+
+	return true;
+}
+
+// Fills the lane with the operand's numbers, all integers or all floats
+bool NumericLoop::load(Environment* environment, const Operand& operand, int start, int limit, Lane& lane)
+{
+	long unsigned int count = limit - start + 1;
+
+	if (operand.table.empty()) // The same value for every element
+	{
+		Expression* value = operand.constant ? operand.constant : environment->read(operand.variable);
+
+		if (value && value->type == Expression::Type::INTEGER)
+		{
+			int number = 0;
+			value->evaluate(number);
+			lane.isInteger = true;
+			lane.integers.assign(count, number);
+			return true;
+		}
+
+		if (value && value->type == Expression::Type::FLOAT)
+		{
+			float number = 0.0;
+			value->evaluate(number);
+			lane.isInteger = false;
+			lane.reals.assign(count, number);
+			return true;
+		}
+
+		return false;
+	}
+
+	TableNode* table = arrayOf(environment, operand.table, start, limit);
+	if (!table)
+		return false;
+
+	std::vector<Expression*>& array = table->arrayPart();
+	Expression* first = array[start - 1];
+	if (!first)
+		return false;
+
+	lane.isInteger = first->type == Expression::Type::INTEGER;
+	if (lane.isInteger)
+		lane.integers.resize(count);
+	else if (first->type == Expression::Type::FLOAT)
+		lane.reals.resize(count);
+	else
+		return false;
+
+	for (long unsigned int i = 0; i < count; i++)
+	{
+		Expression* element = array[start - 1 + i];
+		if (!element || element->type != first->type)
+			return false;
+
+		if (lane.isInteger)
+			element->evaluate(lane.integers[i]);
+		else
+			element->evaluate(lane.reals[i]);
+	}
+
+	return true;
+}
+
+// An integer and a float operand give floats, as in the interpreter
+void NumericLoop::combine(Lane& leftLane, Lane& rightLane, Lane& result)
+{
+	long unsigned int count = leftLane.isInteger ? leftLane.integers.size() : leftLane.reals.size();
+	result.isInteger = leftLane.isInteger && rightLane.isInteger;
+
+	if (result.isInteger)
+	{
+		result.integers.resize(count);
+		kernels().integers(operation, leftLane.integers.data(), rightLane.integers.data(), result.integers.data(), count);
+		return;
+	}
+
+	for (Lane* lane : { &leftLane, &rightLane })
+	{
+		if (!lane->isInteger)
+			continue;
+
+		lane->reals.resize(count);
+		for (long unsigned int i = 0; i < count; i++)
+			lane->reals[i] = (float)lane->integers[i];
+	}
+
+	result.reals.resize(count);
+	kernels().reals(operation, leftLane.reals.data(), rightLane.reals.data(), result.reals.data(), count);
+}
+
+// Writes the numbers into the elements from start on. An element this loop stored on its last
+// run is overwritten in place when nothing else can hold it: storing it anywhere copies it, and
+// no call started since, so no parameter is bound to it. Other elements get new nodes
+void NumericLoop::store(Environment* environment, TableNode* table, int start, const Lane& lane)
+{
+	std::vector<Expression*>& array = table->arrayPart();
+	long unsigned int count = lane.isInteger ? lane.integers.size() : lane.reals.size();
+	Expression::Type type = lane.isInteger ? Expression::Type::INTEGER : Expression::Type::FLOAT;
+	bool isReusable = table == stored && storedEpoch == environment->epoch;
+
+	std::vector<Expression*> elements(count);
+	for (long unsigned int i = 0; i < count; i++)
+	{
+		Expression*& element = array[start - 1 + i];
+		long unsigned int previous = start + i - storedStart;
+		if (isReusable && start + (int)i >= storedStart && previous < storedElements.size() && storedElements[previous] == element && element->type == type)
+		{
+			if (lane.isInteger)
+				static_cast<IntegerNode*>(element)->setValue(lane.integers[i]);
+			else
+				static_cast<FloatNode*>(element)->setValue(lane.reals[i]);
+		}
+		else
+		{
+			element = lane.isInteger ? (Expression*)new IntegerNode(lane.integers[i]) : new FloatNode(lane.reals[i]);
+			element->isUpdatedInPlace = true; // Only now, rawSet would have stored a copy
+		}
+		elements[i] = element;
+	}
+
+	storedElements.swap(elements);
+	stored = table;
+	storedStart = start;
+	storedEpoch = environment->epoch;
+}
+
+// Integers are summed in any order, since they wrap. Floats are summed in SIMD lanes, so the
+// rounding may differ from the loop's order of additions, and the sum turns to floats at the
+// first float
+Expression* NumericLoop::reduce(Expression* initial, Lane& lane)
+{
+	if (initial->type == Expression::Type::INTEGER && lane.isInteger)
+	{
+		int number = 0;
+		initial->evaluate(number);
+		return new IntegerNode((int)((unsigned int)number + kernels().sum(lane.integers.data(), lane.integers.size())));
+	}
+
+	float sum = 0.0;
+	if (initial->type == Expression::Type::INTEGER)
+	{
+		int number = 0;
+		initial->evaluate(number);
+		sum = (float)number;
+	}
+	else
+		initial->evaluate(sum);
+
+	if (lane.isInteger)
+	{
+		lane.reals.resize(lane.integers.size());
+		for (long unsigned int i = 0; i < lane.integers.size(); i++)
+			lane.reals[i] = (float)lane.integers[i];
+	}
+
+	return new FloatNode(sum + kernels().sumReals(lane.reals.data(), lane.reals.size()));
+}
@@ -0,0 +1,73 @@
+#ifndef NUMERICLOOP_H
+#define NUMERICLOOP_H
+
+#include <string>
+#include <vector>
+
+class Environment;
+class Expression;
+class Node;
+class Statement;
+class TableNode;
+
+// A numeric for loop over the array parts of tables, whose body is one of
+//     acc = acc + x        acc = acc + x op y        t[i] = x op y
+// where x and y are elements u[i] or values the loop does not change, and op is +, - or *.
+// ForNode recognizes it when folding and runs it here with SIMD kernels, picked for the CPU
+// at runtime. When an element is not a number, or the elements of a table mix integers and
+// floats, the loop runs as written instead.
+//
+// A sum of floats is reassociated: the kernels keep a partial sum per SIMD lane, so it may round
+// differently from the loop's additions in order, by about as much as the order of the elements
+// would change it. Every other result is the one the loop would compute.
+class NumericLoop
+{
+private:
+	enum Operation { ADD, SUBTRACT, MULTIPLY };
+
+	struct Operand
+	{
+		std::string table; // Set for an element table[i]
+		std::string variable; // Set for a variable the loop does not assign
+		Expression* constant;
+	};
+
+	// The numbers an operand takes over the loop's range
+	struct Lane
+	{
+		bool isInteger;
+		std::vector<int> integers;
+		std::vector<float> reals;
+	};
+
+	std::string counter;
+	std::string accumulator; // Empty when the loop stores into destination[i]
+	std::string destination;
+	Operand left;
+	Operand right;
+	bool hasRight;
+	Operation operation;
+
+	Lane lanes[3]; // Kept between runs so their storage is reused
+
+	// What the last run of a map stored, from element storedStart of the table on
+	TableNode* stored;
+	int storedStart;
+	unsigned long long storedEpoch;
+	std::vector<Expression*> storedElements;
+
+	NumericLoop();
+
+	bool matchOperand(Node* node, Operand& operand);
+	bool load(Environment* environment, const Operand& operand, int start, int limit, Lane& lane);
+	void combine(Lane& leftLane, Lane& rightLane, Lane& result);
+	void store(Environment* environment, TableNode* table, int start, const Lane& lane);
+	Expression* reduce(Expression* initial, Lane& lane);
+
+public:
+	static NumericLoop* match(const std::string& counter, Statement* body);
+
+	bool run(Environment* environment, int start, int limit);
+};
+
+#endif
@@ -0,0 +1,128 @@
+#include "Optimizer.h"
+#include "Inliner.h"
+#include "Memoizer.h"
+#include "ValueNumbering.h"
+#include "globals.h"
+
+
+Optimizer::Optimizer(Environment* environment, long unsigned int threads) : pool(threads)
+{
+	this->environment = environment;
+}
+
+Statement* Optimizer::run(Statement* root)
+{
+	return optimize(root, true);
+}
+
+// Part of the main chunk, a statement run before the rest is parsed (./parser stream) or the
+// statements reparsed after an edit (./parser reload). The rest of the program is unknown, so
+// no function is known to be pure and nothing is cached. Inlined calls check at runtime that
+// the function is the one inlined, so inlining stays
+Statement* Optimizer::runPart(Statement* part)
+{
+	return optimize(part, false);
+}
+
+// A function body parsed on the first call of the function (./parser lazy), numbered as the
+// unit it would have been. Only the functions defined in it are known to inlining
+void Optimizer::runBody(FunctionNode* function, int line)
+{
+	units.clear();
+
+	fold(function);
+	pool.wait();
+
+	Inliner(environment).run(function->body());
+
+	units.push_back({ function, line, "", {}, {} });
+	Unit& unit = units.back();
+	pool.submit([this, &unit] { number(unit, nullptr); });
+	pool.wait();
+
+	print(unit);
+}
+
+Statement* Optimizer::optimize(Statement* root, bool isWhole)
+{
+	units.clear();
+
+	root = root->fold();
+	submitFolds(root);
+	pool.wait();
+
+	Inliner(environment).run(root);
+	if (memo_capacity && isWhole)
+		Memoizer(environment).run(root, memo_capacity);
+
+	units.push_back({ nullptr, 0, "", {}, {} });
+	Unit& main = units.back();
+	pool.submit([this, &main, root] { number(main, root); });
+	pool.wait();
+
+	print(main);
+	temporaries = std::move(main.temporaries);
+
+	return root;
+}
+
+// The functions defined below the node, their bodies not folded yet
+void Optimizer::submitFolds(Node* node)
+{
+	for (auto child : node->children)
+	{
+		if (child->tag == "FunctionNode")
+		{
+			FunctionNode* function = static_cast<FunctionNode*>(child);
+			pool.submit([this, function] { fold(function); });
+		}
+		else
+			submitFolds(child);
+	}
+}
+
+void Optimizer::fold(FunctionNode* function)
+{
+	function->foldBody();
+	if (function->body())
+		submitFolds(function->body());
+}
+
+void Optimizer::number(Unit& unit, Statement* root)
+{
+	ValueNumbering numbering(environment);
+	if (unit.function)
+		numbering.run(unit.function, unit.line, unit.indentation);
+	else
+		numbering.run(root);
+
+	unit.dumped = std::move(numbering.dumped);
+	unit.temporaries = std::move(numbering.temporaries);
+
+	for (auto& nested : numbering.nested)
+	{
+		Unit* child = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			units.push_back({ nested.function, nested.line, nested.indentation, {}, {} });
+			child = &units.back();
+		}
+
+		unit.nested.push_back({ nested.position, child });
+		pool.submit([this, child] { number(*child, nullptr); });
+	}
+}
+
+void Optimizer::print(const Unit& unit)
+{
+	environment->output.flush(); // A body compiled on its call dumps after what ran before
+	auto nested = unit.nested.begin();
+	for (long unsigned int i = 0; i <= unit.dumped.size(); i++)
+	{
+		for (; nested != unit.nested.end() && nested->first == i; nested++)
+			print(*nested->second);
+
+		if (i < unit.dumped.size())
+			std::cout << unit.dumped[i] << '\n';
+	}
+}
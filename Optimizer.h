@@ -0,0 +1,60 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ThreadPool.h"
+
+class Environment;
+class FunctionNode;
+class Node;
+class Statement;
+class TemporaryNode;
+
+// The passes run once after parsing.
+//
+// The main chunk and every function body are units of their own: folding and value numbering
+// a body touch nothing outside it, so the units run on a ThreadPool (./parser jobs=N, one
+// thread per core by default). A unit's nested functions are submitted once it is done with
+// them. Inlining and caching look at the whole program and run in between, on one thread.
+// Numbering keeps what it dumps per unit, and it is printed in source order, so the output
+// is the same for any number of threads.
+class Optimizer
+{
+private:
+	struct Unit
+	{
+		FunctionNode* function; // Null for the main chunk
+		int line;
+		std::string indentation;
+		std::vector<std::string> dumped;
+		std::vector<std::pair<long unsigned int, Unit*>> nested; // Dumped before the line at that index
+		std::vector<TemporaryNode*> temporaries;
+	};
+
+	Environment* environment;
+	ThreadPool pool;
+	std::mutex mutex;
+	std::deque<Unit> units; // Grows from every thread, a deque keeps the units in place
+
+	Statement* optimize(Statement* root, bool isWhole);
+	void submitFolds(Node* node);
+	void fold(FunctionNode* function);
+	void number(Unit& unit, Statement* root);
+	void print(const Unit& unit);
+
+public:
+	std::vector<TemporaryNode*> temporaries; // Numbering put in the main chunk last optimized, freed with it when streamed
+
+	Optimizer(Environment* environment, long unsigned int threads);
+
+	Statement* run(Statement* root);
+	Statement* runPart(Statement* part);
+	void runBody(FunctionNode* function, int line);
+};
+
+#endif
@@ -0,0 +1,262 @@
+#include "Output.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+
+// "00" to "99", so two digits take one division
+static const char digitPairs[] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+
+
+Output::Output()
+{
+	this->buffer.resize(capacity);
+	this->used = 0;
+	this->captured = nullptr;
+}
+
+Output::~Output()
+{
+	flush();
+}
+
+void Output::write(const char* text, long unsigned int length)
+{
+	if (used + length > capacity)
+	{
+		flush();
+		if (length > capacity) // Would not fit anyway
+		{
+			if (captured)
+				captured->append(text, length);
+			else
+				fwrite(text, 1, length, stdout);
+			return;
+		}
+	}
+
+	memcpy(buffer.data() + used, text, length);
+	used += length;
+}
+
+void Output::write(const std::string& text)
+{
+	write(text.data(), text.size());
+}
+
+void Output::put(char character)
+{
+	if (used == capacity)
+		flush();
+
+	buffer[used++] = character;
+}
+
+void Output::writeInteger(int value)
+{
+	char text[32];
+	write(text, formatInteger(value, text));
+}
+
+void Output::writeFloat(float value)
+{
+	char text[32];
+	write(text, formatFloat(value, text));
+}
+
+// Writes out what is buffered, behind what std::cout printed before
+void Output::flush()
+{
+	if (used == 0)
+		return;
+
+	if (captured)
+		captured->append(buffer.data(), used);
+	else
+	{
+		fwrite(buffer.data(), 1, used, stdout);
+		fflush(stdout);
+	}
+	used = 0;
+}
+
+// Flushes into text from now on, or to stdout again when it is null
+void Output::capture(std::string* text)
+{
+	flush();
+	captured = text;
+}
+
+// The digits from the last, two at a time
+long unsigned int Output::formatInteger(int value, char* text)
+{
+	char digits[16];
+	char* end = digits + sizeof(digits);
+	char* position = end;
+
+	unsigned int number = value < 0 ? 0u - static_cast<unsigned int>(value) : value;
+	while (number >= 100)
+	{
+		unsigned int pair = (number % 100) * 2;
+		number /= 100;
+		*--position = digitPairs[pair + 1];
+		*--position = digitPairs[pair];
+	}
+
+	if (number >= 10)
+	{
+		*--position = digitPairs[number * 2 + 1];
+		*--position = digitPairs[number * 2];
+	}
+	else
+		*--position = '0' + number;
+
+	if (value < 0)
+		*--position = '-';
+
+	memcpy(text, position, end - position);
+	return end - position;
+}
+
+// Exact up to 1e22, the rest within an ulp
+static const double powers[] =
+{
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19,
+	1e20, 1e21, 1e22, 1e23, 1e24, 1e25, 1e26, 1e27, 1e28, 1e29, 1e30, 1e31, 1e32, 1e33, 1e34, 1e35, 1e36, 1e37, 1e38, 1e39,
+	1e40, 1e41, 1e42, 1e43, 1e44, 1e45, 1e46, 1e47, 1e48, 1e49, 1e50, 1e51, 1e52, 1e53, 1e54, 1e55, 1e56, 1e57, 1e58, 1e59, 1e60
+};
+
+// number * 10^power, rounded once
+static double scaled(double number, int power)
+{
+	return power >= 0 ? number * powers[power] : number / powers[-power];
+}
+
+// Whether digits, scaled by power as the bounds of value are, lie between them. Scaling rounds,
+// so within some ulps of a bound only reading the digits back tells
+static bool isWithin(double digits, double lowest, double highest, int power, float value)
+{
+	const double margin = 1e-15;
+	if (digits > lowest * (1 + margin) && digits < highest * (1 - margin))
+		return true;
+	if (digits < lowest * (1 - margin) || digits > highest * (1 + margin))
+		return false;
+
+	char text[32];
+	snprintf(text, sizeof(text), "%.0fe%d", digits, -power);
+	return std::strtof(text, nullptr) == value;
+}
+
+// The fewest digits that read back as the same float, laid out as Lua's %.14g lays out a
+// double. Lua's 14 digits of a float would print its error: 0.1 as 0.10000000149012.
+//
+// The reals that round to the float lie halfway to its neighbours, which a double holds
+// exactly. For 1 digit and up, the number scaled to that many digits is rounded, and taken
+// when it is within those bounds, scaled too. 9 digits always are
+long unsigned int Output::formatFloat(float value, char* text)
+{
+	if (std::isnan(value) || std::isinf(value))
+		return snprintf(text, 32, "%g", value);
+
+	char* position = text;
+	if (std::signbit(value))
+		*position++ = '-';
+
+	float magnitude = std::fabs(value);
+	if (magnitude == 0.0f)
+	{
+		memcpy(position, "0.0", 3);
+		return position + 3 - text;
+	}
+
+	double number = magnitude;
+	double above = std::nextafter(magnitude, INFINITY);
+	double below = std::nextafter(magnitude, 0.0f);
+	double high = std::isinf(above) ? number + (number - below) / 2 : (number + above) / 2;
+	double low = (number + below) / 2;
+
+	int exponent = static_cast<int>(std::floor(std::log10(number)));
+	if (number < scaled(1.0, exponent))
+		exponent--;
+	else if (number >= scaled(1.0, exponent + 1))
+		exponent++;
+
+	unsigned int digits = 0;
+	for (int precision = 1; precision <= 9; precision++)
+	{
+		int power = precision - 1 - exponent;
+		double target = scaled(number, power);
+		double lowest = scaled(low, power);
+		double highest = scaled(high, power);
+
+		double nearest = std::floor(target + 0.5);
+		double other = nearest > target ? nearest - 1 : nearest + 1; // Nearer to the wider bound below a power of 2
+		if (isWithin(nearest, lowest, highest, power, magnitude))
+			digits = nearest;
+		else if (isWithin(other, lowest, highest, power, magnitude))
+			digits = other;
+		else if (precision == 9)
+			digits = nearest;
+		else
+			continue;
+
+		if (digits == powers[precision]) // Rounded up to a digit more
+		{
+			digits /= 10;
+			exponent++;
+		}
+		break;
+	}
+
+	char significand[16];
+	long unsigned int length = formatInteger(digits, significand);
+	while (length > 1 && significand[length - 1] == '0')
+		length--;
+
+	if (exponent < -4 || exponent >= 14)
+	{
+		*position++ = significand[0];
+		if (length > 1)
+		{
+			*position++ = '.';
+			memcpy(position, significand + 1, length - 1);
+			position += length - 1;
+		}
+		*position++ = 'e';
+		*position++ = exponent < 0 ? '-' : '+';
+		int shown = std::abs(exponent);
+		if (shown < 10)
+			*position++ = '0';
+		position += formatInteger(shown, position);
+	}
+	else if (exponent >= 0)
+	{
+		for (int i = 0; i <= exponent; i++)
+			*position++ = static_cast<long unsigned int>(i) < length ? significand[i] : '0';
+		*position++ = '.'; // An integral float keeps its point, as in Lua: 3.0, not the 3 of an integer
+		if (length > static_cast<long unsigned int>(exponent) + 1)
+		{
+			memcpy(position, significand + exponent + 1, length - exponent - 1);
+			position += length - exponent - 1;
+		}
+		else
+			*position++ = '0';
+	}
+	else
+	{
+		*position++ = '0';
+		*position++ = '.';
+		for (int i = -1; i > exponent; i--)
+			*position++ = '0';
+		memcpy(position, significand, length);
+		position += length;
+	}
+
+	return position - text;
+}
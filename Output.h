@@ -0,0 +1,37 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <string>
+#include <vector>
+
+// What a script prints, kept in a buffer of its environment and written to stdout when the
+// buffer fills or at a flush point: before anything else is printed, before a streamed source
+// is read from a terminal, and at exit. Numbers are formatted straight into the buffer. A shard
+// of ./parser each-line captures its output instead, to be written in the order of the input
+class Output
+{
+private:
+	static const long unsigned int capacity = 1 << 16;
+
+	std::vector<char> buffer;
+	long unsigned int used;
+	std::string* captured; // Where flushing appends instead of writing to stdout, when set
+
+public:
+	Output();
+	~Output();
+
+	void write(const char* text, long unsigned int length);
+	void write(const std::string& text);
+	void put(char character);
+	void writeInteger(int value);
+	void writeFloat(float value);
+	void flush();
+	void capture(std::string* text);
+
+	// Return the length written to text, which has room for 32 characters
+	static long unsigned int formatInteger(int value, char* text);
+	static long unsigned int formatFloat(float value, char* text);
+};
+
+#endif
@@ -0,0 +1,212 @@
+#include "Records.h"
+#include "Compilation.h"
+#include "Environment.h"
+#include "Nodes.h"
+#include "ThreadPool.h"
+#include "globals.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+
+// As main prints it, after what the script printed before
+static std::string describe(Environment* environment, RuntimeError& error)
+{
+	std::string text = "RUNTIME ERROR: " + error.describe(*environment->source, environment->line);
+	environment->unwind(0);
+	return text;
+}
+
+
+
+Records::Records() {}
+
+Records::~Records() {}
+
+// Parses the file once in every environment, each becoming a state, the states at once and
+// sharing the threads jobs= gives between their optimizers. False, having printed the syntax
+// errors once, when it does not parse
+bool Records::parse(const std::string& file, const std::vector<Environment*>& environments)
+{
+	FILE* source = fopen(file.c_str(), "rb");
+	if (!source)
+	{
+		std::cout << "It's one of the bad ones... " << file << ": can not open\n";
+		return false;
+	}
+
+	long unsigned int jobs = std::max(1ul, compile_jobs / environments.size());
+	for (auto environment : environments)
+	{
+		State* state = new State();
+		states.emplace_back(state);
+		state->environment = environment;
+		state->compilation.reset(new Compilation(file, jobs, environment));
+		if (states.size() == 1)
+			state->compilation->load(source);
+		else
+			state->compilation->load(states[0]->compilation->source.data(), states[0]->compilation->length);
+
+		// Declared before the passes run, so they take line for the global it is
+		state->line = new StringNode("");
+		state->line->isUpdatedInPlace = true;
+		state->slot = &environment->declare("line", state->line);
+	}
+	fclose(source);
+
+	// Once every state has its copy of the source, as flex's scanner writes to the one it scans
+	ThreadPool pool(states.size());
+	for (auto& state : states)
+	{
+		Compilation* compilation = state->compilation.get();
+		pool.submit([compilation] { compilation->parse(); });
+	}
+	pool.wait();
+
+	for (auto& error : states[0]->compilation->errors)
+		std::cout << error << '\n';
+	return states[0]->compilation->errors.empty();
+}
+
+// Reads the lines from the file instead of stdin
+bool Records::open(const std::string& path)
+{
+	if (states.size() == 1)
+		return states[0]->environment->input.open(path);
+
+	return input.open(path);
+}
+
+int Records::run()
+{
+	if (states.size() == 1)
+		return runAlone();
+
+	return runSharded();
+}
+
+// Runs the main chunk for a line. A return ends the line's run, as next does in awk
+void Records::record(State* state, const char* text, long unsigned int length)
+{
+	state->line->setValue(text, length);
+	*state->slot = state->line; // The last line's run may have assigned to line
+
+	state->environment->source = state->compilation->sourceName;
+	if (state->compilation->root)
+		state->compilation->root->execute();
+
+	state->environment->controlFlow = Environment::ControlFlow::NORMAL;
+}
+
+// Runs the lines of a block, false with the error of the one that failed
+bool Records::run(State* state, const std::string& text, std::string& error)
+{
+	const char* position = text.data();
+	const char* end = position + text.size();
+	try
+	{
+		while (position != end)
+		{
+			const char* newline = static_cast<const char*>(memchr(position, '\n', end - position));
+			const char* stop = newline ? newline : end;
+			record(state, position, stop - position);
+			position = newline ? newline + 1 : end;
+		}
+	}
+	catch (RuntimeError& runtimeError)
+	{
+		error = describe(state->environment, runtimeError);
+		return false;
+	}
+
+	return true;
+}
+
+// The state reads the lines through its own input, so io.read in the script takes the next ones
+int Records::runAlone()
+{
+	State* state = states[0].get();
+	Environment* environment = state->environment;
+
+	const char* text = nullptr;
+	long unsigned int length = 0;
+	try
+	{
+		while (environment->input.line(text, length))
+			record(state, text, length);
+	}
+	catch (RuntimeError& error)
+	{
+		std::string message = describe(environment, error);
+		environment->output.flush();
+		std::cout << message << '\n';
+		return 1;
+	}
+
+	environment->output.flush();
+	return 0;
+}
+
+// Reads a batch of blocks, a few for every state, runs them on the pool and writes what they
+// printed in order, then reads the next batch. Block i of a batch runs in state i % shards, the
+// blocks of a state in order, so what the script keeps in globals does not depend on which thread
+// was free. The first error is printed after the output of the lines before it, and ends the run
+int Records::runSharded()
+{
+	for (auto& state : states)
+		state->environment->input.close(); // The lines are read here
+
+	ThreadPool pool(states.size());
+	std::vector<Block> blocks(4 * states.size());
+
+	while (true)
+	{
+		long unsigned int count = 0;
+		const char* text = nullptr;
+		long unsigned int length = 0;
+		while (count < blocks.size() && input.lines(blockSize, text, length))
+		{
+			blocks[count].text.assign(text, length);
+			blocks[count].output.clear();
+			blocks[count].error.clear();
+			count++;
+		}
+
+		if (count == 0)
+			break;
+
+		for (long unsigned int shard = 0; shard < states.size() && shard < count; shard++)
+		{
+			pool.submit([this, &blocks, count, shard]
+			{
+				State* state = states[shard].get();
+				for (long unsigned int i = shard; i < count; i += states.size())
+				{
+					Block& block = blocks[i];
+					state->environment->output.capture(&block.output);
+					bool isRun = run(state, block.text, block.error);
+					state->environment->output.capture(nullptr);
+					if (!isRun)
+						break; // The blocks after it are not written
+				}
+			});
+		}
+		pool.wait();
+
+		for (long unsigned int i = 0; i < count; i++)
+		{
+			fwrite(blocks[i].output.data(), 1, blocks[i].output.size(), stdout);
+			if (!blocks[i].error.empty())
+			{
+				fflush(stdout);
+				std::cout << blocks[i].error << '\n';
+				return 1;
+			}
+		}
+		fflush(stdout);
+	}
+
+	return 0;
+}
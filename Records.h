@@ -0,0 +1,64 @@
+#ifndef RECORDS_H
+#define RECORDS_H
+
+#include "Input.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+class Compilation;
+class Environment;
+class Expression;
+class StringNode;
+
+// Runs a script for every line of stdin, awk-style (./parser each-line=file). The script is
+// read once, then parsed and optimized once per state: the nodes of a tree keep what they
+// computed last (the result an assignment overwrites, loop counters, the values numbering
+// reuses), so two threads can not run one tree. Its main chunk runs for each line with the line
+// in the global `line`, and its globals live on from one line to the next. A line is read into
+// the same string every time, copied only where the script stores it.
+//
+// One state reads the lines itself, so io.read in the script takes the ones after it. With
+// shards=N, N states each run blocks of whole lines on a thread of the pool, and the output of
+// every block is captured and written in the order of the input. Block i of the input runs in
+// state i % N. The states do not share globals, so what a script counts across lines it counts
+// per state, the same for every run
+class Records
+{
+private:
+	static const long unsigned int blockSize = 1 << 20;
+
+	struct State
+	{
+		Environment* environment;
+		std::unique_ptr<Compilation> compilation;
+		StringNode* line;
+		Expression** slot; // Of the global line
+	};
+
+	struct Block
+	{
+		std::string text;
+		std::string output;
+		std::string error; // Of the line that failed, which ends the run
+	};
+
+	std::vector<std::unique_ptr<State>> states;
+	Input input; // Of the shards, a single state reads its own
+
+	void record(State* state, const char* text, long unsigned int length);
+	bool run(State* state, const std::string& text, std::string& error);
+	int runAlone();
+	int runSharded();
+
+public:
+	Records();
+	~Records();
+
+	bool parse(const std::string& file, const std::vector<Environment*>& environments);
+	bool open(const std::string& path);
+	int run();
+};
+
+#endif
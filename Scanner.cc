@@ -0,0 +1,452 @@
+#include "Scanner.h"
+#include "Compilation.h"
+#include "Lexeme.h"
+#include "globals.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCANNER_X86
+#include <immintrin.h>
+#endif
+
+
+static_assert(Compilation::padding >= 32, "a block read starting before the end must stay inside the source");
+
+typedef yy::parser::symbol_type (*MakeToken)(yy::location location);
+
+// Each kernel gives the index of the first of count characters outside its class, or count
+struct Kernels
+{
+	long unsigned int (*whitespace)(const char* text, long unsigned int count);
+	long unsigned int (*name)(const char* text, long unsigned int count);
+	long unsigned int (*until)(const char* text, long unsigned int count, char stop);
+};
+
+static bool isWhitespace(char character)
+{
+	return character == ' ' || character == '\t' || character == '\n';
+}
+
+static bool isNameCharacter(char character)
+{
+	return (character >= 'a' && character <= 'z') || (character >= 'A' && character <= 'Z')
+		|| (character >= '0' && character <= '9') || character == '_';
+}
+
+static long unsigned int spanWhitespace(const char* text, long unsigned int count)
+{
+	long unsigned int i = 0;
+	while (i < count && isWhitespace(text[i]))
+		i++;
+
+	return i;
+}
+
+static long unsigned int spanName(const char* text, long unsigned int count)
+{
+	long unsigned int i = 0;
+	while (i < count && isNameCharacter(text[i]))
+		i++;
+
+	return i;
+}
+
+static long unsigned int spanUntil(const char* text, long unsigned int count, char stop)
+{
+	const void* found = std::memchr(text, stop, count);
+	return found ? static_cast<const char*>(found) - text : count;
+}
+
+#ifdef SCANNER_X86
+
+// The index of the first clear bit of a block's mask, the block starting at i
+static long unsigned int firstOutside(long unsigned int i, unsigned int mask, long unsigned int count)
+{
+	long unsigned int index = i + __builtin_ctz(~mask);
+	return index < count ? index : count;
+}
+
+__attribute__((target("sse2")))
+static long unsigned int spanWhitespaceSse2(const char* text, long unsigned int count)
+{
+	const __m128i space = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t'), newline = _mm_set1_epi8('\n');
+	for (long unsigned int i = 0; i < count; i += 16)
+	{
+		__m128i block = _mm_loadu_si128((const __m128i*)(text + i));
+		__m128i matches = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, space), _mm_cmpeq_epi8(block, tab)), _mm_cmpeq_epi8(block, newline));
+		unsigned int mask = _mm_movemask_epi8(matches) | 0xFFFF0000;
+		if (mask != 0xFFFFFFFF)
+			return firstOutside(i, mask, count);
+	}
+
+	return count;
+}
+
+// Signed compares, so bytes from 0x80 up are below every range
+__attribute__((target("sse2")))
+static long unsigned int spanNameSse2(const char* text, long unsigned int count)
+{
+	const __m128i beforeDigits = _mm_set1_epi8('0' - 1), afterDigits = _mm_set1_epi8('9' + 1);
+	const __m128i beforeLetters = _mm_set1_epi8('a' - 1), afterLetters = _mm_set1_epi8('z' + 1);
+	const __m128i lowerCase = _mm_set1_epi8(0x20), underscore = _mm_set1_epi8('_');
+	for (long unsigned int i = 0; i < count; i += 16)
+	{
+		__m128i block = _mm_loadu_si128((const __m128i*)(text + i));
+		__m128i lower = _mm_or_si128(block, lowerCase);
+		__m128i digits = _mm_and_si128(_mm_cmpgt_epi8(block, beforeDigits), _mm_cmplt_epi8(block, afterDigits));
+		__m128i letters = _mm_and_si128(_mm_cmpgt_epi8(lower, beforeLetters), _mm_cmplt_epi8(lower, afterLetters));
+		__m128i matches = _mm_or_si128(_mm_or_si128(digits, letters), _mm_cmpeq_epi8(block, underscore));
+		unsigned int mask = _mm_movemask_epi8(matches) | 0xFFFF0000;
+		if (mask != 0xFFFFFFFF)
+			return firstOutside(i, mask, count);
+	}
+
+	return count;
+}
+
+__attribute__((target("sse2")))
+static long unsigned int spanUntilSse2(const char* text, long unsigned int count, char stop)
+{
+	const __m128i stops = _mm_set1_epi8(stop);
+	for (long unsigned int i = 0; i < count; i += 16)
+	{
+		__m128i block = _mm_loadu_si128((const __m128i*)(text + i));
+		unsigned int mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(block, stops)) | 0xFFFF0000;
+		if (mask != 0xFFFFFFFF)
+			return firstOutside(i, mask, count);
+	}
+
+	return count;
+}
+
+__attribute__((target("avx2")))
+static long unsigned int spanWhitespaceAvx2(const char* text, long unsigned int count)
+{
+	const __m256i space = _mm256_set1_epi8(' '), tab = _mm256_set1_epi8('\t'), newline = _mm256_set1_epi8('\n');
+	for (long unsigned int i = 0; i < count; i += 32)
+	{
+		__m256i block = _mm256_loadu_si256((const __m256i*)(text + i));
+		__m256i matches = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, space), _mm256_cmpeq_epi8(block, tab)), _mm256_cmpeq_epi8(block, newline));
+		unsigned int mask = _mm256_movemask_epi8(matches);
+		if (mask != 0xFFFFFFFF)
+			return firstOutside(i, mask, count);
+	}
+
+	return count;
+}
+
+__attribute__((target("avx2")))
+static long unsigned int spanNameAvx2(const char* text, long unsigned int count)
+{
+	const __m256i beforeDigits = _mm256_set1_epi8('0' - 1), afterDigits = _mm256_set1_epi8('9' + 1);
+	const __m256i beforeLetters = _mm256_set1_epi8('a' - 1), afterLetters = _mm256_set1_epi8('z' + 1);
+	const __m256i lowerCase = _mm256_set1_epi8(0x20), underscore = _mm256_set1_epi8('_');
+	for (long unsigned int i = 0; i < count; i += 32)
+	{
+		__m256i block = _mm256_loadu_si256((const __m256i*)(text + i));
+		__m256i lower = _mm256_or_si256(block, lowerCase);
+		__m256i digits = _mm256_and_si256(_mm256_cmpgt_epi8(block, beforeDigits), _mm256_cmpgt_epi8(afterDigits, block));
+		__m256i letters = _mm256_and_si256(_mm256_cmpgt_epi8(lower, beforeLetters), _mm256_cmpgt_epi8(afterLetters, lower));
+		__m256i matches = _mm256_or_si256(_mm256_or_si256(digits, letters), _mm256_cmpeq_epi8(block, underscore));
+		unsigned int mask = _mm256_movemask_epi8(matches);
+		if (mask != 0xFFFFFFFF)
+			return firstOutside(i, mask, count);
+	}
+
+	return count;
+}
+
+__attribute__((target("avx2")))
+static long unsigned int spanUntilAvx2(const char* text, long unsigned int count, char stop)
+{
+	const __m256i stops = _mm256_set1_epi8(stop);
+	for (long unsigned int i = 0; i < count; i += 32)
+	{
+		__m256i block = _mm256_loadu_si256((const __m256i*)(text + i));
+		unsigned int mask = ~static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, stops)));
+		if (mask != 0xFFFFFFFF)
+			return firstOutside(i, mask, count);
+	}
+
+	return count;
+}
+
+#endif
+
+static Kernels selectKernels()
+{
+#ifdef SCANNER_X86
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2"))
+		return { spanWhitespaceAvx2, spanNameAvx2, spanUntilAvx2 };
+
+	if (__builtin_cpu_supports("sse2"))
+		return { spanWhitespaceSse2, spanNameSse2, spanUntilSse2 };
+#endif
+
+	return { spanWhitespace, spanName, spanUntil };
+}
+
+static const Kernels& kernels()
+{
+	static const Kernels selected = selectKernels();
+	return selected;
+}
+
+static void log_lexer(const char* text, long unsigned int length)
+{
+	if (debug_lex)
+		std::cout << "LEX:\t\t " << std::string(text, length) << '\n';
+}
+
+
+
+Scanner::Scanner(Compilation& compilation) : compilation(compilation), location(compilation.location)
+{
+	this->source = compilation.source.data();
+	this->position = 0;
+	this->end = compilation.length;
+}
+
+yy::parser::symbol_type Scanner::next()
+{
+	location.step();
+
+	while (true)
+	{
+		if (position >= compilation.complete && compilation.input) // A token may go on past the end
+			refill();
+		if (position >= end)
+			break;
+
+		char character = source[position];
+		if (isWhitespace(character))
+			skipWhitespace();
+		else if (character == '-' && source[position + 1] == '-')
+			skipComment();
+		else if (isNameCharacter(character) && !(character >= '0' && character <= '9'))
+			return name();
+		else if ((character >= '0' && character <= '9') || (character == '-' && source[position + 1] >= '0' && source[position + 1] <= '9'))
+			return number();
+		else
+		{
+			yy::parser::symbol_type token = symbol();
+			if (token.kind() != yy::parser::symbol_kind::S_YYUNDEF)
+				return token;
+		}
+	}
+
+	return yy::parser::make_EXIT(location);
+}
+
+// Reads on in a streamed source, which drops what is before the current token. False at its end
+bool Scanner::refill()
+{
+	if (!compilation.input)
+		return false;
+
+	bool isRead = compilation.refill(position);
+	source = compilation.source.data();
+	position = 0;
+	end = compilation.length;
+
+	return isRead;
+}
+
+// Lines and columns as flex's rules for runs of spaces, tabs and newlines leave them
+void Scanner::skipWhitespace()
+{
+	const char* text = source + position;
+	long unsigned int length = kernels().whitespace(text, end - position);
+
+	newlines(text, length);
+	log_lexer(text, length);
+	location.step();
+	position += length;
+}
+
+// Moves the location over the text, onto the line after its last newline
+void Scanner::newlines(const char* text, long unsigned int length)
+{
+	long unsigned int lines = 0, afterNewline = length;
+	for (long unsigned int i = 0; i < length; i++)
+	{
+		if (text[i] == '\n')
+		{
+			lines++;
+			afterNewline = length - i - 1;
+		}
+	}
+
+	if (lines)
+	{
+		location.lines(lines);
+		location.columns(afterNewline);
+	}
+	else
+		location.columns(length);
+}
+
+void Scanner::skipComment()
+{
+	const char* text = source + position;
+	long unsigned int length = kernels().until(text, end - position, '\n');
+
+	log_lexer(text, length);
+	location.columns(length);
+	location.step();
+	position += length;
+}
+
+yy::parser::symbol_type Scanner::name()
+{
+	static const struct { const char* text; long unsigned int length; MakeToken make; } keywords[] =
+	{
+		{ "if", 2, yy::parser::make_IF }, { "then", 4, yy::parser::make_THEN }, { "elseif", 6, yy::parser::make_ELSEIF },
+		{ "else", 4, yy::parser::make_ELSE }, { "for", 3, yy::parser::make_FOR }, { "while", 5, yy::parser::make_WHILE },
+		{ "repeat", 6, yy::parser::make_REPEAT }, { "do", 2, yy::parser::make_DO }, { "until", 5, yy::parser::make_UNTIL },
+		{ "end", 3, yy::parser::make_END }, { "in", 2, yy::parser::make_IN }, { "not", 3, yy::parser::make_NOT },
+		{ "and", 3, yy::parser::make_AND }, { "or", 2, yy::parser::make_OR }, { "local", 5, yy::parser::make_LOCAL },
+		{ "function", 8, yy::parser::make_FUNCTION }, { "break", 5, yy::parser::make_BREAK }, { "return", 6, yy::parser::make_RETURN },
+		{ "print", 5, yy::parser::make_PRINT }, { "nil", 3, yy::parser::make_NIL }, { "false", 5, yy::parser::make_FALSE },
+		{ "true", 4, yy::parser::make_TRUE }
+	};
+
+	const char* text = source + position;
+	long unsigned int length = kernels().name(text, end - position);
+	position += length;
+	location.columns(length);
+	log_lexer(text, length);
+
+	for (auto& keyword : keywords)
+		if (keyword.length == length && keyword.text[0] == text[0] && std::memcmp(keyword.text, text, length) == 0)
+			return keyword.make(location);
+
+	return yy::parser::make_VAR(compilation.lexeme(text, length), location);
+}
+
+// [0-9]+\.[0-9]+ or -?[0-9]+, whichever is longer
+yy::parser::symbol_type Scanner::number()
+{
+	const char* text = source + position;
+	long unsigned int length = text[0] == '-' ? 1 : 0;
+	while (text[length] >= '0' && text[length] <= '9')
+		length++;
+
+	bool isFloat = text[0] != '-' && text[length] == '.' && text[length + 1] >= '0' && text[length + 1] <= '9';
+	if (isFloat)
+	{
+		length++;
+		while (text[length] >= '0' && text[length] <= '9')
+			length++;
+	}
+
+	position += length;
+	location.columns(length);
+	log_lexer(text, length);
+
+	int integer = 0;
+	if (!isFloat && parseInteger(text, length, integer))
+		return yy::parser::make_INTEGER(integer, location);
+
+	return yy::parser::make_FLOAT(parseFloat(text, length), location); // Too big for an int, as in Lua
+}
+
+// Strings, operators and punctuation. Gives YYUNDEF for a character flex would echo, which
+// next() skips as flex's default rule does, scanning on
+yy::parser::symbol_type Scanner::symbol()
+{
+	const char* text = source + position;
+
+	if (text[0] == '"')
+	{
+		long unsigned int length = kernels().until(text + 1, end - position - 1, '"') + 1;
+		while (position + length >= end && refill()) // Strings can span lines
+		{
+			text = source + position;
+			length = kernels().until(text + 1, end - position - 1, '"') + 1;
+		}
+
+		if (position + length < end)
+		{
+			position += length + 1;
+			newlines(text, length + 1);
+			log_lexer(text, length + 1);
+			return yy::parser::make_STRING(compilation.lexeme(text + 1, length - 1), location);
+		}
+	}
+
+	char second = position + 1 < end ? text[1] : '\0';
+	MakeToken make = nullptr;
+	if (second == '=')
+	{
+		switch (text[0])
+		{
+			case '=': make = yy::parser::make_EQUALS; break;
+			case '!': make = yy::parser::make_NOT_EQUALS; break;
+			case '<': make = yy::parser::make_LESS_OR_EQUAL; break;
+			case '>': make = yy::parser::make_MORE_OR_EQUAL; break;
+			case '~': make = yy::parser::make_TILDE_EQUAL; break;
+		}
+	}
+
+	long unsigned int length = make ? 2 : 1;
+	if (!make)
+	{
+		switch (text[0])
+		{
+			case '+': make = yy::parser::make_PLUS; break;
+			case '-': make = yy::parser::make_MINUS; break;
+			case '*': make = yy::parser::make_MUL; break;
+			case '/': make = yy::parser::make_DIV; break;
+			case '^': make = yy::parser::make_POWER_OF; break;
+			case '%': make = yy::parser::make_MOD; break;
+			case '<': make = yy::parser::make_LESS; break;
+			case '>': make = yy::parser::make_MORE; break;
+			case '#': make = yy::parser::make_HASHTAG; break;
+			case '=': make = yy::parser::make_ASSIGNMENT; break;
+			case '.': make = yy::parser::make_DOT; break;
+			case ':': make = yy::parser::make_COLON; break;
+			case ';': make = yy::parser::make_SEMICOLON; break;
+			case ',': make = yy::parser::make_COMMA; break;
+			case '(': make = yy::parser::make_LROUND; break;
+			case ')': make = yy::parser::make_RROUND; break;
+			case '[': make = yy::parser::make_LSQUARE; break;
+			case ']': make = yy::parser::make_RSQUARE; break;
+			case '{': make = yy::parser::make_LCURLY; break;
+			case '}': make = yy::parser::make_RCURLY; break;
+		}
+	}
+
+	position += length;
+	location.columns(length);
+
+	if (!make) // flex's default rule, the location keeps the character
+	{
+		fwrite(text, 1, 1, stdout);
+		return yy::parser::make_YYUNDEF(location);
+	}
+
+	log_lexer(text, length);
+	return make(location);
+}
+
+
+
+void openScanner(Compilation& compilation)
+{
+	compilation.scanner = new Scanner(compilation);
+}
+
+void closeScanner(Compilation& compilation)
+{
+	delete static_cast<Scanner*>(compilation.scanner);
+	compilation.scanner = nullptr;
+}
+
+yy::parser::symbol_type nextToken(Compilation& compilation)
+{
+	return static_cast<Scanner*>(compilation.scanner)->next();
+}
@@ -0,0 +1,37 @@
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include "grammar.tab.hh"
+
+class Compilation;
+
+// A hand-written scanner giving the same tokens, text and locations as lexer.ll, linked in
+// its place with make SCANNER=simd (make scanner-check compares the two on testInputs).
+//
+// Runs of whitespace, comments, names and strings are scanned 16 or 32 bytes at a time with
+// SSE2 or AVX2, picked for the CPU at runtime. Like flex, a character no token starts with
+// is echoed to stdout and skipped.
+class Scanner
+{
+private:
+	Compilation& compilation;
+	const char* source; // The compilation's, padded past end so a block read starting before it stays inside
+	long unsigned int position;
+	long unsigned int end;
+	yy::location& location; // The compilation's
+
+	bool refill();
+	void skipWhitespace();
+	void newlines(const char* text, long unsigned int length);
+	void skipComment();
+	yy::parser::symbol_type name();
+	yy::parser::symbol_type number();
+	yy::parser::symbol_type symbol();
+
+public:
+	Scanner(Compilation& compilation);
+
+	yy::parser::symbol_type next();
+};
+
+#endif
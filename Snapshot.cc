@@ -0,0 +1,308 @@
+#include "Snapshot.h"
+#include "Environment.h"
+#include "Nodes.h"
+
+#include <cstring>
+
+
+static const char magic[4] = { '\x1b', 'L', 'u', 's' };
+
+// What a builtin's name, as "pcall" or "io.read", is bound to in the environment
+static Expression* builtin(Environment* environment, const std::string& name)
+{
+	long unsigned int dot = name.find('.');
+	std::string global = name.substr(0, dot);
+	if (!environment->exists(global))
+		return nullptr;
+
+	Expression* value = environment->read(global);
+	if (dot == std::string::npos)
+		return value;
+
+	return value->type == Expression::Type::TABLE ? static_cast<TableNode*>(value)->rawGet(name.substr(dot + 1)) : nullptr;
+}
+
+
+
+Snapshot::Snapshot() : Chunk() {}
+
+// Saves the globals, false when one of them or what they refer to can not be saved
+bool Snapshot::save(const std::string& path, uint64_t hash, Environment* environment)
+{
+	Snapshot snapshot;
+	const std::map<std::string, Expression*>& globals = environment->globals();
+	for (auto& global : globals)
+		snapshot.collect(global.second);
+
+	for (long unsigned int i = 0; i < snapshot.tables.size(); i++) // Grows with the tables found in the ones before
+	{
+		TableNode* table = snapshot.tables[i];
+		if (table->metatable)
+			snapshot.collect(table->metatable);
+
+		snapshot.contents.push_back(table->entries());
+		for (auto& entry : snapshot.contents.back())
+		{
+			snapshot.collect(entry.first);
+			snapshot.collect(entry.second);
+		}
+	}
+
+	uint32_t index = 0;
+	for (auto function : snapshot.functions)
+		snapshot.indices[function] = index++;
+	for (auto table : snapshot.tables)
+		snapshot.indices[table] = index++;
+
+	snapshot.words.push_back(snapshot.functions.size());
+	for (auto function : snapshot.functions)
+	{
+		bool isBuiltin = function->tag == "BuiltinFunctionNode";
+		snapshot.words.push_back(isBuiltin);
+		if (isBuiltin)
+			snapshot.words.push_back(snapshot.intern(function->value));
+		else
+			snapshot.write(function);
+	}
+
+	snapshot.words.push_back(snapshot.tables.size());
+	for (long unsigned int i = 0; i < snapshot.tables.size(); i++)
+	{
+		TableNode* table = snapshot.tables[i];
+		snapshot.writeValue(table->metatable ? table->metatable : NilNode::instance());
+
+		uint32_t count = 0;
+		for (auto& entry : snapshot.contents[i])
+			count += entry.second->type != Expression::Type::NIL;
+
+		snapshot.words.push_back(count);
+		for (auto& entry : snapshot.contents[i])
+		{
+			if (entry.second->type == Expression::Type::NIL)
+				continue;
+
+			snapshot.writeValue(entry.first);
+			snapshot.writeValue(entry.second);
+		}
+	}
+
+	uint32_t count = 0;
+	for (auto& global : globals)
+		count += global.second->type != Expression::Type::NIL;
+
+	snapshot.words.push_back(count);
+	for (auto& global : globals)
+	{
+		if (global.second->type == Expression::Type::NIL)
+			continue;
+
+		snapshot.words.push_back(snapshot.intern(global.first));
+		snapshot.writeValue(global.second);
+	}
+
+	if (snapshot.isBroken)
+		return false;
+
+	return snapshot.saveFile(path, magic, version, hash);
+}
+
+// Writes the globals saved in path to the environment, which has only the base library yet.
+// False, leaving the environment as it was, when there is no such file, or it is from another
+// version, prelude or options, or it is cut short
+bool Snapshot::load(const std::string& path, uint64_t hash, Environment* environment, std::string* source)
+{
+	Snapshot snapshot;
+	snapshot.environment = environment;
+	snapshot.source = source;
+	if (!snapshot.map(path, magic, version, hash))
+	{
+		snapshot.unmap();
+		return false;
+	}
+
+	uint32_t count = snapshot.next();
+	if (count > static_cast<uint32_t>(snapshot.end - snapshot.position))
+		snapshot.isBroken = true;
+
+	for (uint32_t i = 0; i < count && !snapshot.isBroken; i++)
+	{
+		Expression* function = nullptr;
+		if (snapshot.next() != 0) // The environment's own, looked up by name
+		{
+			std::string name = snapshot.string();
+			function = builtin(environment, name);
+			if (!function || function->tag != "BuiltinFunctionNode" || function->value != name)
+				snapshot.isBroken = true;
+		}
+		else
+		{
+			function = snapshot.expression();
+			if (!snapshot.isBroken && function->tag != "FunctionNode")
+				snapshot.isBroken = true;
+			if (!snapshot.isBroken)
+				static_cast<FunctionNode*>(function)->isOptimized = false;
+		}
+
+		snapshot.objects.push_back(function);
+	}
+
+	count = snapshot.next();
+	if (count > static_cast<uint32_t>(snapshot.end - snapshot.position))
+		snapshot.isBroken = true;
+
+	long unsigned int first = snapshot.objects.size();
+	for (uint32_t i = 0; i < count && !snapshot.isBroken; i++)
+		snapshot.objects.push_back(new TableNode());
+
+	for (uint32_t i = 0; i < count && !snapshot.isBroken; i++)
+	{
+		TableNode* table = static_cast<TableNode*>(snapshot.objects[first + i]);
+		Expression* metatable = snapshot.readValue();
+		if (!snapshot.isBroken && metatable->type == Expression::Type::TABLE)
+			table->metatable = static_cast<TableNode*>(metatable);
+		else if (!snapshot.isBroken && metatable->type != Expression::Type::NIL)
+			snapshot.isBroken = true;
+
+		uint32_t entries = snapshot.next();
+		for (uint32_t j = 0; j < entries && !snapshot.isBroken; j++)
+		{
+			Expression* key = snapshot.readValue();
+			Expression* value = snapshot.isBroken ? nullptr : snapshot.readValue();
+			if (snapshot.isBroken)
+				break;
+
+			try
+			{
+				table->rawSet(key, value);
+			}
+			catch (RuntimeError&) // A nil key, or a float one that is no integer
+			{
+				snapshot.isBroken = true;
+			}
+		}
+	}
+
+	count = snapshot.next();
+	std::vector<std::pair<std::string, Expression*>> globals;
+	for (uint32_t i = 0; i < count && !snapshot.isBroken; i++)
+	{
+		std::string name = snapshot.string();
+		Expression* value = snapshot.isBroken ? nullptr : snapshot.readValue();
+		globals.push_back(std::make_pair(name, value));
+	}
+
+	if (snapshot.position != snapshot.end)
+		snapshot.isBroken = true;
+
+	snapshot.unmap();
+	if (snapshot.isBroken)
+		return false;
+
+	for (auto& global : globals)
+		environment->write(global.first, global.second);
+
+	return true;
+}
+
+// Adds the table or function to the ones saved, once
+void Snapshot::collect(Expression* value)
+{
+	if (value->type != Expression::Type::TABLE && value->type != Expression::Type::FUNCTION)
+		return;
+	if (!indices.emplace(value, 0).second)
+		return;
+
+	if (value->type == Expression::Type::TABLE)
+		tables.push_back(static_cast<TableNode*>(value));
+	else
+		functions.push_back(static_cast<FunctionNode*>(value));
+}
+
+// The value as its type and a word, see the class comment
+void Snapshot::writeValue(Expression* value)
+{
+	uint32_t word = 0;
+	switch (value->type)
+	{
+		case Expression::Type::STRING:
+		{
+			std::string text = "";
+			value->evaluate(text);
+			word = intern(text);
+			break;
+		}
+		case Expression::Type::INTEGER:
+		{
+			int number = 0;
+			value->evaluate(number);
+			word = number;
+			break;
+		}
+		case Expression::Type::FLOAT:
+		{
+			float number = 0.0;
+			value->evaluate(number);
+			memcpy(&word, &number, sizeof(word));
+			break;
+		}
+		case Expression::Type::BOOLEAN:
+		{
+			bool truth = false;
+			value->evaluate(truth);
+			word = truth;
+			break;
+		}
+		case Expression::Type::NIL:
+			break;
+		case Expression::Type::TABLE:
+		case Expression::Type::FUNCTION:
+			word = indices[value];
+			break;
+		default: // No value a global or a table holds
+			isBroken = true;
+			return;
+	}
+
+	words.push_back(value->type);
+	words.push_back(word);
+}
+
+Expression* Snapshot::readValue()
+{
+	uint32_t type = next();
+	if (type == Expression::Type::STRING)
+	{
+		std::string text = string();
+		return isBroken ? nullptr : new StringNode(text);
+	}
+
+	uint32_t word = next();
+	if (isBroken)
+		return nullptr;
+
+	switch (type)
+	{
+		case Expression::Type::INTEGER:
+			return new IntegerNode(static_cast<int>(word));
+		case Expression::Type::FLOAT:
+		{
+			float number = 0.0;
+			memcpy(&number, &word, sizeof(number));
+			return new FloatNode(number);
+		}
+		case Expression::Type::BOOLEAN:
+			return new BooleanNode(word != 0);
+		case Expression::Type::NIL:
+			return NilNode::instance();
+		case Expression::Type::TABLE:
+		case Expression::Type::FUNCTION:
+			if (word < objects.size() && objects[word]->type == type)
+				return objects[word];
+			break;
+		default:
+			break;
+	}
+
+	isBroken = true;
+	return nullptr;
+}
@@ -0,0 +1,48 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "Chunk.h"
+
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class FunctionNode;
+class TableNode;
+
+// The globals a prelude left, saved to a file and restored by the next run of the same prelude
+// instead of running it again (./parser prelude=file snapshot=file).
+//
+// The file is laid out as a Chunk's, its words being the functions and tables reachable from
+// the globals, then the globals by name. A function is the name of a builtin or its optimized
+// tree, a table its metatable and its keys and values. A value is two words, its type and
+// then an integer, the bits of a float, a string or the index of a function or table. Restoring
+// makes every table before filling any, so an index becomes a pointer whatever the order the
+// tables refer to each other in. Restoring reads as much as the prelude left, not the prelude,
+// and a function restored is optimized on its first call.
+class Snapshot : public Chunk
+{
+private:
+	// Saving
+	std::vector<FunctionNode*> functions;
+	std::vector<TableNode*> tables;
+	std::vector<std::vector<std::pair<Expression*, Expression*>>> contents; // Of the tables
+	std::unordered_map<Expression*, uint32_t> indices;
+
+	// Loading
+	std::vector<Expression*> objects; // The functions, then the tables
+
+	Snapshot();
+
+	void collect(Expression* value);
+	void writeValue(Expression* value);
+	Expression* readValue();
+
+public:
+	static const uint32_t version = 2;
+
+	static bool save(const std::string& path, uint64_t hash, Environment* environment);
+	static bool load(const std::string& path, uint64_t hash, Environment* environment, std::string* source);
+};
+
+#endif
@@ -0,0 +1,141 @@
+#include "ThreadPool.h"
+
+
+thread_local const ThreadPool* ThreadPool::owner = nullptr;
+thread_local long unsigned int ThreadPool::current = 0;
+
+ThreadPool::ThreadPool(long unsigned int threads)
+{
+	this->queued = 0;
+	this->pending = 0;
+	this->isStopping = false;
+
+	if (threads == 0)
+		threads = 1;
+
+	for (long unsigned int i = 0; i < threads; i++)
+		queues.emplace_back(new Queue());
+
+	for (long unsigned int i = 1; i < threads; i++)
+		workers.emplace_back(&ThreadPool::work, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		isStopping = true;
+	}
+	isChanged.notify_all();
+
+	for (auto& worker : workers)
+		worker.join();
+}
+
+// One thread per core, or one when that is unknown
+long unsigned int ThreadPool::defaultSize()
+{
+	long unsigned int cores = std::thread::hardware_concurrency();
+	return cores == 0 ? 1 : cores;
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queued++;
+		pending++;
+	}
+
+	Queue& queue = *queues[owner == this ? current : 0]; // A task of another pool submits from outside
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.tasks.push_back(std::move(task));
+	}
+
+	isChanged.notify_all();
+}
+
+// Runs tasks on the calling thread until every submitted one, and whatever they submit, is done
+void ThreadPool::wait()
+{
+	std::function<void()> task;
+
+	while (true)
+	{
+		if (take(0, task))
+		{
+			task();
+			finish();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(mutex);
+		if (pending == 0)
+			return;
+		isChanged.wait(lock, [this] { return pending == 0 || queued > 0; });
+	}
+}
+
+// The newest task of the thread's own deque, or else the oldest of another's
+bool ThreadPool::take(long unsigned int index, std::function<void()>& task)
+{
+	for (long unsigned int i = 0; i < queues.size(); i++)
+	{
+		Queue& queue = *queues[(index + i) % queues.size()];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tasks.empty())
+			continue;
+
+		if (i == 0)
+		{
+			task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+		}
+		else
+		{
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+		}
+
+		std::lock_guard<std::mutex> counts(mutex);
+		queued--;
+		return true;
+	}
+
+	return false;
+}
+
+void ThreadPool::finish()
+{
+	bool isDone = false;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		isDone = --pending == 0;
+	}
+
+	if (isDone)
+		isChanged.notify_all();
+}
+
+void ThreadPool::work(long unsigned int index)
+{
+	owner = this;
+	current = index;
+	std::function<void()> task;
+
+	while (true)
+	{
+		if (take(index, task))
+		{
+			task();
+			finish();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(mutex);
+		isChanged.wait(lock, [this] { return isStopping || queued > 0; });
+		if (isStopping)
+			return;
+	}
+}
@@ -0,0 +1,54 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing pool running the tasks of one compilation.
+//
+// Every thread has a deque of tasks. A task submitted while running one goes on the back of
+// its thread's deque, and the thread takes its next task from the back again, depth first.
+// A thread out of tasks steals from the front of another's deque, the oldest and so usually
+// the biggest one left. The thread calling wait() is one of the threads, so a pool of one
+// runs everything on it.
+class ThreadPool
+{
+private:
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	std::vector<std::unique_ptr<Queue>> queues; // The waiting thread's first
+	std::vector<std::thread> workers;
+
+	std::mutex mutex;
+	std::condition_variable isChanged;
+	long int queued; // Counted before the task is on a deque
+	long unsigned int pending; // Submitted and not finished
+	bool isStopping;
+
+	static thread_local const ThreadPool* owner; // Of the calling thread, when it is a worker
+	static thread_local long unsigned int current; // Index of the calling thread's deque in owner
+
+	bool take(long unsigned int index, std::function<void()>& task);
+	void finish();
+	void work(long unsigned int index);
+
+public:
+	ThreadPool(long unsigned int threads);
+	~ThreadPool();
+
+	static long unsigned int defaultSize();
+
+	void submit(std::function<void()> task);
+	void wait();
+};
+
+#endif
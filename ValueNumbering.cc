@@ -0,0 +1,378 @@
+#include "ValueNumbering.h"
+#include "Nodes.h"
+#include "globals.h"
+
+
+// Names a statement may assign. Over-approximated: every variable an assignment lists counts,
+// and so do the ones assigned inside functions defined in it
+static void collectAssigned(Node* node, std::set<std::string>& names)
+{
+	if (node->tag == "AssignmentNode" && node->children[0]->tag == "VariableNode")
+		names.insert(node->children[0]->value);
+	else if (node->tag == "MultipleAssignmentNode")
+	{
+		for (auto child : node->children)
+			if (child->tag == "VariableNode")
+				names.insert(child->value);
+	}
+	else if (node->tag == "ForNode")
+		names.insert(node->value);
+	else if (node->tag == "ForInNode")
+	{
+		const std::vector<std::string>& variables = static_cast<ForInNode*>(node)->nameList();
+		names.insert(variables.begin(), variables.end());
+	}
+
+	for (auto child : node->children)
+		collectAssigned(child, names);
+}
+
+static bool isDisjoint(const std::set<std::string>& names, const std::set<std::string>& assigned)
+{
+	for (auto& name : names)
+		if (assigned.count(name) != 0)
+			return false;
+
+	return true;
+}
+
+
+
+ValueNumbering::ValueNumbering(Environment* environment)
+{
+	this->environment = environment;
+	this->nextVersion = 0;
+	this->nextNumber = 0;
+	this->line = 0;
+}
+
+void ValueNumbering::run(Statement* root)
+{
+	scopes.assign(1, {});
+
+	dump("main chunk");
+	indentation = "  ";
+	statement(root);
+	indentation = "";
+}
+
+void ValueNumbering::run(FunctionNode* function, int line, const std::string& indentation)
+{
+	scopes.assign(1, {});
+	this->line = line;
+	this->indentation = indentation;
+
+	for (auto& parameter : function->parameterList())
+		assign(parameter);
+
+	dump("function at line " + std::to_string(line));
+	this->indentation += "  ";
+	statement(function->body());
+}
+
+// Numbers the expression in slot, replacing it when its value is already computed.
+// Returns its key, empty when it is not a pure computation over variables and literals
+std::string ValueNumbering::expression(Expression*& slot)
+{
+	operands.emplace_back();
+	std::string key = slot->number(*this);
+	Operands found = operands.back();
+	operands.pop_back();
+
+	bool isComputation = slot->type == Expression::Type::BINARYOPERATION || slot->type == Expression::Type::LOGICALOPERATION
+		|| slot->type == Expression::Type::UNARYOPERATION;
+
+	if (key.empty() || !isComputation)
+	{
+		hoist(found.invariants);
+		found.invariants.clear();
+	}
+	else if (Available* available = find(key))
+	{
+		// The operands now only run when the value is missing, so nothing below is reused or kept
+		forget(found.registered);
+		found.registered.clear();
+		found.invariants.clear();
+
+		TemporaryNode* source = temporary(*available);
+		slot = new TemporaryNode(environment, slot, source);
+		temporaries.push_back(static_cast<TemporaryNode*>(slot));
+		dump("line " + std::to_string(line) + ": " + source->value + " reused");
+	}
+	else
+	{
+		int number = ++nextNumber;
+		scopes.back()[key] = { &slot, nullptr, number };
+		found.registered.push_back({ key, &slot });
+		dump("line " + std::to_string(line) + ": %" + std::to_string(number) + " = " + key);
+
+		// The outermost loop assigning none of the operands, an inner loop assigns fewer names
+		long unsigned int loop = 0;
+		while (loop < loops.size() && !isDisjoint(found.names, loops[loop].assigned))
+			loop++;
+
+		if (loop == loops.size())
+		{
+			hoist(found.invariants);
+			found.invariants.clear();
+		}
+		else // Kept along with this computation, unless invariant in an outer loop
+		{
+			std::vector<Invariant> outer;
+			for (auto& invariant : found.invariants)
+				if (invariant.loop < loop)
+					outer.push_back(invariant);
+
+			outer.push_back({ &slot, loop, number });
+			found.invariants = outer;
+		}
+	}
+
+	if (operands.empty())
+	{
+		hoist(found.invariants);
+		return key;
+	}
+
+	Operands& parent = operands.back();
+	parent.names.insert(found.names.begin(), found.names.end());
+	parent.invariants.insert(parent.invariants.end(), found.invariants.begin(), found.invariants.end());
+	parent.registered.insert(parent.registered.end(), found.registered.begin(), found.registered.end());
+
+	return key;
+}
+
+void ValueNumbering::statement(Statement* statement)
+{
+	if (statement->line)
+		line = statement->line;
+
+	statement->number(*this);
+}
+
+std::string ValueNumbering::variable(const std::string& name)
+{
+	if (!operands.empty())
+		operands.back().names.insert(name);
+
+	auto version = versions.find(name);
+	return name + "#" + std::to_string(version == versions.end() ? 0 : version->second);
+}
+
+std::string ValueNumbering::constant(Expression* constant)
+{
+	switch (constant->type)
+	{
+		case Expression::Type::INTEGER:
+		{
+			int value = 0;
+			constant->evaluate(value);
+			return std::to_string(value);
+		}
+		case Expression::Type::FLOAT:
+		{
+			float value = 0.0;
+			constant->evaluate(value);
+			return std::to_string(value); // Always has a decimal point, unlike an integer
+		}
+		case Expression::Type::STRING:
+		{
+			std::string value = "", quoted = "\"";
+			constant->evaluate(value);
+			for (auto character : value)
+			{
+				if (character == '"' || character == '\\')
+					quoted += '\\';
+				quoted += character;
+			}
+			return quoted + "\"";
+		}
+		case Expression::Type::BOOLEAN:
+		{
+			bool value = false;
+			constant->evaluate(value);
+			return value ? "true" : "false";
+		}
+		default:
+			return "nil";
+	}
+}
+
+void ValueNumbering::assign(const std::string& name)
+{
+	versions[name] = ++nextVersion;
+}
+
+void ValueNumbering::pushScope()
+{
+	scopes.emplace_back();
+}
+
+void ValueNumbering::popScope()
+{
+	scopes.pop_back();
+}
+
+// Each branch starts from the versions before the if, and a name assigned in any of them
+// gets a new version after it, as a phi would give it
+void ValueNumbering::beginBranches()
+{
+	branches.push_back({ versions, {}, true });
+}
+
+void ValueNumbering::nextBranch()
+{
+	Branches& current = branches.back();
+
+	if (!current.isFirst)
+	{
+		collectChanged(current);
+		popScope();
+		versions = current.versions;
+	}
+
+	current.isFirst = false;
+	pushScope();
+}
+
+void ValueNumbering::endBranches()
+{
+	Branches current = branches.back();
+	branches.pop_back();
+
+	if (!current.isFirst)
+	{
+		collectChanged(current);
+		popScope();
+	}
+
+	versions = current.versions;
+	for (auto& name : current.changed)
+		assign(name);
+}
+
+// Names assigned in the loop get new versions on entry, for the values coming around the
+// back edge, and again on exit
+void ValueNumbering::beginLoop(const unsigned long long* entries, Statement* body, const std::string& variable)
+{
+	Loop loop = { entries, {}, line };
+	collectAssigned(body, loop.assigned);
+	if (!variable.empty())
+		loop.assigned.insert(variable);
+
+	for (auto& name : loop.assigned)
+		assign(name);
+
+	dump("loop at line " + std::to_string(line));
+	indentation += "  ";
+
+	loops.push_back(loop);
+	pushScope();
+}
+
+void ValueNumbering::endLoop()
+{
+	popScope();
+
+	for (auto& name : loops.back().assigned)
+		assign(name);
+
+	loops.pop_back();
+	indentation.resize(indentation.size() - 2);
+}
+
+// Left for a later run, the names the body assigns get new versions as if it ran here
+void ValueNumbering::function(FunctionNode* function)
+{
+	nested.push_back({ function, line, indentation, dumped.size() });
+
+	std::set<std::string> assigned(function->parameterList().begin(), function->parameterList().end());
+	collectAssigned(function->body(), assigned);
+	for (auto& name : assigned)
+		assign(name);
+}
+
+ValueNumbering::Available* ValueNumbering::find(const std::string& key)
+{
+	for (auto scope = scopes.rbegin(); scope != scopes.rend(); scope++)
+	{
+		auto available = scope->find(key);
+		if (available != scope->end())
+			return &available->second;
+	}
+
+	return nullptr;
+}
+
+void ValueNumbering::forget(const std::vector<std::pair<std::string, Expression**>>& registered)
+{
+	for (auto& computation : registered)
+	{
+		for (auto& scope : scopes)
+		{
+			auto available = scope.find(computation.first);
+			if (available != scope.end() && available->second.slot == computation.second)
+				scope.erase(available);
+		}
+	}
+}
+
+// The temporary storing the value, put in place of the computation the first time it is reused
+TemporaryNode* ValueNumbering::temporary(Available& available)
+{
+	if (available.temporary)
+		return available.temporary;
+
+	Expression*& slot = *available.slot;
+
+	if (slot->type == Expression::Type::TEMPORARY) // Already kept across a loop
+		available.temporary = static_cast<TemporaryNode*>(slot);
+	else
+	{
+		available.temporary = new TemporaryNode(environment, slot);
+		temporaries.push_back(available.temporary);
+		available.temporary->value = "%" + std::to_string(available.number);
+		slot = available.temporary;
+	}
+
+	return available.temporary;
+}
+
+void ValueNumbering::hoist(const std::vector<Invariant>& invariants)
+{
+	for (auto& invariant : invariants)
+	{
+		Expression*& slot = *invariant.slot;
+		TemporaryNode* temporary = nullptr;
+
+		if (slot->type == Expression::Type::TEMPORARY) // Already reused
+			temporary = static_cast<TemporaryNode*>(slot);
+		else
+		{
+			temporary = new TemporaryNode(environment, slot);
+			temporaries.push_back(temporary);
+			temporary->value = "%" + std::to_string(invariant.number);
+			slot = temporary;
+		}
+
+		const Loop& loop = loops[invariant.loop];
+		temporary->hoist(loop.entries);
+		dump("line " + std::to_string(line) + ": " + temporary->value + " hoisted out of the loop at line " + std::to_string(loop.line));
+	}
+}
+
+void ValueNumbering::collectChanged(Branches& current)
+{
+	for (auto& version : versions)
+	{
+		auto before = current.versions.find(version.first);
+		if (before == current.versions.end() || before->second != version.second)
+			current.changed.insert(version.first);
+	}
+}
+
+void ValueNumbering::dump(const std::string& text)
+{
+	if (dump_ir)
+		dumped.push_back("IR:\t " + indentation + text);
+}
@@ -0,0 +1,125 @@
+#ifndef VALUENUMBERING_H
+#define VALUENUMBERING_H
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+class Environment;
+class Expression;
+class FunctionNode;
+class Statement;
+class TemporaryNode;
+
+// Value numbering over the folded tree, run once after parsing.
+//
+// Variables are renamed SSA style: every assignment gives the name a new version, and
+// so do the merge points after an if and around a loop body, where a phi would be.
+// A computation over versioned names and literals gets a key, and a second computation
+// with the same key, dominated by the first, reads the first one's value instead
+// (CSE/GVN). A computation whose operands are not assigned in a loop keeps its value
+// across the iterations (LICM). The tree stays the executable form: both rewrites
+// insert TemporaryNodes, whose runtime guards cover what the pass cannot see, calls
+// and metamethods writing variables.
+//
+// A function body can run whenever the function is called, so nothing computed outside is
+// available in it, and it is numbered on its own: the functions met are kept in nested.
+class ValueNumbering
+{
+public:
+	struct Nested
+	{
+		FunctionNode* function;
+		int line;
+		std::string indentation;
+		long unsigned int position; // Lines dumped before it
+	};
+
+private:
+	struct Available
+	{
+		Expression** slot; // Where the computation sits in its parent
+		TemporaryNode* temporary; // Made once the value is reused
+		int number;
+	};
+
+	struct Loop
+	{
+		const unsigned long long* entries;
+		std::set<std::string> assigned;
+		int line;
+	};
+
+	struct Invariant
+	{
+		Expression** slot;
+		long unsigned int loop; // Outermost loop it is invariant in
+		int number;
+	};
+
+	// What the numbering of an expression found below it
+	struct Operands
+	{
+		std::set<std::string> names;
+		std::vector<Invariant> invariants; // Not cached yet, an invariant parent may cover them
+		std::vector<std::pair<std::string, Expression**>> registered;
+	};
+
+	struct Branches
+	{
+		std::map<std::string, int> versions; // Before the branches
+		std::set<std::string> changed;
+		bool isFirst;
+	};
+
+	Environment* environment;
+	std::map<std::string, int> versions;
+	int nextVersion;
+	int nextNumber;
+	int line;
+	std::string indentation;
+
+	std::vector<std::map<std::string, Available>> scopes; // Dominating computations, innermost last
+	std::vector<Loop> loops;
+	std::vector<Operands> operands;
+	std::vector<Branches> branches;
+
+	Available* find(const std::string& key);
+	void forget(const std::vector<std::pair<std::string, Expression**>>& registered);
+	TemporaryNode* temporary(Available& available);
+	void hoist(const std::vector<Invariant>& invariants);
+	void collectChanged(Branches& branches);
+	void dump(const std::string& text);
+
+public:
+	std::vector<std::string> dumped; // With ./parser dumpir
+	std::vector<Nested> nested;
+	std::vector<TemporaryNode*> temporaries; // Made for the unit, in slots its children do not see
+
+	ValueNumbering(Environment* environment);
+
+	void run(Statement* root);
+	void run(FunctionNode* function, int line, const std::string& indentation);
+
+	std::string expression(Expression*& slot);
+	void statement(Statement* statement);
+
+	std::string variable(const std::string& name);
+	std::string constant(Expression* constant);
+	void assign(const std::string& name);
+
+	void pushScope();
+	void popScope();
+
+	void beginBranches();
+	void nextBranch();
+	void endBranches();
+
+	void beginLoop(const unsigned long long* entries, Statement* body, const std::string& variable = "");
+	void endLoop();
+
+	void function(FunctionNode* function);
+};
+
+#endif
@@ -0,0 +1,37 @@
+#!/usr/bin/bash
+# Parsing must stay linear in the number of statements: a script with 4 times as many may take
+# at most 6 times as long. Copying the statement list on every reduction made it take 16 times.
+make -s || { echo "fail"; exit 1; }
+
+generate ()
+{
+	awk -v count=$1 'BEGIN { for (i = 0; i < count; i++) print "x = " i; print "print(x)" }' > $2
+}
+
+# Times a run, which must exit normally and print the value the last statement assigned
+run ()
+{
+	local start=$(date +%s%N)
+	local output
+	output=$(./parser nodebug < $1) || return 1
+	[ "$output" = "$2"$'\t' ] || return 1 # print separates values with tabs
+	echo $(( ($(date +%s%N) - start) / 1000000 ))
+}
+
+generate 250000 benchmark_small.txt
+generate 1000000 benchmark_large.txt
+
+small=$(run benchmark_small.txt 249999) && large=$(run benchmark_large.txt 999999)
+status=$?
+rm -f benchmark_small.txt benchmark_large.txt
+if [ $status -ne 0 ]; then
+	echo "fail"
+	exit 1
+fi
+
+echo "250000 statements: ${small}ms, 1000000 statements: ${large}ms" >&2
+if [ $large -le $(( small * 6 )) ]; then
+	echo "success"
+else
+	echo "quadratic"
+fi
@@ -2,12 +2,16 @@
 #define GLOBALS_H
 
 #include "Nodes.h"
+#include "Environment.h"
 
-extern Statement* root;
 extern bool debug_lex;
 extern bool debug_grammar;
 extern bool debug_assignments;
 extern bool debug_calls;
 extern bool debug_evaluations;
+extern bool dump_ir;
+extern long unsigned int memo_capacity;
+extern long unsigned int compile_jobs;
+extern bool lazy_functions;
 
 #endif
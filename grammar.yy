@@ -2,121 +2,149 @@
 %defines
 %define api.value.type variant
 %define api.token.constructor
+%locations
+%param { Compilation& compilation }
+
+// With no statement separators, ( after an expression may call it or start the next statement.
+// Shifting calls it, as Lua does for f()(x) and a = f (x). The other three are a SEMICOLON after
+// a statement, ELSEIF after an empty elseifs, and print(exp), all right when shifted
+%expect 5
 
 
 %code {
-	#define YY_DECL yy::parser::symbol_type yylex()
-	YY_DECL;
+	#include "Compilation.h"
+	#include "Optimizer.h"
 
 	void log_grammar(std::string message)
 	{
 		if (debug_grammar)
 			std::cout << "GRAMMAR:\t " << message << '\n';
 	}
-
-	Statement* root;
-	Environment* environment = new Environment();
 }
 
 %code requires{
 	#include "globals.h"
 	#include "Environment.h"
 	#include "Nodes.h"
+	#include "Lexeme.h"
+
+	class Compilation;
 }
 
 %token EXIT 0 "end of file"
 
 /* Control-flow */
-%token <std::string> IF
-%token <std::string> THEN
-%token <std::string> ELSEIF
-%token <std::string> ELSE
+%token IF
+%token THEN
+%token ELSEIF
+%token ELSE
 
 /* Looping */
-%token <std::string> FOR
-%token <std::string> WHILE
-%token <std::string> REPEAT
-%token <std::string> DO
-%token <std::string> UNTIL
-%token <std::string> END
-%token <std::string> IN
+%token FOR
+%token WHILE
+%token REPEAT
+%token DO
+%token UNTIL
+%token END
+%token IN
 
 /* Binary operations */
-%token <std::string> PLUS
-%token <std::string> MINUS
-%token <std::string> MUL
-%token <std::string> DIV
-%token <std::string> POWER_OF
-%token <std::string> MOD
-%token <std::string> EQUALS
-%token <std::string> NOT_EQUALS
-%token <std::string> LESS
-%token <std::string> MORE
-%token <std::string> LESS_OR_EQUAL
-%token <std::string> MORE_OR_EQUAL
-%token <std::string> TILDE_EQUAL
+%token PLUS
+%token MINUS
+%token MUL
+%token DIV
+%token POWER_OF
+%token MOD
+%token EQUALS
+%token NOT_EQUALS
+%token LESS
+%token MORE
+%token LESS_OR_EQUAL
+%token MORE_OR_EQUAL
+%token TILDE_EQUAL
 
 /* Unary operations */
-%token <std::string> NOT
-%token <std::string> AND
-%token <std::string> OR
-%token <std::string> HASHTAG
+%token NOT
+%token AND
+%token OR
+%token HASHTAG
 
 /* Scope */
-%token <std::string> LOCAL
+%token LOCAL
 
 /* Functions */
-%token <std::string> FUNCTION
-%token <std::string> BREAK
-%token <std::string> RETURN
-%token <std::string> PRINT
+%token FUNCTION
+%token BREAK
+%token RETURN
+%token PRINT
 
 /* Values */
-%token <std::string> NIL
-%token <std::string> FALSE
-%token <std::string> TRUE
+%token NIL
+%token FALSE
+%token TRUE
 %token <int> INTEGER
 %token <float> FLOAT
-%token <std::string> STRING
-%token <std::string> VAR
+%token <Lexeme> STRING
+%token <Lexeme> VAR
+%token <Lexeme> BODY /* A function body left as source, see Compilation::next */
 
 /* Single-character tokens */
-%token <std::string> ASSIGNMENT
-%token <std::string> DOT
-%token <std::string> COLON
-%token <std::string> SEMICOLON
-%token <std::string> COMMA
-%token <std::string> LROUND
-%token <std::string> RROUND
-%token <std::string> LSQUARE
-%token <std::string> RSQUARE
-%token <std::string> LCURLY
-%token <std::string> RCURLY
+%token ASSIGNMENT
+%token DOT
+%token COLON
+%token SEMICOLON
+%token COMMA
+%token LROUND
+%token RROUND
+%token LSQUARE
+%token RSQUARE
+%token LCURLY
+%token RCURLY
 
 /* Whitespace */
-%token <std::string> WHITESPACE
-%token <std::string> NEWLINE
-%token <std::string> OTHER
+%token WHITESPACE
+%token NEWLINE
+%token OTHER
 
 
 
 %type <Statement*> block
+%type <std::vector<Statement*>> mainchunk
+%type <std::vector<Statement*>> mainstmts
 %type <std::vector<Statement*>> chunk
 %type <std::vector<Statement*>> stmts
 %type <Statement*> stmt
 %type <Statement*> laststmt
-//%type <Statement*> for
+%type <Statement*> for
 %type <Statement*> assignment
+%type <std::vector<Expression*>> varlist
+%type <std::vector<Expression*>> namelist
 %type <Statement*> if
 %type <std::vector<Statement*>> elseifs
 %type <Statement*> elseif
 %type <Statement*> else
 
+%type <Expression*> funcname
+%type <Statement*> body
+%type <Expression*> functiondef
+%type <std::vector<std::string>> parlist
+%type <Expression*> functioncall
+%type <std::vector<Expression*>> args
+%type <Expression*> prefixexp
+%type <Expression*> var
+
+%type <Expression*> tableconstructor
+%type <std::vector<std::pair<Expression*, Expression*>>> fieldlist
+%type <std::pair<Expression*, Expression*>> field
+
 %type <std::vector<Expression*>> explist
 %type <Expression*> exp
+%type <Expression*> op_or
+%type <Expression*> op_and
 %type <Expression*> op
 %type <Expression*> op_1
 %type <Expression*> op_2
+%type <Expression*> op_unary
 %type <Expression*> op_3
 %type <Expression*> op_last
 
@@ -124,65 +152,163 @@
 
 %%
 
-block : chunk								{ log_grammar("block:chunk"); $$ = new Block($1); root = $$; }
+program : mainchunk							{ log_grammar("program:mainchunk"); compilation.finish(std::move($1)); }
 
-chunk : stmts								{ log_grammar("chunk:stmts"); 						$$ = $1; }
-	  | chunk laststmt						{ log_grammar("chunk:chunk laststmt"); 				$$ = $1; $$.push_back($2); }
-	  | chunk laststmt SEMICOLON			{ log_grammar("chunk:chunk laststmt SEMICOLON"); 	$$ = $1; $$.push_back($2); }
+/* The main chunk's statements go through compilation.statement, which runs each one at once when streaming, or keeps its lines to reparse */
+mainchunk : /* empty */						{ log_grammar("mainchunk:empty"); }
+		  | mainstmts						{ log_grammar("mainchunk:mainstmts"); 						$$ = std::move($1); }
+		  | mainchunk laststmt				{ log_grammar("mainchunk:mainchunk laststmt"); 				$$ = std::move($1); compilation.statement($$, $2, @2); }
+		  | mainchunk laststmt SEMICOLON	{ log_grammar("mainchunk:mainchunk laststmt SEMICOLON"); 	$$ = std::move($1); compilation.statement($$, $2, @2); }
 
-laststmt : RETURN exp/*list*/ 				{ log_grammar("laststmt:RETURN exp optsemi"); 	$$ = new ReturnNode($2); }
-		 | BREAK 							{ log_grammar("laststmt:BREAK optsemi"); 		$$ = new BreakNode(); 	}
+mainstmts : stmt							{ log_grammar("mainstmts:stmt"); 					$1->line = @1.begin.line; compilation.statement($$, $1, @1); }
+		  | mainstmts stmt					{ log_grammar("mainstmts:mainstmts stmt"); 			$2->line = @2.begin.line; $$ = std::move($1); compilation.statement($$, $2, @2); }
+		  | mainstmts SEMICOLON				{ log_grammar("mainstmts:mainstmts SEMICOLON"); 	$$ = std::move($1); }
 
-stmts : stmt								{ log_grammar("stmts:stmt"); 				$$.push_back($1); }
-	  | stmt SEMICOLON						{ log_grammar("stmts:stmt"); 				$$.push_back($1); }
-	  | stmts stmt							{ log_grammar("stmts:stmts stmt optsemi"); 	$$ = $1; $$.push_back($2); }
-	  | stmts SEMICOLON stmt				{ log_grammar("stmts:stmts stmt optsemi"); 	$$ = $1; $$.push_back($3); }
+block : chunk								{ log_grammar("block:chunk"); $$ = new Block(compilation.environment, std::move($1)); }
 
-stmt : if elseifs else END					{ log_grammar("stmt:ifstatement END");				$2.insert($2.begin(), $1); if ($3) $2.push_back($3); $$ = new IfStatementNode($2); }
-	 | assignment							{ log_grammar("stmt:assignment");					$$ = $1; }
-	 | PRINT explist						{ log_grammar("stmt:PRINT explist"); 				$$ = new PrintNode($2); }
-	 | PRINT LROUND explist RROUND			{ log_grammar("stmt:PRINT LROUND explist RROUND");	$$ = new PrintNode($3); }
-//	 | for 									{ log_grammar("stmt:for"); 							$$ = $1; }
+chunk : /* empty */							{ log_grammar("chunk:empty"); }
+	  | stmts								{ log_grammar("chunk:stmts"); 						$$ = std::move($1); }
+	  | chunk laststmt						{ log_grammar("chunk:chunk laststmt"); 				$$ = std::move($1); $$.push_back($2); }
+	  | chunk laststmt SEMICOLON			{ log_grammar("chunk:chunk laststmt SEMICOLON"); 	$$ = std::move($1); $$.push_back($2); }
 
-assignment : VAR ASSIGNMENT exp				{ log_grammar("assignment:VAR ASSIGNMENT exp"); $$ = new AssignmentNode(environment, new VariableNode(environment, $1), $3); }
+laststmt : RETURN explist 					{ log_grammar("laststmt:RETURN explist optsemi"); 	$$ = new ReturnNode(compilation.environment, $2); $$->line = @1.begin.line; }
+		 | RETURN 							{ log_grammar("laststmt:RETURN optsemi"); 			$$ = new ReturnNode(compilation.environment, std::vector<Expression*>()); $$->line = @1.begin.line; }
+		 | BREAK 							{ log_grammar("laststmt:BREAK optsemi"); 			$$ = new BreakNode(compilation.environment); $$->line = @1.begin.line; }
 
-//for : FOR assignment COMMA exp DO block		{ log_grammar("for:FOR VAR ASSIGNMENT exp COMMA exp"); $$ = new ForNode($2, $4, $6); }
+stmts : stmt								{ log_grammar("stmts:stmt"); 				$1->line = @1.begin.line; $$.push_back($1); }
+	  | stmt SEMICOLON						{ log_grammar("stmts:stmt"); 				$1->line = @1.begin.line; $$.push_back($1); }
+	  | stmts stmt							{ log_grammar("stmts:stmts stmt optsemi"); 	$2->line = @2.begin.line; $$ = std::move($1); $$.push_back($2); }
+	  | stmts SEMICOLON stmt				{ log_grammar("stmts:stmts stmt optsemi"); 	$3->line = @3.begin.line; $$ = std::move($1); $$.push_back($3); }
+
+stmt : if elseifs else END					{ log_grammar("stmt:ifstatement END");				$2.insert($2.begin(), $1); if ($3) $2.push_back($3); $$ = new IfStatementNode(std::move($2)); }
+	 | assignment							{ log_grammar("stmt:assignment");					$$ = $1; }
+	 | prefixexp							{ log_grammar("stmt:prefixexp");
+											  // Reduced from prefixexp, not functioncall, so that ( after a call calls again
+											  if ($1->type != Expression::Type::CALL) { error(@1, "syntax error"); YYERROR; }
+											  $$ = new CallStatementNode($1); }
+	 | PRINT explist						{ log_grammar("stmt:PRINT explist");
+											  // print(exp) parses as PRINT (exp), whose parentheses would truncate a call's results
+											  if ($2.size() == 1 && $2[0]->type == Expression::Type::PARENTHESIS) { Expression* parentheses = $2[0]; $2[0] = static_cast<ParenthesisNode*>(parentheses)->getExpression(); delete parentheses; }
+											  $$ = new PrintNode(compilation.environment, std::move($2)); }
+	 | PRINT LROUND explist RROUND			{ log_grammar("stmt:PRINT LROUND explist RROUND");	$$ = new PrintNode(compilation.environment, std::move($3)); }
+	 | FUNCTION funcname LROUND parlist RROUND body					{ log_grammar("stmt:FUNCTION funcname funcbody"); 			$$ = new AssignmentNode(compilation.environment, $2, new FunctionNode(compilation.environment, $4, $6, compilation.sourceName)); }
+	 | FUNCTION funcname COLON VAR LROUND parlist RROUND body		{ log_grammar("stmt:FUNCTION funcname COLON VAR funcbody"); $6.insert($6.begin(), "self"); $$ = new AssignmentNode(compilation.environment, new IndexNode($2, new StringNode($4.string())), new FunctionNode(compilation.environment, $6, $8, compilation.sourceName)); }
+	 | LOCAL FUNCTION VAR LROUND parlist RROUND body					{ log_grammar("stmt:LOCAL FUNCTION VAR funcbody"); 			$$ = new AssignmentNode(compilation.environment, new VariableNode(compilation.environment, $3.string()), new FunctionNode(compilation.environment, $5, $7, compilation.sourceName), true); }
+	 | for 									{ log_grammar("stmt:for"); 							$$ = $1; }
+	 | WHILE exp DO block END				{ log_grammar("stmt:WHILE exp DO block END");		$$ = new WhileNode(compilation.environment, $2, $4); }
+	 | REPEAT block UNTIL exp				{ log_grammar("stmt:REPEAT block UNTIL exp");		$$ = new RepeatNode(compilation.environment, $2, $4); }
+
+assignment : varlist ASSIGNMENT explist		{ log_grammar("assignment:varlist ASSIGNMENT explist");
+												  if ($1.size() == 1 && $3.size() == 1) $$ = new AssignmentNode(compilation.environment, $1[0], $3[0]);
+												  else $$ = new MultipleAssignmentNode(compilation.environment, $1, $3); }
+		   | LOCAL namelist ASSIGNMENT explist	{ log_grammar("assignment:LOCAL namelist ASSIGNMENT explist");
+												  if ($2.size() == 1 && $4.size() == 1) $$ = new AssignmentNode(compilation.environment, $2[0], $4[0], true);
+												  else $$ = new MultipleAssignmentNode(compilation.environment, $2, $4, true); }
+		   | LOCAL namelist					{ log_grammar("assignment:LOCAL namelist");
+												  if ($2.size() == 1) $$ = new AssignmentNode(compilation.environment, $2[0], NilNode::instance(), true);
+												  else $$ = new MultipleAssignmentNode(compilation.environment, $2, std::vector<Expression*>(), true); }
+
+varlist : var								{ log_grammar("varlist:var");					$$.push_back($1); }
+		| varlist COMMA var					{ log_grammar("varlist:varlist COMMA var");		$$ = std::move($1); $$.push_back($3); }
+
+namelist : VAR								{ log_grammar("namelist:VAR");					$$.push_back(new VariableNode(compilation.environment, $1.string())); }
+		 | namelist COMMA VAR				{ log_grammar("namelist:namelist COMMA VAR");	$$ = std::move($1); $$.push_back(new VariableNode(compilation.environment, $3.string())); }
+
+for : FOR VAR ASSIGNMENT exp COMMA exp DO block END					{ log_grammar("for:FOR VAR ASSIGNMENT exp COMMA exp DO block END"); 			$$ = new ForNode(compilation.environment, $2.string(), $4, $6, nullptr, $8); }
+	| FOR VAR ASSIGNMENT exp COMMA exp COMMA exp DO block END		{ log_grammar("for:FOR VAR ASSIGNMENT exp COMMA exp COMMA exp DO block END"); $$ = new ForNode(compilation.environment, $2.string(), $4, $6, $8, $10); }
+	| FOR namelist IN explist DO block END							{ log_grammar("for:FOR namelist IN explist DO block END");						$$ = new ForInNode(compilation.environment, $2, $4, $6); }
 
 if : IF exp THEN block						{ log_grammar("if:IF exp THEN block"); $$ = new IfNode($2, $4); }
 
 elseifs : /* empty */						{ log_grammar("elseifs:empty"); }
 		| elseif							{ log_grammar("elseifs: ELSEIF");			$$.push_back($1); 	}
-		| elseifs elseif					{ log_grammar("elseifs:elseifs elseif");	$$ = $1; $$.push_back($2); }
+		| elseifs elseif					{ log_grammar("elseifs:elseifs elseif");	$$ = std::move($1); $$.push_back($2); }
 
 elseif : ELSEIF exp THEN block				{ log_grammar("elseif:ELSEIF exp THEN block"); $$ = new IfNode($2, $4); 	}
 
 else : /* empty */							{ log_grammar("else:empty"); }
 	 | ELSE block							{ log_grammar("else:ELSE block"); $$ = new ElseNode($2); }
+
+funcname : VAR								{ log_grammar("funcname:VAR");				$$ = new VariableNode(compilation.environment, $1.string()); }
+		 | funcname DOT VAR					{ log_grammar("funcname:funcname DOT VAR");	$$ = new IndexNode($1, new StringNode($3.string())); }
+
+functiondef : FUNCTION LROUND parlist RROUND body			{ log_grammar("functiondef:FUNCTION funcbody"); $$ = new FunctionNode(compilation.environment, $3, $5, compilation.sourceName); }
+
+body : block END								{ log_grammar("body:block END");	$$ = $1; }
+	 | BODY									{ log_grammar("body:BODY");			$$ = new LazyBlock(compilation.environment, compilation.name, $1.string(), @1.begin.line, @1.begin.column); }
+
+parlist : /* empty */						{ log_grammar("parlist:empty"); }
+		| VAR								{ log_grammar("parlist:VAR");				$$.push_back($1.string()); }
+		| parlist COMMA VAR					{ log_grammar("parlist:parlist COMMA VAR");	$$ = std::move($1); $$.push_back($3.string()); }
+
+functioncall : prefixexp args				{ log_grammar("functioncall:prefixexp args");			$$ = new CallNode($1, $2); }
+			 | prefixexp COLON VAR args		{ log_grammar("functioncall:prefixexp COLON VAR args");	$$ = new CallNode($1, $3.string(), $4); }
+
+args : LROUND RROUND						{ log_grammar("args:LROUND RROUND"); }
+	 | LROUND explist RROUND				{ log_grammar("args:LROUND explist RROUND"); $$ = std::move($2); }
+
+prefixexp : var								{ log_grammar("prefixexp:var");					$$ = $1; }
+		  | functioncall					{ log_grammar("prefixexp:functioncall");		$$ = $1; }
+		  | LROUND exp RROUND				{ log_grammar("prefixexp:LROUND exp RROUND");	$$ = new ParenthesisNode($2); }
+
+var : VAR									{ log_grammar("var:VAR");								$$ = new VariableNode(compilation.environment, $1.string()); }
+	| prefixexp LSQUARE exp RSQUARE			{ log_grammar("var:prefixexp LSQUARE exp RSQUARE");		$$ = new IndexNode($1, $3); }
+	| prefixexp DOT VAR						{ log_grammar("var:prefixexp DOT VAR");					$$ = new IndexNode($1, new StringNode($3.string())); }
+
+tableconstructor : LCURLY RCURLY			{ log_grammar("tableconstructor:LCURLY RCURLY");				$$ = new TableConstructorNode(std::vector<std::pair<Expression*, Expression*>>()); }
+				 | LCURLY fieldlist RCURLY	{ log_grammar("tableconstructor:LCURLY fieldlist RCURLY");		$$ = new TableConstructorNode($2); }
+
+fieldlist : field							{ log_grammar("fieldlist:field");						$$.push_back($1); }
+		  | fieldlist COMMA field			{ log_grammar("fieldlist:fieldlist COMMA field");		$$ = std::move($1); $$.push_back($3); }
+		  | fieldlist SEMICOLON field		{ log_grammar("fieldlist:fieldlist SEMICOLON field");	$$ = std::move($1); $$.push_back($3); }
+		  | fieldlist COMMA					{ log_grammar("fieldlist:fieldlist COMMA");				$$ = std::move($1); }
+		  | fieldlist SEMICOLON				{ log_grammar("fieldlist:fieldlist SEMICOLON");			$$ = std::move($1); }
+
+field : exp									{ log_grammar("field:exp");										$$ = std::make_pair((Expression*)nullptr, $1); }
+	  | VAR ASSIGNMENT exp					{ log_grammar("field:VAR ASSIGNMENT exp");						$$ = std::make_pair(new StringNode($1.string()), $3); }
+	  | LSQUARE exp RSQUARE ASSIGNMENT exp	{ log_grammar("field:LSQUARE exp RSQUARE ASSIGNMENT exp");		$$ = std::make_pair($2, $5); }
 //
 explist : exp 								{ log_grammar("explist:exp"); $$.push_back($1); }
-		| explist COMMA exp					{ log_grammar("explist:explist exp"); $$ = $1; $$.push_back($3); }
+		| explist COMMA exp					{ log_grammar("explist:explist exp"); $$ = std::move($1); $$.push_back($3); }
+
+exp : op_or								{ log_grammar("exp:op_or"); $$ = $1; }
 
-exp : op									{ log_grammar("exp:op"); $$ = $1; }
+op_or : op_and								{ log_grammar("op_or:op_and");				$$ = $1; }
+	  | op_or OR op_and						{ log_grammar("op_or:op_or or op_and");		$$ = new LogicalOperationNode($1, $3, LogicalOperationNode::Operation::OR); }
+
+op_and : op									{ log_grammar("op_and:op");					$$ = $1; }
+	   | op_and AND op						{ log_grammar("op_and:op_and and op");		$$ = new LogicalOperationNode($1, $3, LogicalOperationNode::Operation::AND); }
 
 op : op_1									{ log_grammar("op:op_1");		$$ = $1; }
    | op EQUALS op_1							{ log_grammar("op:op == op_1");	$$ = new BinaryOperationNode($1, $3, BinaryOperationNode::Operation::EQUALS); }
    | op NOT_EQUALS op_1						{ log_grammar("op:op != op_1");	$$ = new BinaryOperationNode($1, $3, BinaryOperationNode::Operation::NOT_EQUALS); }
+   | op TILDE_EQUAL op_1					{ log_grammar("op:op ~= op_1");	$$ = new BinaryOperationNode($1, $3, BinaryOperationNode::Operation::NOT_EQUALS); }
+   | op LESS op_1							{ log_grammar("op:op < op_1");	$$ = new BinaryOperationNode($1, $3, BinaryOperationNode::Operation::LESS); }
+   | op MORE op_1							{ log_grammar("op:op > op_1");	$$ = new BinaryOperationNode($1, $3, BinaryOperationNode::Operation::MORE); }
+   | op LESS_OR_EQUAL op_1					{ log_grammar("op:op <= op_1");	$$ = new BinaryOperationNode($1, $3, BinaryOperationNode::Operation::LESS_OR_EQUAL); }
+   | op MORE_OR_EQUAL op_1					{ log_grammar("op:op >= op_1");	$$ = new BinaryOperationNode($1, $3, BinaryOperationNode::Operation::MORE_OR_EQUAL); }
 
 op_1 : op_2									{ log_grammar("op_1:op_2");			$$ = $1; }
 	 | op_1 PLUS op_2						{ log_grammar("op_1:op_1 + op_2");	$$ = new BinaryOperationNode($1, $3, BinaryOperationNode::Operation::PLUS); }
 	 | op_1 MINUS op_2						{ log_grammar("op_1:op_1 - op_2");	$$ = new BinaryOperationNode($1, $3, BinaryOperationNode::Operation::MINUS); }
 
-op_2 : op_3									{ log_grammar("op_2:op_3"); 		$$ = $1; }
-	 | op_2 MUL op_3						{ log_grammar("op_2:op_2 * op_3");	$$ = new BinaryOperationNode($1, $3, BinaryOperationNode::Operation::MULTIPLICATION); }
-	 | op_2 DIV op_3						{ log_grammar("op_2:op_2 / op_3");	$$ = new BinaryOperationNode($1, $3, BinaryOperationNode::Operation::DIVISION); }
+op_2 : op_unary								{ log_grammar("op_2:op_unary"); 		$$ = $1; }
+	 | op_2 MUL op_unary					{ log_grammar("op_2:op_2 * op_unary");	$$ = new BinaryOperationNode($1, $3, BinaryOperationNode::Operation::MULTIPLICATION); }
+	 | op_2 DIV op_unary					{ log_grammar("op_2:op_2 / op_unary");	$$ = new BinaryOperationNode($1, $3, BinaryOperationNode::Operation::DIVISION); }
+
+op_unary : op_3								{ log_grammar("op_unary:op_3");				$$ = $1; }
+		 | NOT op_unary						{ log_grammar("op_unary:not op_unary");		$$ = new UnaryOperationNode($2, UnaryOperationNode::Operation::NOT); }
+		 | HASHTAG op_unary					{ log_grammar("op_unary:# op_unary");		$$ = new UnaryOperationNode($2, UnaryOperationNode::Operation::LENGTH); }
 
 op_3 : op_last								{ log_grammar("op_3:op_last");			$$ = $1; }
 	 | op_3 POWER_OF op_last				{ log_grammar("op_3:op_3 ^ op_last");	$$ = new BinaryOperationNode($1, $3, BinaryOperationNode::Operation::POWER_OF); }
 
 op_last : TRUE								{ log_grammar("op_last:TRUE"); 				$$ = new BooleanNode(true); }
 		| FALSE								{ log_grammar("op_last:FALSE"); 			$$ = new BooleanNode(false); }
+		| NIL								{ log_grammar("op_last:NIL"); 				$$ = NilNode::instance(); }
 		| FLOAT								{ log_grammar("op_last:FLOAT"); 			$$ = new FloatNode($1); }
 		| INTEGER							{ log_grammar("op_last:INTEGER"); 			$$ = new IntegerNode($1); }
-		| STRING							{ log_grammar("op_last:STRING"); 			$$ = new StringNode($1); }
-		| VAR								{ log_grammar("op_last:VAR"); 				$$ = new VariableNode(environment, $1); }
-		| LROUND exp RROUND					{ log_grammar("op_last:LROUND exp RROUND"); $$ = new ParenthesisNode($2); }
+		| STRING							{ log_grammar("op_last:STRING"); 			$$ = new StringNode($1.string()); }
+		| prefixexp							{ log_grammar("op_last:prefixexp"); 		$$ = $1; }
+		| tableconstructor					{ log_grammar("op_last:tableconstructor");	$$ = $1; }
+		| functiondef						{ log_grammar("op_last:functiondef");		$$ = $1; }
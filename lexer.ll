@@ -3,95 +3,150 @@
 #include <stdio.h>
 #include <string>
 #include "globals.h"
+#include "Compilation.h"
+#include "Lexeme.h"
 
-#define YY_DECL yy::parser::symbol_type yylex()
+#define YY_DECL yy::parser::symbol_type scan(yyscan_t yyscanner)
 extern bool debug_lex;
 
-void log_lexer(std::string message)
+#define YY_USER_ACTION yyextra->location.columns(yyleng);
+#define YY_INPUT(buffer, result, size) result = yyextra->readLine(buffer, (int)size); // A line at a time, as refill reads
+
+void log_lexer(const char* message)
 {
 	if (debug_lex)
 		std::cout << "LEX:\t\t " << message << '\n';
 }
 
+// A string's newlines move the location on to the line after them, as the newline rule does
+void countLines(yy::location& location, const char* text, int length)
+{
+	int lines = 0, afterNewline = 0;
+	for (int i = 0; i < length; i++)
+	{
+		if (text[i] == '\n')
+		{
+			lines++;
+			afterNewline = length - i - 1;
+		}
+	}
+
+	if (lines)
+	{
+		location.lines(lines);
+		location.columns(afterNewline);
+	}
+}
+
 }
-%option noyywrap nounput batch noinput
+%option reentrant noyywrap nounput batch noinput
+%option extra-type="Compilation*"
 %%
+%{
+	yyextra->location.step();
+%}
 
  /* Control-flow */
-if						{ log_lexer(yytext); return yy::parser::make_IF(yytext); }
-then					{ log_lexer(yytext); return yy::parser::make_THEN(yytext); }
-elseif					{ log_lexer(yytext); return yy::parser::make_ELSEIF(yytext); }
-else					{ log_lexer(yytext); return yy::parser::make_ELSE(yytext); }
+if						{ log_lexer(yytext); return yy::parser::make_IF(yyextra->location); }
+then					{ log_lexer(yytext); return yy::parser::make_THEN(yyextra->location); }
+elseif					{ log_lexer(yytext); return yy::parser::make_ELSEIF(yyextra->location); }
+else					{ log_lexer(yytext); return yy::parser::make_ELSE(yyextra->location); }
 
  /* Looping */
-for						{ log_lexer(yytext); return yy::parser::make_FOR(yytext); }
-while					{ log_lexer(yytext); return yy::parser::make_WHILE(yytext); }
-repeat					{ log_lexer(yytext); return yy::parser::make_REPEAT(yytext); }
-do						{ log_lexer(yytext); return yy::parser::make_DO(yytext); }
-until					{ log_lexer(yytext); return yy::parser::make_UNTIL(yytext); }
-end						{ log_lexer(yytext); return yy::parser::make_END(yytext); }
-in						{ log_lexer(yytext); return yy::parser::make_IN(yytext); }
+for						{ log_lexer(yytext); return yy::parser::make_FOR(yyextra->location); }
+while					{ log_lexer(yytext); return yy::parser::make_WHILE(yyextra->location); }
+repeat					{ log_lexer(yytext); return yy::parser::make_REPEAT(yyextra->location); }
+do						{ log_lexer(yytext); return yy::parser::make_DO(yyextra->location); }
+until					{ log_lexer(yytext); return yy::parser::make_UNTIL(yyextra->location); }
+end						{ log_lexer(yytext); return yy::parser::make_END(yyextra->location); }
+in						{ log_lexer(yytext); return yy::parser::make_IN(yyextra->location); }
 
  /* Binary operations */
-\+						{ log_lexer(yytext); return yy::parser::make_PLUS(yytext); }
-\-						{ log_lexer(yytext); return yy::parser::make_MINUS(yytext); }
-\*						{ log_lexer(yytext); return yy::parser::make_MUL(yytext); }
-\/						{ log_lexer(yytext); return yy::parser::make_DIV(yytext); }
-\^						{ log_lexer(yytext); return yy::parser::make_POWER_OF(yytext); }
-\%						{ log_lexer(yytext); return yy::parser::make_MOD(yytext); }
-\=\=					{ log_lexer(yytext); return yy::parser::make_EQUALS(yytext); }
-\!\=					{ log_lexer(yytext); return yy::parser::make_NOT_EQUALS(yytext); }
-\<						{ log_lexer(yytext); return yy::parser::make_LESS(yytext); }
-\>						{ log_lexer(yytext); return yy::parser::make_MORE(yytext); }
-\<\=					{ log_lexer(yytext); return yy::parser::make_LESS_OR_EQUAL(yytext); }
-\>\=					{ log_lexer(yytext); return yy::parser::make_MORE_OR_EQUAL(yytext); }
-\~\=					{ log_lexer(yytext); return yy::parser::make_TILDE_EQUAL(yytext); }
+\+						{ log_lexer(yytext); return yy::parser::make_PLUS(yyextra->location); }
+\-						{ log_lexer(yytext); return yy::parser::make_MINUS(yyextra->location); }
+\*						{ log_lexer(yytext); return yy::parser::make_MUL(yyextra->location); }
+\/						{ log_lexer(yytext); return yy::parser::make_DIV(yyextra->location); }
+\^						{ log_lexer(yytext); return yy::parser::make_POWER_OF(yyextra->location); }
+\%						{ log_lexer(yytext); return yy::parser::make_MOD(yyextra->location); }
+\=\=					{ log_lexer(yytext); return yy::parser::make_EQUALS(yyextra->location); }
+\!\=					{ log_lexer(yytext); return yy::parser::make_NOT_EQUALS(yyextra->location); }
+\<						{ log_lexer(yytext); return yy::parser::make_LESS(yyextra->location); }
+\>						{ log_lexer(yytext); return yy::parser::make_MORE(yyextra->location); }
+\<\=					{ log_lexer(yytext); return yy::parser::make_LESS_OR_EQUAL(yyextra->location); }
+\>\=					{ log_lexer(yytext); return yy::parser::make_MORE_OR_EQUAL(yyextra->location); }
+\~\=					{ log_lexer(yytext); return yy::parser::make_TILDE_EQUAL(yyextra->location); }
 
  /* Unary operations */
-not						{ log_lexer(yytext); return yy::parser::make_NOT(yytext); }
-and						{ log_lexer(yytext); return yy::parser::make_AND(yytext); }
-or						{ log_lexer(yytext); return yy::parser::make_OR(yytext); }
-\#						{ log_lexer(yytext); return yy::parser::make_HASHTAG(yytext); }
+not						{ log_lexer(yytext); return yy::parser::make_NOT(yyextra->location); }
+and						{ log_lexer(yytext); return yy::parser::make_AND(yyextra->location); }
+or						{ log_lexer(yytext); return yy::parser::make_OR(yyextra->location); }
+\#						{ log_lexer(yytext); return yy::parser::make_HASHTAG(yyextra->location); }
 
  /* Scope */
-local					{ log_lexer(yytext); return yy::parser::make_LOCAL(yytext); }
+local					{ log_lexer(yytext); return yy::parser::make_LOCAL(yyextra->location); }
 
  /* Functions */
-function				{ log_lexer(yytext); return yy::parser::make_FUNCTION(yytext); }
-break					{ log_lexer(yytext); return yy::parser::make_BREAK(yytext); }
-return					{ log_lexer(yytext); return yy::parser::make_RETURN(yytext); }
-(print)					{ log_lexer(yytext); return yy::parser::make_PRINT(yytext); }
+function				{ log_lexer(yytext); return yy::parser::make_FUNCTION(yyextra->location); }
+break					{ log_lexer(yytext); return yy::parser::make_BREAK(yyextra->location); }
+return					{ log_lexer(yytext); return yy::parser::make_RETURN(yyextra->location); }
+(print)					{ log_lexer(yytext); return yy::parser::make_PRINT(yyextra->location); }
 
  /* Values */
-nil						{ log_lexer(yytext); return yy::parser::make_NIL(yytext); }
-false					{ log_lexer(yytext); return yy::parser::make_FALSE(yytext); }
-true					{ log_lexer(yytext); return yy::parser::make_TRUE(yytext); }
-[0-9]+\.[0-9]+	 		{ log_lexer(yytext); return yy::parser::make_FLOAT(std::stof(yytext)); }
-\-[0-9]+				{ log_lexer(yytext); return yy::parser::make_INTEGER(std::stoi(yytext)); }
-[0-9]+					{ log_lexer(yytext); return yy::parser::make_INTEGER(std::stoi(yytext)); }
+nil						{ log_lexer(yytext); return yy::parser::make_NIL(yyextra->location); }
+false					{ log_lexer(yytext); return yy::parser::make_FALSE(yyextra->location); }
+true					{ log_lexer(yytext); return yy::parser::make_TRUE(yyextra->location); }
+[0-9]+\.[0-9]+	 		{ log_lexer(yytext); return yy::parser::make_FLOAT(parseFloat(yytext, yyleng), yyextra->location); }
+\-?[0-9]+				{ log_lexer(yytext); int integer = 0;
+						  if (parseInteger(yytext, yyleng, integer)) return yy::parser::make_INTEGER(integer, yyextra->location);
+						  return yy::parser::make_FLOAT(parseFloat(yytext, yyleng), yyextra->location); /* Too big for an int, as in Lua */ }
 
-\"[^\"]*\"				{ log_lexer(yytext); std::string str = yytext; return yy::parser::make_STRING(str.substr(1, yyleng - 2)); }
-[a-zA-Z_][a-zA-Z0-9_]*	{ log_lexer(yytext); return yy::parser::make_VAR(yytext); }
+\"[^\"]*\"				{ log_lexer(yytext); countLines(yyextra->location, yytext, yyleng); return yy::parser::make_STRING(yyextra->lexeme(yytext + 1, yyleng - 2), yyextra->location); }
+[a-zA-Z_][a-zA-Z0-9_]*	{ log_lexer(yytext); return yy::parser::make_VAR(yyextra->lexeme(yytext, yyleng), yyextra->location); }
 
  /* Single-character tokens */
-\=						{ log_lexer(yytext); return yy::parser::make_ASSIGNMENT(yytext); }
-\.						{ log_lexer(yytext); return yy::parser::make_DOT(yytext); }
-\:						{ log_lexer(yytext); return yy::parser::make_COLON(yytext); }
-\;						{ log_lexer(yytext); return yy::parser::make_SEMICOLON(yytext); }
-\,						{ log_lexer(yytext); return yy::parser::make_COMMA(yytext); }
-\(						{ log_lexer(yytext); return yy::parser::make_LROUND(yytext); }
-\)						{ log_lexer(yytext); return yy::parser::make_RROUND(yytext); }
-\[						{ log_lexer(yytext); return yy::parser::make_LSQUARE(yytext); }
-\]						{ log_lexer(yytext); return yy::parser::make_RSQUARE(yytext); }
-\{						{ log_lexer(yytext); return yy::parser::make_LCURLY(yytext); }
-\}						{ log_lexer(yytext); return yy::parser::make_RCURLY(yytext); }
-
- /* Whitespace */
-" "+					{ log_lexer("( )+"); /*return yy::parser::make_WHITESPACE(yytext);*/ }
-\t+						{ log_lexer("(\\t)+"); /*return yy::parser::make_WHITESPACE(yytext);*/ }
-\n+						{ log_lexer("(\\n)+"); /*return yy::parser::make_NEWLINE(yytext);*/ }
+\=						{ log_lexer(yytext); return yy::parser::make_ASSIGNMENT(yyextra->location); }
+\.						{ log_lexer(yytext); return yy::parser::make_DOT(yyextra->location); }
+\:						{ log_lexer(yytext); return yy::parser::make_COLON(yyextra->location); }
+\;						{ log_lexer(yytext); return yy::parser::make_SEMICOLON(yyextra->location); }
+\,						{ log_lexer(yytext); return yy::parser::make_COMMA(yyextra->location); }
+\(						{ log_lexer(yytext); return yy::parser::make_LROUND(yyextra->location); }
+\)						{ log_lexer(yytext); return yy::parser::make_RROUND(yyextra->location); }
+\[						{ log_lexer(yytext); return yy::parser::make_LSQUARE(yyextra->location); }
+\]						{ log_lexer(yytext); return yy::parser::make_RSQUARE(yyextra->location); }
+\{						{ log_lexer(yytext); return yy::parser::make_LCURLY(yyextra->location); }
+\}						{ log_lexer(yytext); return yy::parser::make_RCURLY(yyextra->location); }
+
+ /* Whitespace and comments */
+" "+					{ log_lexer("( )+"); yyextra->location.step(); /*return yy::parser::make_WHITESPACE(yyextra->location);*/ }
+\t+						{ log_lexer("(\\t)+"); yyextra->location.step(); /*return yy::parser::make_WHITESPACE(yyextra->location);*/ }
+\n+						{ log_lexer("(\\n)+"); yyextra->location.lines(yyleng); yyextra->location.step(); /*return yy::parser::make_NEWLINE(yyextra->location);*/ }
+"--"[^\n]*				{ log_lexer(yytext); yyextra->location.step(); }
 
  /* Misc */
-<<EOF>>					{ return yy::parser::make_EXIT(); }
+<<EOF>>					{ return yy::parser::make_EXIT(yyextra->location); }
 
 %%
+
+// Scans the compilation's source in place, flex only needs the two zeros at its end. A streamed
+// one flex reads itself, into buffers it reuses, so the compilation copies token text out
+void openScanner(Compilation& compilation)
+{
+	yyscan_t scanner = nullptr;
+	yylex_init_extra(&compilation, &scanner);
+	if (compilation.input)
+		yyset_in(compilation.input, scanner);
+	else
+		yy_scan_buffer(compilation.source.data(), compilation.length + 2, scanner);
+	compilation.scanner = scanner;
+}
+
+void closeScanner(Compilation& compilation)
+{
+	yylex_destroy(compilation.scanner);
+	compilation.scanner = nullptr;
+}
+
+yy::parser::symbol_type nextToken(Compilation& compilation)
+{
+	return scan(compilation.scanner);
+}
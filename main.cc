@@ -1,6 +1,13 @@
+#include <algorithm>
+#include <iomanip>
 #include <iostream>
+#include <memory>
 #include "grammar.tab.hh"
 #include "globals.h"
+#include "Compilation.h"
+#include "Records.h"
+#include "Snapshot.h"
+#include "ThreadPool.h"
 
 
 bool debug_lex = false;
@@ -8,17 +15,223 @@ bool debug_grammar = false;
 bool debug_assignments = false;
 bool debug_calls = false;
 bool debug_evaluations = false;
+bool dump_ir = false;
+long unsigned int memo_capacity = 0; // Results kept per pure function, 0 keeps none
+long unsigned int compile_jobs = ThreadPool::defaultSize(); // Threads optimizing function bodies
+bool lazy_functions = false; // Function bodies are parsed on their first call
 
-void yy::parser::error(std::string const&err)
+// Prints the tokens instead of running, one per line with its location and kind, for comparing scanners
+static void printTokens(Compilation& compilation)
 {
-	std::cout << "It's one of the bad ones... " << err << std::endl;
+	openScanner(compilation);
+	while (true)
+	{
+		yy::parser::symbol_type token = yylex(compilation);
+		std::cout << token.location << ' ' << static_cast<int>(token.kind());
+
+		switch (token.kind())
+		{
+			case yy::parser::symbol_kind::S_VAR:
+			case yy::parser::symbol_kind::S_STRING:
+				std::cout << ' ' << token.value.as<Lexeme>().string();
+				break;
+			case yy::parser::symbol_kind::S_INTEGER:
+				std::cout << ' ' << token.value.as<int>();
+				break;
+			case yy::parser::symbol_kind::S_FLOAT:
+				std::cout << ' ' << std::setprecision(9) << token.value.as<float>();
+				break;
+			default:
+				break;
+		}
+		std::cout << '\n';
+
+		if (token.kind() == yy::parser::symbol_kind::S_YYEOF)
+			break;
+	}
+	closeScanner(compilation);
+}
+
+// Parses and optimizes the files at once, each on a thread of its own, without running them.
+// Prints their syntax errors in the order given, or success
+static int compileFiles(const std::vector<std::string>& files)
+{
+	std::vector<std::unique_ptr<Compilation>> compilations;
+	ThreadPool pool(compile_jobs);
+	for (auto& file : files)
+	{
+		compilations.emplace_back(new Compilation(file, 1, new Environment()));
+		Compilation* compilation = compilations.back().get();
+		pool.submit([compilation]
+		{
+			FILE* source = fopen(compilation->name.c_str(), "rb");
+			if (!source)
+			{
+				compilation->errors.push_back("It's one of the bad ones... " + compilation->name + ": can not open");
+				return;
+			}
+			compilation->load(source);
+			fclose(source);
+			compilation->parse();
+		});
+	}
+	pool.wait();
+
+	int status = 0;
+	for (auto& compilation : compilations)
+	{
+		for (auto& error : compilation->errors)
+			std::cout << error << '\n';
+		if (!compilation->errors.empty())
+			status = 1;
+	}
+
+	if (status == 0)
+		std::cout << "success\n";
+	return status;
+}
+
+// Runs the files in turn as versions of one script, each reparsed from the one before and run
+// on what the ones before left. Stops at none of the errors
+static int reloadFiles(const std::vector<std::string>& files)
+{
+	Compilation compilation("", compile_jobs, new Environment());
+	compilation.isReparsable = true;
+
+	int status = 0;
+	for (auto& file : files)
+	{
+		FILE* source = fopen(file.c_str(), "rb");
+		if (!source)
+		{
+			std::cout << "It's one of the bad ones... " << file << ": can not open\n";
+			status = 1;
+			continue;
+		}
+
+		compilation.name = file;
+		*compilation.sourceName = file; // Also for the functions kept from the versions before
+		bool isParsed = compilation.reparse(source);
+		fclose(source);
+
+		compilation.environment->output.flush();
+		for (auto& error : compilation.errors)
+			std::cout << error << '\n';
+		if (!isParsed)
+		{
+			status = 1;
+			continue;
+		}
+
+		Environment* environment = compilation.environment;
+		environment->unwind(0);
+		environment->controlFlow = Environment::ControlFlow::NORMAL;
+		environment->source = compilation.sourceName;
+		try
+		{
+			compilation.root->execute();
+		}
+		catch (RuntimeError& error)
+		{
+			environment->output.flush();
+			std::cout << "RUNTIME ERROR: " << error.describe(*environment->source, environment->line) << '\n';
+			status = 1;
+		}
+	}
+
+	compilation.environment->output.flush();
+	return status;
+}
+
+// Runs the file in the environment stdin then runs in. With a snapshot, restores the globals
+// a run of the same file saved there instead, or saves them once it ran
+static bool runPrelude(const std::string& file, const std::string& snapshot, Environment* environment)
+{
+	FILE* source = fopen(file.c_str(), "rb");
+	if (!source)
+	{
+		std::cout << "It's one of the bad ones... " << file << ": can not open\n";
+		return false;
+	}
+
+	Compilation compilation(file, compile_jobs, environment);
+	compilation.load(source);
+	fclose(source);
+
+	uint64_t hash = Chunk::hash(compilation.source.data(), compilation.length);
+	if (!snapshot.empty() && Snapshot::load(snapshot, hash, environment, compilation.sourceName))
+		return true;
+
+	bool isParsed = compilation.parse();
+	for (auto& error : compilation.errors)
+		std::cout << error << '\n';
+	if (!isParsed)
+		return false;
+
+	environment->source = compilation.sourceName;
+	try
+	{
+		compilation.root->execute();
+	}
+	catch (RuntimeError& error)
+	{
+		environment->output.flush();
+		std::cout << "RUNTIME ERROR: " << error.describe(*environment->source, environment->line) << '\n';
+		return false;
+	}
+
+	if (!snapshot.empty())
+		Snapshot::save(snapshot, hash, environment);
+
+	return true;
+}
+
+// Runs the file for every line of stdin or the input file, in as many states as shards, see Records.
+// Every state runs the prelude first
+static int eachLine(const std::string& file, long unsigned int shards, const std::string& prelude, const std::string& snapshot, const std::string& input)
+{
+	std::vector<Environment*> environments;
+	for (long unsigned int i = 0; i < std::max(shards, 1ul); i++)
+	{
+		environments.push_back(new Environment());
+		if (!prelude.empty() && !runPrelude(prelude, snapshot, environments.back()))
+			return 1;
+	}
+
+	Records records;
+	if (!records.parse(file, environments))
+		return 1;
+
+	if (!input.empty() && !records.open(input))
+	{
+		std::cout << "It's one of the bad ones... " << input << ": can not open\n";
+		return 1;
+	}
+
+	return records.run();
+}
+
+void yy::parser::error(const location_type& location, std::string const&err)
+{
+	compilation.errors.push_back("It's one of the bad ones... " + compilation.name + ":" + std::to_string(location.begin.line) + ": " + err);
 }
 
 int main(int argc, char **argv)
 {
-	if (argc == 2)
+	bool isPrintingTokens = false;
+	bool isCompiling = false;
+	bool isStreaming = false;
+	bool isReloading = false;
+	std::string chunk = "";
+	std::string prelude = "";
+	std::string snapshot = "";
+	std::string input = "";
+	std::string records = "";
+	long unsigned int shards = 1;
+	std::vector<std::string> files;
+	for (int i = 1; i < argc; i++)
 	{
-		std::string argument = argv[1];
+		std::string argument = argv[i];
 		if (argument == "nodebug")
 		{
 			debug_lex = false;
@@ -27,16 +240,98 @@ int main(int argc, char **argv)
 			debug_calls = false;
 			debug_evaluations = false;
 		}
+		else if (argument == "dumpir") // Prints what value numbering reused and hoisted
+			dump_ir = true;
+		else if (argument == "tokens")
+			isPrintingTokens = true;
+		else if (argument == "memo") // Caches the results of pure functions
+			memo_capacity = 256;
+		else if (argument.compare(0, 5, "memo=") == 0)
+			memo_capacity = std::stoul(argument.substr(5));
+		else if (argument.compare(0, 5, "jobs=") == 0) // Threads optimizing function bodies, the output is the same for any
+			compile_jobs = std::stoul(argument.substr(5));
+		else if (argument == "lazy") // Parses function bodies on their first call, and only those called
+			lazy_functions = true;
+		else if (argument.compare(0, 6, "cache=") == 0) // Runs the tree saved in the file when it is of stdin, else parses and saves it
+			chunk = argument.substr(6);
+		else if (argument.compare(0, 8, "prelude=") == 0) // Runs the file before stdin, in the same globals
+			prelude = argument.substr(8);
+		else if (argument.compare(0, 9, "snapshot=") == 0) // Restores the globals the prelude left from the file when it is of that prelude, else runs it and saves them
+			snapshot = argument.substr(9);
+		else if (argument.compare(0, 6, "input=") == 0) // What io reads instead of what is left of stdin
+			input = argument.substr(6);
+		else if (argument.compare(0, 10, "each-line=") == 0) // Runs the file for every line of stdin, the line in the global line
+			records = argument.substr(10);
+		else if (argument.compare(0, 7, "shards=") == 0) // States each-line runs blocks of lines in, on threads of their own, the output kept in order
+			shards = std::stoul(argument.substr(7));
+		else if (argument == "stream") // Runs each statement of the main chunk once it is parsed, and keeps none
+			isStreaming = true;
+		else if (argument == "compile") // Checks the files after it instead of running stdin
+			isCompiling = true;
+		else if (argument == "reload") // Runs the files after it as versions of one script, reparsing only what changed
+			isReloading = true;
+		else if (isCompiling || isReloading)
+			files.push_back(argument);
+	}
+
+	if (isCompiling)
+		return compileFiles(files);
+	if (isReloading)
+		return reloadFiles(files);
+	if (!records.empty())
+		return eachLine(records, shards, prelude, snapshot, input);
+
+	Environment* environment = new Environment();
+	if (!input.empty() && !environment->input.open(input))
+	{
+		std::cout << "It's one of the bad ones... " << input << ": can not open\n";
+		return 1;
 	}
+	if (!prelude.empty() && !runPrelude(prelude, snapshot, environment))
+		return 1;
 
+	Compilation compilation("stdin", compile_jobs, environment);
+	if (isStreaming)
+		compilation.stream(stdin);
+	else
+		compilation.load(stdin);
 
-	std::string graph = "";
-	yy::parser parser;
-	if(!parser.parse())
+	if (isPrintingTokens)
 	{
-		root->execute();
-		root->createGraphViz();
+		printTokens(compilation);
+		return 0;
 	}
 
-	return 0;
+	int status = 0;
+	bool isParsed = false;
+	try
+	{
+		if (!chunk.empty() && !isStreaming && compilation.loadChunk(chunk))
+			isParsed = true;
+		else
+		{
+			compilation.chunk = chunk;
+			isParsed = compilation.parse(); // A streamed compilation runs as it is parsed
+		}
+		if (isParsed && compilation.root)
+		{
+			environment->source = compilation.sourceName;
+			compilation.root->execute();
+		}
+	}
+	catch (RuntimeError& error)
+	{
+		environment->output.flush();
+		std::cout << "RUNTIME ERROR: " << error.describe(*environment->source, environment->line) << '\n';
+		status = 1;
+	}
+	environment->output.flush();
+
+	if (isParsed && compilation.root)
+		compilation.root->createGraphViz();
+
+	for (auto& error : compilation.errors)
+		std::cout << error << std::endl;
+
+	return status;
 }
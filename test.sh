@@ -12,6 +12,12 @@ check_output ()
 	fi
 }
 
+# Peak memory in kB of ./parser stream running the file, its lines after "-- Repeated" repeated to make the count given
+stream_peak ()
+{
+	{ sed '/^-- Repeated/q' $1; yes "$(sed '1,/^-- Repeated/d' $1)" | head -n $2; echo 'io.write(io.read("a"))'; } | ./parser nodebug stream input=/proc/self/status | awk '/^VmHWM:/ { print $2 }'
+}
+
 file="testInputs/intTest.txt"
 output=$(cat testInputs/intTest.txt | ./parser nodebug)
 check_output $output $file
@@ -31,3 +37,127 @@ check_output $output $file
 file="testInputs/varTest.txt"
 output=$(cat testInputs/varTest.txt | ./parser nodebug)
 check_output $output $file
+
+file="testInputs/metatableTest.txt"
+output=$(cat testInputs/metatableTest.txt | ./parser nodebug)
+check_output $output $file
+
+file="testInputs/forTest.txt"
+output=$(cat testInputs/forTest.txt | ./parser nodebug)
+check_output $output $file
+
+file="testInputs/loopTest.txt"
+output=$(cat testInputs/loopTest.txt | ./parser nodebug)
+check_output $output $file
+
+file="testInputs/logicTest.txt"
+output=$(cat testInputs/logicTest.txt | ./parser nodebug)
+check_output $output $file
+
+file="testInputs/errorTest.txt"
+output=$(cat testInputs/errorTest.txt | ./parser nodebug)
+check_output $output $file
+
+file="testInputs/foldTest.txt"
+output=$(cat testInputs/foldTest.txt | ./parser nodebug)
+check_output $output $file
+
+file="testInputs/deadCodeTest.txt"
+output=$(cat testInputs/deadCodeTest.txt | ./parser nodebug)
+check_output $output $file
+
+file="testInputs/valueNumberingTest.txt"
+output=$(cat testInputs/valueNumberingTest.txt | ./parser nodebug)
+check_output $output $file
+
+file="testInputs/inPlaceTest.txt"
+output=$(cat testInputs/inPlaceTest.txt | ./parser nodebug)
+check_output $output $file
+
+file="testInputs/vectorTest.txt"
+output=$(cat testInputs/vectorTest.txt | ./parser nodebug)
+check_output $output $file
+
+file="testInputs/inlineTest.txt"
+output=$(cat testInputs/inlineTest.txt | ./parser nodebug)
+check_output $output $file
+
+file="testInputs/memoTest.txt"
+output=$(cat testInputs/memoTest.txt | ./parser nodebug memo=4)
+check_output $output $file
+
+file="testInputs/parallelTest.txt"
+output=$(cat testInputs/parallelTest.txt | ./parser nodebug jobs=8)
+check_output $output $file
+
+file="testInputs/parallelTest.txt"
+output=$(cmp -s <(./parser nodebug dumpir jobs=1 < testInputs/parallelTest.txt) <(./parser nodebug dumpir jobs=8 < testInputs/parallelTest.txt) && echo success)
+check_output $output $file
+
+file="testInputs/streamTest.txt"
+output=$(cat testInputs/streamTest.txt | ./parser nodebug stream)
+check_output $output $file
+
+file="testInputs/streamMemoryTest.txt"
+output=$(small=$(stream_peak testInputs/streamMemoryTest.txt 10000); large=$(stream_peak testInputs/streamMemoryTest.txt 100000); [ "$large" -le $((small + 512)) ] && echo success)
+check_output $output $file
+
+file="testInputs/reloadTest.txt"
+output=$(./parser nodebug reload testInputs/reloadTest.txt testInputs/reloadTestEdited.txt)
+check_output $output $file
+
+file="testInputs/lazyTest.txt"
+output=$(./parser nodebug lazy < testInputs/lazyTest.txt)
+check_output $output $file
+
+file="testInputs/lazyTest.txt"
+output=$(printf 'function broken()\n\tx = = 1\nend\nok, message = pcall(broken)\nif message == "stdin:2: syntax error" then print("success") end\n' | ./parser nodebug lazy)
+check_output $output $file
+
+file="testInputs/chunkTest.txt"
+output=$(./parser nodebug cache=chunkTest.chunk < testInputs/chunkTest.txt > /dev/null; ./parser nodebug cache=chunkTest.chunk < testInputs/chunkTest.txt; rm -f chunkTest.chunk)
+check_output $output $file
+
+file="testInputs/snapshotTest.txt"
+output=$(./parser nodebug prelude=testInputs/snapshotPrelude.txt snapshot=snapshotTest.snapshot < testInputs/snapshotTest.txt > /dev/null; ./parser nodebug prelude=testInputs/snapshotPrelude.txt snapshot=snapshotTest.snapshot < testInputs/snapshotTest.txt; rm -f snapshotTest.snapshot)
+check_output $output $file
+
+file="testInputs/printTest.txt"
+output=$(./parser nodebug < testInputs/printTest.txt | cmp -s - testInputs/printTest.expected && echo success)
+check_output $output $file
+
+file="testInputs/ioTest.txt"
+output=$(./parser nodebug input=testInputs/ioTest.data < testInputs/ioTest.txt)
+check_output $output $file
+
+file="testInputs/ioTest.txt"
+output=$(cat testInputs/ioTest.data | ./parser nodebug input=/dev/fd/3 3<&0 < testInputs/ioTest.txt)
+check_output $output $file
+
+file="testInputs/eachLineTest.txt"
+output=$(./parser nodebug each-line=testInputs/eachLineTest.txt < testInputs/eachLineTest.data)
+check_output $output $file
+
+file="testInputs/eachLineTest.txt"
+output=$(cat testInputs/eachLineTest.data | ./parser nodebug each-line=testInputs/eachLineTest.txt shards=3)
+check_output $output $file
+
+file="testInputs/shardTest.txt"
+output=$({ yes "$(printf '%063d' 0)" | head -n 98304; echo last; } | ./parser nodebug each-line=testInputs/shardTest.txt shards=3)
+check_output $output $file
+
+file="Compilation.cc"
+output=$(./parser nodebug jobs=8 compile testInputs/*.txt testInputs/*.txt)
+check_output $output $file
+
+file="Scanner.cc"
+if which flex > /dev/null; then
+	output=$(make -s scanner-check)
+	check_output $output $file
+else
+	echo "Skipping $file, the scanners are compared with flex's"
+fi
+
+file="benchmark.sh"
+output=$(bash benchmark.sh)
+check_output $output $file